@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "ad.h"
@@ -8,87 +9,136 @@
 Ret ret;
 Domain *symTable;
 Symbol *crtFn;
+bool traceSymbols=true;
+
+static Arena symArena=ARENA("symbols");		// domains and symbols
+// the args of the functions; they are not in symArena because a function symbol
+// is in the parent domain, but its args are added while its own domain is the current one
+static Arena argsArena=ARENA("fn args");
+
+// an entry of the names map
+// the entries are never deleted, only their "top" becomes NULL when the name is no longer visible
+typedef struct{
+	const char *name;
+	Symbol *top;		// the innermost visible symbol with this name or NULL
+	}Binding;
+
+// open addressing with linear probing on the name pointer
+// the capacity is always a power of 2 and the map is at most half full
+static Binding *bindings;
+static size_t nBindings,capBindings;
+
+static size_t hashPtr(const char *name){
+	return (size_t)(((uintptr_t)name>>3)*0x9E3779B97F4A7C15ull);
+	}
+
+// returns the entry of the name, or the empty entry where it must be added
+static Binding *findBinding(const char *name){
+	size_t i=hashPtr(name)&(capBindings-1);
+	while(bindings[i].name&&bindings[i].name!=name)i=(i+1)&(capBindings-1);
+	return &bindings[i];
+	}
+
+// doubles the capacity, dropping the entries of the names which are no longer visible
+static void growBindings(){
+	Binding *old=bindings;
+	size_t oldCap=capBindings;
+	capBindings=capBindings?capBindings*2:1024;
+	bindings=(Binding*)calloc(capBindings,sizeof(Binding));
+	if(!bindings)err("not enough memory");
+	nBindings=0;
+	for(size_t i=0;i<oldCap;i++){
+		if(!old[i].top)continue;
+		*findBinding(old[i].name)=old[i];
+		nBindings++;
+		}
+	free(old);
+	}
 
 Domain *addDomain(){
-	puts("creates a new domain");
-	Domain *d=(Domain*)safeAlloc(sizeof(Domain));
+	if(traceSymbols)puts("creates a new domain");
+	ArenaMark mark=arenaMark(&symArena);
+	Domain *d=(Domain*)arenaAlloc(&symArena,sizeof(Domain));
+	d->mark=mark;
 	d->parent=symTable;
 	d->symbols=NULL;
 	symTable=d;
 	return d;
 }
 
-void delSymbols(Symbol *list);
-
 void delSymbol(Symbol *s){
+	if(!traceSymbols)return;
 	printf("\tdeletes the symbol %s\n",s->name);
 	if(s->kind==KIND_FN){
-		delSymbols(s->args);
+		for(int i=0;i<s->nArgs;i++){
+			printf("\tdeletes the symbol %s\n",s->args[i].name);
+			}
 		}
-	free(s);
 	}
 
+// deletes the symbols of a domain and makes visible the symbols they shadowed
 void delSymbols(Symbol *list){
 	for(Symbol *s1=list,*s2;s1;s1=s2){
 		s2=s1->next;
+		findBinding(s1->name)->top=s1->shadowed;
 		delSymbol(s1);
 		}
 	}
 
 void delDomain(){
-	puts("deletes the current domain");
+	if(traceSymbols)puts("deletes the current domain");
 	Domain *parent=symTable->parent;
 	delSymbols(symTable->symbols);
-	free(symTable);
+	arenaRelease(&symArena,symTable->mark);
 	symTable=parent;
-	puts("returns to the parent domain");
-	}
-
-Symbol *searchInList(Symbol *list,const char *name){
-	for(Symbol *s=list;s;s=s->next){
-		if(!strcmp(s->name,name))return s;
-		}
-	return NULL;
+	if(traceSymbols)puts("returns to the parent domain");
 	}
 
 Symbol *searchInCurrentDomain(const char *name){
-	return searchInList(symTable->symbols,name);
+	Symbol *s=searchSymbol(name);
+	return s&&s->domain==symTable?s:NULL;
 	}
 
 Symbol *searchSymbol(const char *name){
-	for(Domain *d=symTable;d;d=d->parent){
-		Symbol *s=searchInList(d->symbols,name);
-		if(s)return s;
-		}
-	return NULL;
+	if(!capBindings)return NULL;
+	return findBinding(name)->top;
 	}
 
 Symbol *createSymbol(const char *name,int kind){
-	Symbol *s=(Symbol*)safeAlloc(sizeof(Symbol));
+	Symbol *s=(Symbol*)arenaAlloc(&symArena,sizeof(Symbol));
+	memset(s,0,sizeof(Symbol));
 	s->name=name;
 	s->kind=kind;
 	return s;
 	}
 
 Symbol *addSymbol(const char *name,int kind){
-	printf("\tadds symbol %s\n",name);
+	if(traceSymbols)printf("\tadds symbol %s\n",name);
 	Symbol *s=createSymbol(name,kind);
+	s->domain=symTable;
 	s->next=symTable->symbols;
 	symTable->symbols=s;
+	if(2*(nBindings+1)>capBindings)growBindings();
+	Binding *b=findBinding(name);
+	if(!b->name){
+		b->name=name;
+		nBindings++;
+		}
+	s->shadowed=b->top;
+	b->top=s;
 	return s;
 	}
 
 Symbol *addFnArg(Symbol *fn,const char *argName){
-	printf("\tadds symbol %s as argument\n",argName);
-	Symbol *s=createSymbol(argName,KIND_ARG);
-	s->next=NULL;
-	if(fn->args){
-		Symbol *p;
-		for(p=fn->args;p->next;p=p->next){}
-		p->next=s;
-		}else{
-		fn->args=s;
+	if(traceSymbols)printf("\tadds symbol %s as argument\n",argName);
+	if(fn->nArgs==fn->capArgs){
+		int capArgs=fn->capArgs?fn->capArgs*2:4;
+		fn->args=(Symbol*)arenaGrow(&argsArena,fn->args,fn->capArgs*sizeof(Symbol),capArgs*sizeof(Symbol));
+		fn->capArgs=capArgs;
 		}
+	Symbol *s=&fn->args[fn->nArgs++];
+	memset(s,0,sizeof(Symbol));
+	s->name=argName;
+	s->kind=KIND_ARG;
 	return s;
 	}
-
@@ -2,9 +2,12 @@
 
 #include <stdbool.h>
 
+#include "utils.h"
+
 typedef struct{
 	int type;		// TYPE_*
 	bool lval;	// if it is a left-value (required for types analysis)
+	int node;		// the AST node built by the rule (see ast.h)
 	}Ret;
 
 extern Ret ret;	// used to store data returned from some syntactic rules
@@ -12,35 +15,53 @@ extern Ret ret;	// used to store data returned from some syntactic rules
 enum{KIND_VAR,KIND_ARG,KIND_FN};
 
 struct Symbol;typedef struct Symbol Symbol;
+struct Domain;typedef struct Domain Domain;
 struct Symbol{
-	const char *name;		// reference to a name stored in a token
+	const char *name;		// the interned name (see atoms.h), so names are compared by pointer
 	int kind;		// KIND_*
 	int type;	// TYPE_* from tokens
 	union{
-		Symbol *args;	// for functions: the list with the function args
+		struct{		// for functions
+			Symbol *args;	// the function args, in a contiguous array
+			int nArgs;		// nr of args
+			int capArgs;		// nr of allocated args
+			};
 		bool local;		// for vars: if it is local
 		};
+	Domain *domain;		// the domain which contains this symbol
+	Symbol *shadowed;		// the symbol with the same name from an outer domain, which is hidden by this one
 	Symbol *next;		// link to the next Symbol in list
 	};
 
-struct Domain;typedef struct Domain Domain;
+// The symbols table has a hash map from each name to its innermost symbol.
+// Each symbol links to the symbol with the same name which it shadows,
+// so all the visible bindings of a name form a stack.
+// Each domain keeps the list of its symbols, which is used to restore the shadowed symbols
+// when the domain is deleted.
+// The domains and their symbols are allocated in an arena, so deleting a domain
+// frees all its memory at once, by returning the arena to the mark from the domain creation.
 struct Domain{
 	Domain *parent;		// the parent of this domain or NULL for the global domain
 	Symbol *symbols;		// simple linked list of symbols
+	ArenaMark mark;		// the state of the symbols arena before the domain was created
 	};
 
 extern Domain *symTable;	// the symbols table (implemented as a stack of domains)
+extern bool traceSymbols;	// if true, the added and deleted domains and symbols are shown (the default)
 
 // pointer the symbol of current function, if a function is parsed
 // or NULL outside functions
 extern Symbol *crtFn;
 
+// all the names must be interned (returned by intern from atoms.h)
 Domain *addDomain();		// adds a new domain to ST as the current domain
 void delDomain();	// deletes the current domain from ST and returns the the last one
 Symbol *searchInCurrentDomain(const char *name);		// searches a symbol by name only in the current domain
 Symbol *searchSymbol(const char *name);		// searches in all domains
 Symbol *addSymbol(const char *name,int kind);	// adds a symbol to the current domain
-Symbol *addFnArg(Symbol *fn,const char *argName);	// adds an argument to the symbol fn
+// adds an argument to the symbol fn
+// the returned pointer is valid only until the next argument is added
+Symbol *addFnArg(Symbol *fn,const char *argName);
 
 
 
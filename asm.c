@@ -0,0 +1,967 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asm.h"
+#include "ast.h"
+#include "ir.h"
+#include "lexer.h"
+#include "utils.h"
+
+bool asmMode;
+static AsmStats stats;
+static Arena asmArena = ARENA("asm");
+
+// the general registers, by their x86-64 number, then the SSE2 registers
+enum{RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15, XMM0, XMM1, XMM8 = XMM0 + 8};
+static const char *const regs64[16] = {"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
+static const char *const regs32[16] = {"%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+    "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"};
+static const int argRegs[6] = {RDI, RSI, RDX, RCX, R8, R9};
+// rax, rcx, rdx, xmm0 and xmm1 are the temporaries of the generated instructions and the registers
+// of the arguments are not allocated, so the arguments of a call are set without conflicts
+static const int callerSaved[] = {R10, R11};
+static const int calleeSaved[] = {RBX, R12, R13, R14, R15};
+#define N_CALLEE_SAVED 5
+#define N_XMM 8                 // xmm8-xmm15, which are all saved by the caller
+
+// a location is a register (< SLOT) or a slot of the stack frame (SLOT + index)
+#define SLOT 32
+#define LOC_CONST -1            // a constant, written directly in the instruction
+#define LOC_NONE -2             // a value which is not used
+
+// the condition codes, in pairs, so the inverse of cc is cc^1
+enum{CC_E, CC_NE, CC_L, CC_GE, CC_LE, CC_G, CC_B, CC_AE, CC_BE, CC_A};
+static const char *const ccNames[] = {"e", "ne", "l", "ge", "le", "g", "b", "ae", "be", "a"};
+
+static Text tData;              // the constants, written in .rodata at the end of the program
+static int nLabels;             // the .LB labels already used by blocks and branches
+static int nConsts;             // the .LC labels of the constants
+static int mainSlots;           // the stack slots of main: the max of all the global instructions
+
+// the current item
+static bool inMain;             // global instructions, generated in main
+static int blockLabel;          // the label of the block 0
+static int nSaved;              // the callee-saved registers pushed at the start of the function
+static int savedRegs[N_CALLEE_SAVED];
+static int nSlots;
+
+// The values which need a location (vregs): the instructions with a used result, the used arguments
+// and, for each phi, the copy assigned at the end of its predecessors (like _p in the C code generated from the IR).
+// Each vreg has a single live interval [start,end] of positions, so the values which are live at the same
+// position are in different locations, also when one of them ends and the other one starts there.
+static int *vregOf;             // [2*nInsts]: the vreg of the value v and of the copy nInsts+v of the phi v, or -1
+static int *keyOf;              // the value of each vreg (v or nInsts+v)
+static int nV;
+static int *start, *end, *loc;
+static int *pos;                // the position of each instruction; 0 is the start of the function
+static int nPos;
+static int *blockFrom, *blockTo;
+static int *callsBefore;        // the number of calls at the positions before each position
+static int *constLabel;         // the label of each real and str constant, 0 if not written yet
+static bool *fused;             // the comparisons generated by the branch which uses them
+
+static bool isReal(int type) {
+    return type == TYPE_REAL;
+}
+
+static int typeOfVreg(int r) {
+    return insts[keyOf[r] % nInsts].type;
+}
+
+static int locOf(int v) {
+    int r = vregOf[v];
+    return r >= 0 ? loc[r] : LOC_CONST;
+}
+
+static bool isComparison(int bin) {
+    return bin == LESS || bin == LESSEQ || bin == GREATER || bin == GREATEREQ || bin == EQUAL || bin == NOTEQ;
+}
+
+static bool isTerminator(int op) {
+    return op >= I_JMP;
+}
+
+static bool hasPhis(int b) {
+    int first = blocks[b].first;
+    return first && insts[first].op == I_PHI;
+}
+
+// register allocation
+
+static void addVreg(int key) {
+    vregOf[key] = nV;
+    keyOf[nV++] = key;
+}
+
+// the int comparisons used only by the branch which follows them are generated as cmp and a conditional jump
+static void findFused(void) {
+    for (int b = 0; b < nBlocks; b++) {
+        int last = blocks[b].last;
+        if (!last || insts[last].op != I_BR) continue;
+        int c = insts[last].a;
+        const Inst *in = &insts[c];
+        if (in->op == I_BIN && isComparison(in->bin) && insts[in->a].type == TYPE_INT && irUses[c] == 1 && in->next == last) {
+            fused[c] = true;
+        }
+    }
+}
+
+static void numberValues(void) {
+    nV = 0;
+    for (int v = 0; v < 2 * nInsts; v++) vregOf[v] = -1;
+    for (int b = 0; b < nBlocks; b++) {
+        for (int i = blocks[b].first; i; i = insts[i].next) {
+            if (!insts[i].type || !irUses[i] || fused[i]) continue;
+            addVreg(i);
+            if (insts[i].op == I_PHI) addVreg(nInsts + i);
+        }
+    }
+    for (int v = 1; v < nInsts; v++) {
+        if (insts[v].op == I_ARG && irUses[v]) addVreg(v);
+    }
+}
+
+static int words;               // the words of a set of vregs
+static uint64_t *useSets, *defSets, *liveIn, *liveOut;
+
+static bool inSet(const uint64_t *set, int r) {
+    return set[r >> 6] >> (r & 63) & 1;
+}
+
+static void addToSet(uint64_t *set, int r) {
+    set[r >> 6] |= 1ull << (r & 63);
+}
+
+static void extend(int r, int p) {
+    if (p < start[r]) start[r] = p;
+    if (p > end[r]) end[r] = p;
+}
+
+// a use of the value v at the position p of the block b
+static void useAt(int v, int p, int b) {
+    int r = vregOf[v];
+    if (r < 0) return;
+    extend(r, p);
+    if (!inSet(defSets + b * words, r)) addToSet(useSets + b * words, r);
+}
+
+static void defAt(int v, int p, int b) {
+    int r = vregOf[v];
+    if (r < 0) return;
+    extend(r, p);
+    addToSet(defSets + b * words, r);
+}
+
+// the copies at the end of the block "from" to the phis of "to"
+static void useEdge(int from, int to, int p) {
+    const Block *s = &blocks[to];
+    int k = s->preds[0] == from ? 0 : 1;
+    for (int i = s->first; i && insts[i].op == I_PHI; i = insts[i].next) {
+        useAt(k ? insts[i].b : insts[i].a, p, from);
+        defAt(nInsts + i, p, from);
+    }
+}
+
+// numbers the instructions and finds the uses and definitions of each block
+static void scanBlocks(void) {
+    int p = 1;
+    for (int b = 0; b < nBlocks; b++) {
+        blockFrom[b] = p++;
+        for (int i = blocks[b].first; i; i = insts[i].next, p++) {
+            const Inst *in = &insts[i];
+            pos[i] = p;
+            switch (in->op) {
+                case I_PHI: useAt(nInsts + i, p, b); break;
+                case I_CALL: for (int k = 0; k < in->b; k++) useAt(irArgs[in->a + k], p, b); break;
+                case I_BIN: useAt(in->a, p, b); useAt(in->b, p, b); break;
+                case I_STORE: case I_NEG: case I_NOT: case I_BR: case I_RET: useAt(in->a, p, b); break;
+                default: break;
+            }
+            if (in->op == I_JMP || in->op == I_BR) {
+                for (int k = 0; k < 2; k++) {
+                    if (blocks[b].succ[k] >= 0) useEdge(b, blocks[b].succ[k], p);
+                }
+            }
+            defAt(i, p, b);
+        }
+        blockTo[b] = p - 1;
+    }
+    nPos = p;
+}
+
+// the live sets at the start and at the end of each block, iterated until they do not change
+static void liveness(void) {
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int b = nBlocks - 1; b >= 0; b--) {
+            uint64_t *out = liveOut + b * words, *in = liveIn + b * words;
+            const uint64_t *use = useSets + b * words, *def = defSets + b * words;
+            int last = blocks[b].last;
+            bool jumps = last && (insts[last].op == I_JMP || insts[last].op == I_BR);
+            for (int w = 0; w < words; w++) {
+                uint64_t o = 0;
+                for (int k = 0; jumps && k < 2; k++) {
+                    if (blocks[b].succ[k] >= 0) o |= liveIn[blocks[b].succ[k] * words + w];
+                }
+                out[w] = o;
+                uint64_t n = use[w] | (o & ~def[w]);
+                if (n != in[w]) {
+                    in[w] = n;
+                    changed = true;
+                }
+            }
+        }
+    }
+    for (int b = 0; b < nBlocks; b++) {
+        for (int r = 0; r < nV; r++) {
+            if (inSet(liveIn + b * words, r)) extend(r, blockFrom[b]);
+            if (inSet(liveOut + b * words, r)) extend(r, blockTo[b]);
+        }
+    }
+}
+
+static bool crossesCall(int r) {
+    return end[r] > start[r] + 1 && callsBefore[end[r]] > callsBefore[start[r] + 1];
+}
+
+static bool isCalleeSaved(int reg) {
+    for (int k = 0; k < N_CALLEE_SAVED; k++) {
+        if (calleeSaved[k] == reg) return true;
+    }
+    return false;
+}
+
+static int byStart(const void *x, const void *y) {
+    int a = *(const int *)x, b = *(const int *)y;
+    return start[a] != start[b] ? start[a] - start[b] : a - b;
+}
+
+static int firstFree(const bool *free, const int *regs, int n) {
+    for (int k = 0; k < n; k++) {
+        if (free[regs[k]]) return regs[k];
+    }
+    return -1;
+}
+
+// the linear scan of Poletto and Sarkar: the intervals are visited by their start and, when there is no free
+// register, the interval which ends last is kept in the stack frame
+static void linearScan(void) {
+    int *order = (int *)arenaAlloc(&asmArena, nV * sizeof(int));
+    int *active = (int *)arenaAlloc(&asmArena, nV * sizeof(int));
+    int nActive = 0;
+    for (int r = 0; r < nV; r++) order[r] = r;
+    qsort(order, nV, sizeof(int), byStart);
+    bool free[SLOT];
+    for (int reg = 0; reg < SLOT; reg++) free[reg] = false;
+    for (int k = 0; k < 2; k++) free[callerSaved[k]] = true;
+    for (int k = 0; k < N_CALLEE_SAVED; k++) free[calleeSaved[k]] = true;
+    int xmmRegs[N_XMM];
+    for (int k = 0; k < N_XMM; k++) free[xmmRegs[k] = XMM8 + k] = true;
+    nSlots = 0;
+    for (int o = 0; o < nV; o++) {
+        int r = order[o];
+        for (int k = 0; k < nActive;) {
+            int j = active[k];
+            if (end[j] < start[r]) {
+                free[loc[j]] = true;
+                active[k] = active[--nActive];
+            } else {
+                k++;
+            }
+        }
+        bool real = isReal(typeOfVreg(r)), crosses = crossesCall(r);
+        int reg = -1;
+        if (real) {
+            if (!crosses) reg = firstFree(free, xmmRegs, N_XMM);
+        } else {
+            if (!crosses) reg = firstFree(free, callerSaved, 2);
+            if (reg < 0) reg = firstFree(free, calleeSaved, N_CALLEE_SAVED);
+        }
+        if (reg < 0 && !(real && crosses)) {
+            int best = -1;
+            for (int k = 0; k < nActive; k++) {
+                int j = active[k];
+                if (isReal(typeOfVreg(j)) != real || end[j] <= end[r] || (crosses && !isCalleeSaved(loc[j]))) continue;
+                if (best < 0 || end[j] > end[active[best]]) best = k;
+            }
+            if (best >= 0) {
+                int j = active[best];
+                reg = loc[j];
+                loc[j] = SLOT + nSlots++;
+                active[best] = active[--nActive];
+            }
+        }
+        if (reg >= 0) {
+            loc[r] = reg;
+            free[reg] = false;
+            active[nActive++] = r;
+        } else {
+            loc[r] = SLOT + nSlots++;
+        }
+    }
+    for (int r = 0; r < nV; r++) {
+        if (loc[r] >= SLOT) {
+            stats.spilled++;
+            continue;
+        }
+        stats.inRegs++;
+        if (isCalleeSaved(loc[r])) stats.calleeSaved++;
+    }
+    stats.values += nV;
+}
+
+static void allocate(void) {
+    vregOf = (int *)arenaAlloc(&asmArena, 2 * nInsts * sizeof(int));
+    keyOf = (int *)arenaAlloc(&asmArena, 2 * nInsts * sizeof(int));
+    fused = (bool *)arenaAlloc(&asmArena, nInsts * sizeof(bool));
+    memset(fused, 0, nInsts * sizeof(bool));
+    constLabel = (int *)arenaAlloc(&asmArena, nInsts * sizeof(int));
+    memset(constLabel, 0, nInsts * sizeof(int));
+    pos = (int *)arenaAlloc(&asmArena, nInsts * sizeof(int));
+    findFused();
+    numberValues();
+    start = (int *)arenaAlloc(&asmArena, nV * sizeof(int));
+    end = (int *)arenaAlloc(&asmArena, nV * sizeof(int));
+    loc = (int *)arenaAlloc(&asmArena, nV * sizeof(int));
+    for (int r = 0; r < nV; r++) {
+        // the arguments are assigned at the start of the function
+        start[r] = keyOf[r] < nInsts && insts[keyOf[r]].op == I_ARG ? 0 : nInsts + 2 * nBlocks;
+        end[r] = 0;
+    }
+    words = (nV + 63) / 64;
+    size_t setsSize = (size_t)nBlocks * words * sizeof(uint64_t);
+    useSets = (uint64_t *)arenaAlloc(&asmArena, 4 * setsSize);
+    memset(useSets, 0, 4 * setsSize);
+    defSets = useSets + nBlocks * words;
+    liveIn = defSets + nBlocks * words;
+    liveOut = liveIn + nBlocks * words;
+    blockFrom = (int *)arenaAlloc(&asmArena, nBlocks * sizeof(int));
+    blockTo = (int *)arenaAlloc(&asmArena, nBlocks * sizeof(int));
+    scanBlocks();
+    liveness();
+    callsBefore = (int *)arenaAlloc(&asmArena, (nPos + 1) * sizeof(int));
+    memset(callsBefore, 0, (nPos + 1) * sizeof(int));
+    for (int b = 0; b < nBlocks; b++) {
+        for (int i = blocks[b].first; i; i = insts[i].next) {
+            if (insts[i].op == I_CALL) callsBefore[pos[i] + 1]++;
+        }
+    }
+    for (int p = 1; p <= nPos; p++) callsBefore[p] += callsBefore[p - 1];
+    linearScan();
+}
+
+// the instructions
+
+static void ins(Text *t, const char *op) {
+    Text_putc(t, '\t');
+    Text_puts(t, op);
+    Text_putc(t, ' ');
+}
+
+static void locText(Text *t, int l, int type) {
+    if (l < XMM0) {
+        Text_puts(t, type == TYPE_STR ? regs64[l] : regs32[l]);
+    } else if (l < SLOT) {
+        Text_lit(t, "%xmm");
+        Text_int(t, l - XMM0);
+    } else {
+        Text_int(t, -8 * (nSaved + 1 + l - SLOT));
+        Text_lit(t, "(%rbp)");
+    }
+}
+
+static void label(Text *t, int n) {
+    Text_lit(t, ".LB");
+    Text_int(t, n);
+}
+
+static void jump(Text *t, int cc, int n) {
+    Text_lit(t, "\tj");
+    Text_puts(t, cc < 0 ? "mp" : ccNames[cc]);
+    Text_putc(t, ' ');
+    label(t, n);
+    Text_putc(t, '\n');
+}
+
+static void global(Text *t, const char *name) {
+    Text_id(t, name);
+    Text_lit(t, "(%rip)");
+}
+
+// the real constants, the real undefined values (0.0) and the strings are in .rodata
+static int constant(int v) {
+    if (!constLabel[v]) {
+        const Inst *in = &insts[v];
+        constLabel[v] = ++nConsts;
+        if (in->op == I_STR) {
+            Text_lit(&tData, ".LC");
+            Text_int(&tData, nConsts);
+            Text_lit(&tData, ":\n\t.string \"");
+            Text_putn(&tData, tkInput + in->pos, in->len);
+            Text_lit(&tData, "\"\n");
+        } else {
+            uint64_t bits = 0;
+            if (in->op == I_REAL) memcpy(&bits, &in->r, sizeof(bits));
+            Text_lit(&tData, "\t.p2align 3\n.LC");
+            Text_int(&tData, nConsts);
+            Text_write(&tData, ":\n\t.quad 0x%016llx\n", (unsigned long long)bits);
+        }
+    }
+    return constLabel[v];
+}
+
+// writes the value v as the source operand of an instruction; a str constant must be loaded with lea
+static void src(Text *t, int v) {
+    const Inst *in = &insts[v];
+    int l = locOf(v);
+    if (l != LOC_CONST) {
+        locText(t, l, in->type);
+    } else if (in->op == I_INT) {
+        Text_putc(t, '$');
+        Text_int(t, in->i);
+    } else if (in->op == I_REAL || (in->op == I_UNDEF && isReal(in->type))) {
+        Text_lit(t, ".LC");
+        Text_int(t, constant(v));
+        Text_lit(t, "(%rip)");
+    } else {
+        Text_lit(t, "$0");
+    }
+}
+
+// op v,l
+static void emitVL(Text *t, const char *op, int v, int l, int type) {
+    ins(t, op);
+    src(t, v);
+    Text_putc(t, ',');
+    locText(t, l, type);
+    Text_putc(t, '\n');
+}
+
+// op a,b for two locations
+static void emitLL(Text *t, const char *op, int a, int b, int type) {
+    ins(t, op);
+    locText(t, a, type);
+    Text_putc(t, ',');
+    locText(t, b, type);
+    Text_putc(t, '\n');
+}
+
+static const char *movOf(int type) {
+    return isReal(type) ? "movsd" : type == TYPE_STR ? "movq" : "movl";
+}
+
+static void moveLoc(Text *t, int dst, int from, int type) {
+    if (dst == from) return;
+    if (dst >= SLOT && from >= SLOT) {
+        int tmp = isReal(type) ? XMM0 : RAX;
+        emitLL(t, movOf(type), from, tmp, type);
+        emitLL(t, movOf(type), tmp, dst, type);
+    } else {
+        emitLL(t, isReal(type) && dst < SLOT && from < SLOT ? "movapd" : movOf(type), from, dst, type);
+    }
+}
+
+static void moveTo(Text *t, int dst, int v) {
+    const Inst *in = &insts[v];
+    int l = locOf(v);
+    if (l != LOC_CONST) {
+        moveLoc(t, dst, l, in->type);
+        return;
+    }
+    int tmp = dst < SLOT ? dst : isReal(in->type) ? XMM0 : RAX;
+    if (in->op == I_STR) {
+        Text_lit(t, "\tleaq .LC");
+        Text_int(t, constant(v));
+        Text_lit(t, "(%rip),");
+        Text_puts(t, regs64[tmp]);
+        Text_putc(t, '\n');
+    } else if (isReal(in->type)) {
+        emitVL(t, "movsd", v, tmp, TYPE_REAL);
+    } else {
+        emitVL(t, movOf(in->type), v, dst, in->type);
+        return;
+    }
+    moveLoc(t, dst, tmp, in->type);
+}
+
+// returns the register which contains v, which is loaded in tmp if it is not in a register
+static int inReg(Text *t, int v, int tmp) {
+    int l = locOf(v);
+    if (l >= 0 && l < SLOT) return l;
+    moveTo(t, tmp, v);
+    return tmp;
+}
+
+static int condition(int bin, bool isUnsigned) {
+    switch (bin) {
+        case LESS: return isUnsigned ? CC_B : CC_L;
+        case LESSEQ: return isUnsigned ? CC_BE : CC_LE;
+        case GREATER: return isUnsigned ? CC_A : CC_G;
+        case GREATEREQ: return isUnsigned ? CC_AE : CC_GE;
+        case EQUAL: return CC_E;
+        default: return CC_NE;
+    }
+}
+
+// compares the int or str operands of the comparison i and returns the condition when it is true
+static int genCompare(Text *t, int i) {
+    const Inst *in = &insts[i];
+    int type = insts[in->a].type;
+    int a = inReg(t, in->a, RAX);
+    if (type == TYPE_STR) {
+        if (insts[in->b].op == I_STR) emitLL(t, "cmpq", inReg(t, in->b, RCX), a, TYPE_STR);
+        else emitVL(t, "cmpq", in->b, a, TYPE_STR);
+        // the pointers are compared like in C
+        return condition(in->bin, true);
+    }
+    emitVL(t, "cmpl", in->b, a, TYPE_INT);
+    return condition(in->bin, false);
+}
+
+static void setcc(Text *t, const char *cc, const char *reg) {
+    Text_lit(t, "\tset");
+    Text_puts(t, cc);
+    Text_putc(t, ' ');
+    Text_puts(t, reg);
+    Text_putc(t, '\n');
+}
+
+// the comparison i of two reals, with the result (0 or 1) in %eax
+// a<b and a<=b are compared as b>a and b>=a, so the unordered operands (NaN) give 0 like in C
+static void genRealCompare(Text *t, int i) {
+    const Inst *in = &insts[i];
+    bool swap = in->bin == LESS || in->bin == LESSEQ;
+    int x = swap ? in->b : in->a, y = swap ? in->a : in->b;
+    emitVL(t, "ucomisd", y, inReg(t, x, XMM0), TYPE_REAL);
+    if (in->bin == EQUAL) {
+        Text_lit(t, "\tsete %al\n\tsetnp %cl\n\tandb %cl,%al\n");
+    } else if (in->bin == NOTEQ) {
+        Text_lit(t, "\tsetne %al\n\tsetp %cl\n\torb %cl,%al\n");
+    } else {
+        setcc(t, in->bin == LESS || in->bin == GREATER ? "a" : "ae", "%al");
+    }
+    Text_lit(t, "\tmovzbl %al,%eax\n");
+}
+
+// sets the flags for the value v used as a condition and returns the condition when it is false
+static int genTest(Text *t, int v) {
+    int type = insts[v].type;
+    if (isReal(type)) {
+        // v!=0.0, which is true for NaN
+        int r = inReg(t, v, XMM0);
+        Text_lit(t, "\txorpd %xmm1,%xmm1\n");
+        emitLL(t, "ucomisd", XMM1, r, TYPE_REAL);
+        Text_lit(t, "\tsetne %al\n\tsetp %cl\n\torb %cl,%al\n");
+        return CC_E;
+    }
+    int l = locOf(v);
+    if (l >= SLOT) {
+        ins(t, type == TYPE_STR ? "cmpq" : "cmpl");
+        Text_lit(t, "$0,");
+        locText(t, l, type);
+        Text_putc(t, '\n');
+    } else {
+        int r = inReg(t, v, RAX);
+        emitLL(t, type == TYPE_STR ? "testq" : "testl", r, r, type);
+    }
+    return CC_E;
+}
+
+static void genBin(Text *t, int i, int dst) {
+    const Inst *in = &insts[i];
+    int type = insts[in->a].type;
+    if (isComparison(in->bin)) {
+        if (isReal(type)) {
+            genRealCompare(t, i);
+        } else {
+            setcc(t, ccNames[genCompare(t, i)], "%al");
+            Text_lit(t, "\tmovzbl %al,%eax\n");
+        }
+        moveLoc(t, dst, RAX, TYPE_INT);
+        return;
+    }
+    if (type == TYPE_STR) err("the strings cannot be added or subtracted");
+    if (isReal(type)) {
+        int r = dst >= XMM0 && dst < SLOT ? dst : XMM0;
+        moveTo(t, r, in->a);
+        const char *op = in->bin == ADD ? "addsd" : in->bin == SUB ? "subsd" : in->bin == MUL ? "mulsd" : "divsd";
+        emitVL(t, op, in->b, r, TYPE_REAL);
+        moveLoc(t, dst, r, TYPE_REAL);
+        return;
+    }
+    if (in->bin == DIV) {
+        // idiv has no immediate operand
+        int divisor = locOf(in->b) == LOC_CONST ? RCX : LOC_CONST;
+        if (divisor == RCX) moveTo(t, RCX, in->b);
+        moveTo(t, RAX, in->a);
+        Text_lit(t, "\tcltd\n");
+        ins(t, "idivl");
+        if (divisor == RCX) locText(t, RCX, TYPE_INT);
+        else src(t, in->b);
+        Text_putc(t, '\n');
+        moveLoc(t, dst, RAX, TYPE_INT);
+        return;
+    }
+    int r = dst < XMM0 ? dst : RAX;
+    moveTo(t, r, in->a);
+    emitVL(t, in->bin == ADD ? "addl" : in->bin == SUB ? "subl" : "imull", in->b, r, TYPE_INT);
+    moveLoc(t, dst, r, TYPE_INT);
+}
+
+static void genUnary(Text *t, int i, int dst) {
+    const Inst *in = &insts[i];
+    int type = insts[in->a].type;
+    if (in->op == I_NEG) {
+        if (isReal(type)) {
+            // the sign bit is changed, like -x in C, so -0.0 remains different from 0.0
+            int r = dst >= XMM0 && dst < SLOT ? dst : XMM0;
+            moveTo(t, r, in->a);
+            emitLL(t, "movq", r, RAX, TYPE_STR);
+            Text_lit(t, "\tbtcq $63,%rax\n");
+            emitLL(t, "movq", RAX, r, TYPE_STR);
+            moveLoc(t, dst, r, TYPE_REAL);
+        } else {
+            int r = dst < XMM0 ? dst : RAX;
+            moveTo(t, r, in->a);
+            ins(t, "negl");
+            locText(t, r, TYPE_INT);
+            Text_putc(t, '\n');
+            moveLoc(t, dst, r, TYPE_INT);
+        }
+        return;
+    }
+    if (isReal(type)) {
+        Text_lit(t, "\txorpd %xmm1,%xmm1\n");
+        emitVL(t, "ucomisd", in->a, XMM1, TYPE_REAL);
+        Text_lit(t, "\tsete %al\n\tsetnp %cl\n\tandb %cl,%al\n");
+    } else {
+        genTest(t, in->a);
+        setcc(t, "e", "%al");
+    }
+    Text_lit(t, "\tmovzbl %al,%eax\n");
+    moveLoc(t, dst, RAX, TYPE_INT);
+}
+
+static void pushArg(Text *t, int v) {
+    const Inst *in = &insts[v];
+    int l = locOf(v);
+    if (l >= XMM0 && l < SLOT) {
+        Text_lit(t, "\tsubq $8,%rsp\n");
+        ins(t, "movsd");
+        locText(t, l, TYPE_REAL);
+        Text_lit(t, ",(%rsp)\n");
+        return;
+    }
+    if (in->op == I_STR) l = inReg(t, v, RAX);
+    ins(t, "pushq");
+    if (l >= 0 && l < XMM0) Text_puts(t, regs64[l]);
+    else src(t, v);
+    Text_putc(t, '\n');
+}
+
+static void genCall(Text *t, int i, int dst) {
+    const Inst *in = &insts[i];
+    int nInt = 0, nReal = 0, nStack = 0;
+    int *argLoc = (int *)arenaAlloc(&asmArena, (in->b + 1) * sizeof(int));
+    for (int k = 0; k < in->b; k++) {
+        if (isReal(insts[irArgs[in->a + k]].type)) argLoc[k] = nReal < 8 ? XMM0 + nReal++ : -1;
+        else argLoc[k] = nInt < 6 ? argRegs[nInt++] : -1;
+        if (argLoc[k] < 0) nStack++;
+    }
+    // the stack must remain aligned to 16 bytes, and the arguments from the stack are pushed from the last one
+    if (nStack & 1) Text_lit(t, "\tsubq $8,%rsp\n");
+    for (int k = in->b - 1; k >= 0; k--) {
+        if (argLoc[k] < 0) pushArg(t, irArgs[in->a + k]);
+    }
+    for (int k = 0; k < in->b; k++) {
+        if (argLoc[k] >= 0) moveTo(t, argLoc[k], irArgs[in->a + k]);
+    }
+    Text_lit(t, "\tcall ");
+    Text_id(t, in->name);
+    if (!strcmp(in->name, "puts")) Text_lit(t, "@PLT");
+    Text_putc(t, '\n');
+    if (nStack) {
+        Text_lit(t, "\taddq $");
+        Text_int(t, 8 * (nStack + (nStack & 1)));
+        Text_lit(t, ",%rsp\n");
+    }
+    if (dst != LOC_NONE) moveLoc(t, dst, isReal(in->type) ? XMM0 : RAX, in->type);
+}
+
+static void genInst(Text *t, int i) {
+    const Inst *in = &insts[i];
+    int r = vregOf[i], dst = r >= 0 ? loc[r] : LOC_NONE;
+    switch (in->op) {
+        case I_LOAD: {
+            if (dst == LOC_NONE) break;
+            int tmp = isReal(in->type) ? (dst >= XMM0 && dst < SLOT ? dst : XMM0) : (dst < XMM0 ? dst : RAX);
+            ins(t, movOf(in->type));
+            global(t, in->name);
+            Text_putc(t, ',');
+            locText(t, tmp, in->type);
+            Text_putc(t, '\n');
+            moveLoc(t, dst, tmp, in->type);
+            break;
+        }
+        case I_STORE: {
+            int type = insts[in->a].type, l = locOf(in->a);
+            const Inst *value = &insts[in->a];
+            if (l >= SLOT || value->op == I_STR || (l == LOC_CONST && isReal(type))) {
+                l = isReal(type) ? XMM0 : RAX;
+                moveTo(t, l, in->a);
+            }
+            ins(t, movOf(type));
+            if (l == LOC_CONST) src(t, in->a);
+            else locText(t, l, type);
+            Text_putc(t, ',');
+            global(t, in->name);
+            Text_putc(t, '\n');
+            break;
+        }
+        case I_BIN:
+            if (dst != LOC_NONE) genBin(t, i, dst);
+            break;
+        case I_NEG: case I_NOT:
+            if (dst != LOC_NONE) genUnary(t, i, dst);
+            break;
+        case I_CALL:
+            genCall(t, i, dst);
+            break;
+        default:
+            err("internal error: wrong IR instruction %d in the assembly generator", in->op);
+    }
+}
+
+static void genEpilogue(Text *t) {
+    if (inMain) {
+        Text_lit(t, "\tjmp .Lmain_end\n");
+        return;
+    }
+    if (!nSaved) {
+        Text_lit(t, "\tleave\n\tret\n");
+        return;
+    }
+    Text_lit(t, "\tleaq ");
+    Text_int(t, -8 * nSaved);
+    Text_lit(t, "(%rbp),%rsp\n");
+    for (int k = nSaved - 1; k >= 0; k--) {
+        Text_lit(t, "\tpopq ");
+        Text_puts(t, regs64[savedRegs[k]]);
+        Text_putc(t, '\n');
+    }
+    Text_lit(t, "\tpopq %rbp\n\tret\n");
+}
+
+static void genReturn(Text *t, int v) {
+    int type = insts[v].type;
+    if (inMain && isReal(type)) {
+        // the result of main is an int, like the conversion done by the C compiler
+        ins(t, "cvttsd2si");
+        src(t, v);
+        Text_lit(t, ",%eax\n");
+    } else {
+        moveTo(t, isReal(type) ? XMM0 : RAX, v);
+    }
+    genEpilogue(t);
+}
+
+// the copies to the phis of the block "to", at the end of the block "from"
+static void genEdge(Text *t, int from, int to) {
+    const Block *s = &blocks[to];
+    int k = s->preds[0] == from ? 0 : 1;
+    for (int i = s->first; i && insts[i].op == I_PHI; i = insts[i].next) {
+        int r = vregOf[nInsts + i];
+        if (r >= 0) moveTo(t, loc[r], k ? insts[i].b : insts[i].a);
+    }
+}
+
+static void genBranch(Text *t, int b) {
+    const Block *bl = &blocks[b];
+    int c = insts[bl->last].a;
+    int ifFalse = fused[c] ? genCompare(t, c) ^ 1 : genTest(t, c);
+    int s0 = bl->succ[0], s1 = bl->succ[1];
+    if (!hasPhis(s0) && !hasPhis(s1)) {
+        if (s0 == b + 1) {
+            jump(t, ifFalse, blockLabel + s1);
+        } else if (s1 == b + 1) {
+            jump(t, ifFalse ^ 1, blockLabel + s0);
+        } else {
+            jump(t, ifFalse, blockLabel + s1);
+            jump(t, -1, blockLabel + s0);
+        }
+        return;
+    }
+    // the copies of each edge are on their own path
+    int other = nLabels++;
+    jump(t, ifFalse, other);
+    genEdge(t, b, s0);
+    jump(t, -1, blockLabel + s0);
+    label(t, other);
+    Text_lit(t, ":\n");
+    genEdge(t, b, s1);
+    if (s1 != b + 1) jump(t, -1, blockLabel + s1);
+}
+
+static void genBlocks(Text *t) {
+    for (int b = 0; b < nBlocks; b++) {
+        const Block *bl = &blocks[b];
+        label(t, blockLabel + b);
+        Text_lit(t, ":\n");
+        for (int i = bl->first; i; i = insts[i].next) {
+            const Inst *in = &insts[i];
+            switch (in->op) {
+                case I_PHI: {
+                    int r = vregOf[i];
+                    if (r >= 0) moveLoc(t, loc[r], loc[vregOf[nInsts + i]], in->type);
+                    break;
+                }
+                case I_JMP:
+                    genEdge(t, b, bl->succ[0]);
+                    if (bl->succ[0] != b + 1) jump(t, -1, blockLabel + bl->succ[0]);
+                    break;
+                case I_BR: genBranch(t, b); break;
+                case I_RET: genReturn(t, in->a); break;
+                default: genInst(t, i);
+            }
+        }
+        if (bl->last && isTerminator(insts[bl->last].op)) continue;
+        if (inMain) {
+            // the end of the global instructions continues with the next item
+            if (b != nBlocks - 1) jump(t, -1, blockLabel + nBlocks);
+        } else {
+            // the end of a function without return, which returns 0
+            Text_lit(t, "\txorl %eax,%eax\n\txorpd %xmm0,%xmm0\n");
+            genEpilogue(t);
+        }
+    }
+    if (inMain) {
+        label(t, blockLabel + nBlocks);
+        Text_lit(t, ":\n");
+    }
+}
+
+// the arguments are moved from the registers and from the stack of the caller to their locations
+static void genArgs(Text *t, const Node *fn) {
+    int nInt = 0, nReal = 0, nStack = 0;
+    for (int a = fn->a; a; a = nodes[a].next) {
+        int type = nodes[a].type, from;
+        if (isReal(type)) from = nReal < 8 ? XMM0 + nReal++ : -1;
+        else from = nInt < 6 ? argRegs[nInt++] : -1;
+        int v = 0;
+        for (int i = 1; i < nInsts && !v; i++) {
+            if (insts[i].op == I_ARG && insts[i].name == nodes[a].name) v = i;
+        }
+        int l = v ? locOf(v) : LOC_CONST;
+        if (from < 0) {
+            if (l != LOC_CONST) {
+                int tmp = l < SLOT ? l : isReal(type) ? XMM0 : RAX;
+                ins(t, movOf(type));
+                Text_int(t, 16 + 8 * nStack);
+                Text_lit(t, "(%rbp),");
+                locText(t, tmp, type);
+                Text_putc(t, '\n');
+                moveLoc(t, l, tmp, type);
+            }
+            nStack++;
+        } else if (l != LOC_CONST) {
+            moveLoc(t, l, from, type);
+        }
+    }
+}
+
+static void genFunction(Text *t, const Node *fn) {
+    nSaved = 0;
+    for (int k = 0; k < N_CALLEE_SAVED; k++) {
+        for (int r = 0; r < nV; r++) {
+            if (loc[r] == calleeSaved[k]) {
+                savedRegs[nSaved++] = calleeSaved[k];
+                break;
+            }
+        }
+    }
+    Text_lit(t, "\n\t.text\n\t.p2align 4\n");
+    Text_id(t, fn->name);
+    Text_lit(t, ":\n\tpushq %rbp\n\tmovq %rsp,%rbp\n");
+    for (int k = 0; k < nSaved; k++) {
+        Text_lit(t, "\tpushq ");
+        Text_puts(t, regs64[savedRegs[k]]);
+        Text_putc(t, '\n');
+    }
+    int frame = 8 * nSlots;
+    if ((8 * nSaved + frame) % 16) frame += 8;
+    if (frame) {
+        Text_lit(t, "\tsubq $");
+        Text_int(t, frame);
+        Text_lit(t, ",%rsp\n");
+    }
+    genArgs(t, fn);
+    genBlocks(t);
+}
+
+void genAsmHeader(Text *begin, Text *main) {
+    stats = (AsmStats){0};
+    nLabels = nConsts = mainSlots = 0;
+    Text_clear(&tData);
+    Text_lit(begin, "# generated by quick, build with: cc file.s\n"
+        "\t.text\n"
+        "puti:\n\tsubq $8,%rsp\n\tmovl %edi,%esi\n\tleaq .Lputi(%rip),%rdi\n\txorl %eax,%eax\n"
+        "\tcall printf@PLT\n\taddq $8,%rsp\n\tret\n"
+        "putr:\n\tsubq $8,%rsp\n\tleaq .Lputr(%rip),%rdi\n\tmovl $1,%eax\n"
+        "\tcall printf@PLT\n\taddq $8,%rsp\n\tret\n"
+        "\t.section .rodata\n.Lputi:\n\t.string \"%d\\n\"\n.Lputr:\n\t.string \"%g\\n\"\n");
+    // all the callee-saved registers are saved by main, and its frame is known at the end of the program
+    Text_lit(main, "\n\t.text\n\t.globl main\n\t.p2align 4\nmain:\n\tpushq %rbp\n\tmovq %rsp,%rbp\n"
+        "\tpushq %rbx\n\tpushq %r12\n\tpushq %r13\n\tpushq %r14\n\tpushq %r15\n"
+        "\tsubq $.Lmain_frame,%rsp\n");
+}
+
+void genAsmItem(int id) {
+    const Node *n = &nodes[id];
+    if (n->kind == N_VARDEF) {
+        Text_lit(&tBegin, "\t.local ");
+        Text_id(&tBegin, n->name);
+        Text_lit(&tBegin, "\n\t.comm ");
+        Text_id(&tBegin, n->name);
+        Text_lit(&tBegin, ",8,8\n");
+        return;
+    }
+    ArenaMark mark = arenaMark(&asmArena);
+    inMain = n->kind != N_FN;
+    allocate();
+    blockLabel = nLabels;
+    nLabels += nBlocks + 1;
+    if (inMain) {
+        nSaved = N_CALLEE_SAVED;
+        if (nSlots > mainSlots) mainSlots = nSlots;
+        genBlocks(&tMain);
+    } else {
+        stats.fns++;
+        genFunction(&tFunctions, n);
+    }
+    arenaRelease(&asmArena, mark);
+}
+
+void genAsmEnd(Text *main) {
+    Text_lit(main, "\txorl %eax,%eax\n.Lmain_end:\n\tleaq -40(%rbp),%rsp\n"
+        "\tpopq %r15\n\tpopq %r14\n\tpopq %r13\n\tpopq %r12\n\tpopq %rbx\n\tpopq %rbp\n\tret\n");
+    int frame = 8 * mainSlots;
+    if ((8 * N_CALLEE_SAVED + frame) % 16) frame += 8;
+    Text_lit(main, "\t.set .Lmain_frame,");
+    Text_int(main, frame);
+    Text_lit(main, "\n\n\t.section .rodata\n");
+    Text_putn(main, tData.buf, tData.n);
+    Text_lit(main, "\t.section .note.GNU-stack,\"\",@progbits\n");
+    Text_clear(&tData);
+}
+
+AsmStats asmStats(void) {
+    return stats;
+}
+
+void showAsmStats(void) {
+    printf("Assembly: %d functions, %ld values, %ld in registers (%ld callee-saved), %ld in the stack frame\n",
+        stats.fns, stats.values, stats.inRegs, stats.calleeSaved, stats.spilled);
+}
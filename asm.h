@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "gen.h"
+
+// An x86-64 backend, used instead of the C code generator when asmMode is true (the -S option).
+// It writes GNU assembler code for the System V ABI, which is built with "cc file.s", without compiling C.
+// The functions and the global code are translated from their optimized IR (see ir.h).
+// The values are assigned to registers by a linear scan allocator and the ones which do not fit are kept
+// in the stack frame: int values are in general registers (32 bits), str values are pointers and
+// real values are in SSE2 registers. The values which are live during a call are kept in the
+// callee-saved registers, or in the stack frame if there is no free one (always for the reals).
+// puti and putr are written at the start of the program as small functions which call printf, like in quick.h,
+// and puts is the one from the C library.
+extern bool asmMode;
+
+// writes the start of the program: the runtime functions in begin and the start of main in main
+void genAsmHeader(Text *begin, Text *main);
+
+// generates the code of a top-level item: a global variable in tBegin, a function in tFunctions
+// and global instructions in tMain; the IR of the functions and global instructions must be already built and optimized
+void genAsmItem(int id);
+
+// writes the end of main and the constants used by the program
+void genAsmEnd(Text *main);
+
+typedef struct{
+    int fns;            // the generated functions
+    long values;        // the values which needed a location
+    long inRegs;        // the values allocated in registers
+    long calleeSaved;   // the values in callee-saved registers, because they are live during a call
+    long spilled;       // the values kept in the stack frame
+}AsmStats;
+
+AsmStats asmStats(void);
+void showAsmStats(void);
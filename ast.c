@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ast.h"
+#include "lexer.h"
+
+Node *nodes;
+int nNodes;
+static int capNodes;
+static Arena astArena = ARENA("ast");
+static AstStats stats;
+
+int newNode(int kind, int line) {
+    if (!nNodes) nNodes = 1;      // the index 0 means "no node"
+    if (nNodes >= capNodes) {
+        int newCap = capNodes ? capNodes * 2 : 1024;
+        nodes = (Node *)arenaGrow(&astArena, nodes, capNodes * sizeof(Node), newCap * sizeof(Node));
+        capNodes = newCap;
+    }
+    Node *n = &nodes[nNodes];
+    memset(n, 0, sizeof(Node));
+    n->kind = kind;
+    n->line = line;
+    return nNodes++;
+}
+
+void resetAst(void) {
+    if (nNodes > 1) {
+        stats.nItems++;
+        stats.nNodes += nNodes - 1;
+        if (nNodes - 1 > stats.maxNodes) stats.maxNodes = nNodes - 1;
+    }
+    nNodes = 1;
+}
+
+void appendNode(int *first, int *last, int id) {
+    if (*last) nodes[*last].next = id;
+    else *first = id;
+    *last = id;
+}
+
+int tailCall(int id) {
+    if (!nodes[id].tail) return 0;
+    int a = nodes[id].a;
+    while (nodes[a].kind == N_PAREN) a = nodes[a].a;
+    return nodes[a].kind == N_CALL ? a : 0;
+}
+
+bool hasTailCall(int id) {
+    for (; id; id = nodes[id].next) {
+        const Node *n = &nodes[id];
+        switch (n->kind) {
+            case N_RETURN: if (tailCall(id)) return true; break;
+            case N_IF: if (hasTailCall(n->b) || hasTailCall(n->c)) return true; break;
+            case N_WHILE: if (hasTailCall(n->b)) return true; break;
+            default: break;
+        }
+    }
+    return false;
+}
+
+static const char *typeName(int type) {
+    switch (type) {
+        case TYPE_INT: return "int";
+        case TYPE_REAL: return "real";
+        case TYPE_STR: return "str";
+        default: return "?";
+    }
+}
+
+const char *opText(int op) {
+    switch (op) {
+        case ADD: return "+";
+        case SUB: return "-";
+        case MUL: return "*";
+        case DIV: return "/";
+        case AND: return "&&";
+        case OR: return "||";
+        case EQUAL: return "==";
+        case NOTEQ: return "!=";
+        case LESS: return "<";
+        case GREATER: return ">";
+        case LESSEQ: return "<=";
+        case GREATEREQ: return ">=";
+        default: return "?";
+    }
+}
+
+static void dumpNode(FILE *fis, int id);
+
+// writes a list as (label item item ...)
+static void dumpList(FILE *fis, const char *label, int id) {
+    fprintf(fis, " (%s", label);
+    for (; id; id = nodes[id].next) {
+        fputc(' ', fis);
+        dumpNode(fis, id);
+    }
+    fputc(')', fis);
+}
+
+static void dumpNode(FILE *fis, int id) {
+    const Node *n = &nodes[id];
+    switch (n->kind) {
+        case N_INT: fprintf(fis, "%d", n->i); break;
+        case N_REAL: fprintf(fis, "%g", n->r); break;
+        case N_STR: fprintf(fis, "\"%.*s\"", (int)n->len, tkInput + n->pos); break;
+        case N_VAR: fputs(n->name, fis); break;
+        case N_CALL:
+            fprintf(fis, "(call %s", n->name);
+            for (int a = n->a; a; a = nodes[a].next) {
+                fputc(' ', fis);
+                dumpNode(fis, a);
+            }
+            fputc(')', fis);
+            break;
+        case N_NEG: fputs("(neg ", fis); dumpNode(fis, n->a); fputc(')', fis); break;
+        case N_NOT: fputs("(! ", fis); dumpNode(fis, n->a); fputc(')', fis); break;
+        case N_PAREN: dumpNode(fis, n->a); break;
+        case N_BIN:
+            fprintf(fis, "(%s ", opText(n->op));
+            dumpNode(fis, n->a);
+            fputc(' ', fis);
+            dumpNode(fis, n->b);
+            fputc(')', fis);
+            break;
+        case N_ASSIGN: fprintf(fis, "(= %s ", n->name); dumpNode(fis, n->a); fputc(')', fis); break;
+        case N_COND:
+            fputs("(? ", fis);
+            dumpNode(fis, n->a);
+            fputc(' ', fis);
+            dumpNode(fis, n->b);
+            fputc(' ', fis);
+            dumpNode(fis, n->c);
+            fputc(')', fis);
+            break;
+        case N_SEQ:
+            fputs("(, ", fis);
+            dumpNode(fis, n->a);
+            fputc(' ', fis);
+            dumpNode(fis, n->b);
+            fputc(')', fis);
+            break;
+        case N_EXPR: dumpNode(fis, n->a); break;
+        case N_EMPTY: fputs("(;)", fis); break;
+        case N_IF:
+            fputs("(if ", fis);
+            dumpNode(fis, n->a);
+            dumpList(fis, "then", n->b);
+            if (n->c) dumpList(fis, "else", n->c);
+            fputc(')', fis);
+            break;
+        case N_WHILE:
+            fputs("(while ", fis);
+            dumpNode(fis, n->a);
+            dumpList(fis, "do", n->b);
+            fputc(')', fis);
+            break;
+        case N_RETURN:
+            fputs(n->tail ? "(return-tail " : "(return ", fis);
+            dumpNode(fis, n->a);
+            fputc(')', fis);
+            break;
+        case N_BLOCK:
+            fputs("(block", fis);
+            dumpList(fis, "vars", n->a);
+            dumpList(fis, "do", n->b);
+            fputc(')', fis);
+            break;
+        case N_VARDEF: fprintf(fis, "(var %s %s)", n->name, typeName(n->type)); break;
+        case N_FN:
+            fprintf(fis, "(fn %s %s", n->name, typeName(n->type));
+            dumpList(fis, "args", n->a);
+            dumpList(fis, "locals", n->b);
+            dumpList(fis, "body", n->c);
+            fputc(')', fis);
+            break;
+        default: fprintf(fis, "(?%d)", n->kind);
+    }
+}
+
+void dumpAst(FILE *fis, int id) {
+    // the global code can have lists of instructions
+    for (; id; id = nodes[id].kind == N_FN || nodes[id].kind == N_VARDEF ? 0 : nodes[id].next) {
+        dumpNode(fis, id);
+        fputc('\n', fis);
+    }
+}
+
+AstStats astStats(void) {
+    return stats;
+}
+
+void showAstStats(void) {
+    printf("AST: %zu bytes per node, %zu items with %zu nodes (%zu bytes), max %d nodes per item (%zu bytes), node array of %zu bytes\n",
+        sizeof(Node), stats.nItems, stats.nNodes, stats.nNodes * sizeof(Node),
+        stats.maxNodes, stats.maxNodes * sizeof(Node), capNodes * sizeof(Node));
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+// The AST of a top-level item: a global variable, a function or an instruction of the Quick global code.
+// The nodes are stored in a single array, allocated in an arena, and they refer to each other by index,
+// so the array can grow without invalidating the links. The index 0 is not used, so it means "no node".
+// The lists (arguments, instructions, ...) are linked through the "next" field.
+enum{
+    N_INT, N_REAL, N_STR,       // constants
+    N_VAR,          // a variable or an argument: name
+    N_CALL,         // name(a, a->next, ...)
+    N_NEG, N_NOT,   // -a, !a
+    N_PAREN,        // (a)
+    N_BIN,          // a op b
+    N_ASSIGN,       // name=a
+    N_COND,         // a ? b : c, created by the inliner
+    N_SEQ,          // a, b: evaluates a, then b, which is the value; created by the inliner
+    N_EXPR,         // a;
+    N_EMPTY,        // ;
+    N_IF,           // if(a) b else c, where b and c are lists of instructions
+    N_WHILE,        // while(a) b
+    N_RETURN,       // return a;
+    N_BLOCK,        // { a b }: the local variables a (N_VARDEF) of the global instructions b, created by the inliner
+    N_VARDEF,       // var name:type (also used for the arguments of a function)
+    N_FN,           // function name(a):type, with the local variables b and the body c
+};
+
+typedef struct{
+    unsigned char kind;     // N_*
+    unsigned char type;     // TYPE_* of the expressions, variables and functions
+    unsigned char op;       // N_BIN: the token code of the operator
+    bool lval:1;            // the expression is an l-value
+    bool local:1;           // N_VAR, N_ASSIGN, N_VARDEF: a local variable or an argument
+    bool tail:1;            // N_RETURN: returns a call of the current function, so it can become a jump
+    int line;
+    int a, b, c;            // the children, depending on kind
+    int next;               // the next node in a list
+    union{
+        int i;              // N_INT
+        double r;           // N_REAL
+        const char *name;   // N_VAR, N_CALL, N_ASSIGN, N_VARDEF, N_FN: an atom
+        struct{unsigned pos, len;};     // N_STR: the chars are tkInput[pos,pos+len), like in the tokens
+    };
+}Node;
+
+extern Node *nodes;         // the nodes of the current item
+extern int nNodes;
+
+// returns the index of a new node, cleared to 0
+// the previous Node pointers are invalidated, because the array may be moved
+int newNode(int kind, int line);
+
+// deletes all the nodes, after the current item was compiled
+void resetAst(void);
+
+// appends the node id at the end of the list [*first,*last]
+void appendNode(int *first, int *last, int id);
+
+// returns the N_CALL of the N_RETURN id if it is a tail call (see Node.tail), else 0
+// the call is searched again, because the expression could be changed by the optimizations
+int tailCall(int id);
+
+// returns true if the list of instructions id has a tail call, also in its if and while instructions
+bool hasTailCall(int id);
+
+// returns the C text of a binary operator, given by its token code
+const char *opText(int op);
+
+// writes the tree in a compact format, with one line per top-level item:
+// (fn name type (args...) (locals...) (body...)), (if cond (then...) (else...)), (+ a b), ...
+void dumpAst(FILE *fis, int id);
+
+typedef struct{
+    size_t nItems;      // the compiled top-level items
+    size_t nNodes;      // the nodes of all the items
+    int maxNodes;       // the nodes of the largest item
+}AstStats;
+
+AstStats astStats(void);
+
+// shows the number of nodes and the memory used by each node
+void showAstStats(void);
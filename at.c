@@ -1,15 +1,16 @@
 #include <stddef.h>
+#include <string.h>
 
 #include "lexer.h"
 #include "ad.h"
+#include "atoms.h"
 
 // adds in ST a function with an argument
 // the argument has the type argType and the function returns the type retType
 Symbol *addFn1Arg(const char *fnName,int argType,int retType){
-    Symbol *fn=addSymbol(fnName,KIND_FN);
+    Symbol *fn=addSymbol(intern(fnName,strlen(fnName)),KIND_FN);
     fn->type=retType;
-    fn->args=NULL;
-    Symbol *arg=addFnArg(fn,"arg");
+    Symbol *arg=addFnArg(fn,intern("arg",3));
     arg->type=argType;
     return fn;
     }
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "atoms.h"
+#include "utils.h"
+
+// each atom is allocated in a single block: the header followed by the chars of the name
+typedef struct{
+	uint32_t hash;
+	uint32_t len;
+	char name[];
+	}Atom;
+
+// open addressing with linear probing
+// the capacity is always a power of 2 and the table is at most half full
+static Atom **table;
+static size_t capacity;
+static AtomStats stats;
+static Arena atomsArena=ARENA("atoms");
+static bool shared;
+static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+
+// In shared mode, each thread keeps its recently used atoms in a small direct-mapped cache,
+// so most names are found without taking the lock.
+#define CACHE_SIZE 256		// power of 2
+static _Thread_local Atom *cache[CACHE_SIZE];
+static _Thread_local size_t cacheHits;
+
+// FNV-1a
+static uint32_t hashName(const char *name,size_t len){
+	uint32_t h=2166136261u;
+	for(size_t i=0;i<len;i++){
+		h^=(unsigned char)name[i];
+		h*=16777619u;
+		}
+	return h;
+	}
+
+static Atom *atomOf(const char *name){
+	return (Atom*)(name-offsetof(Atom,name));
+	}
+
+// doubles the capacity and reinserts all the atoms
+static void grow(){
+	size_t newCapacity=capacity?capacity*2:1024;
+	Atom **newTable=(Atom**)calloc(newCapacity,sizeof(Atom*));
+	if(!newTable)err("not enough memory");
+	for(size_t i=0;i<capacity;i++){
+		Atom *a=table[i];
+		if(!a)continue;
+		size_t j=a->hash&(newCapacity-1);
+		while(newTable[j])j=(j+1)&(newCapacity-1);
+		newTable[j]=a;
+		}
+	free(table);
+	table=newTable;
+	capacity=newCapacity;
+	}
+
+void shareAtoms(bool sharedAtoms){
+	shared=sharedAtoms;
+	}
+
+static Atom *internName(const char *name,size_t len,uint32_t h){
+	if(2*(stats.nAtoms+1)>capacity)grow();
+	size_t i=h&(capacity-1);
+	for(Atom *a;(a=table[i]);i=(i+1)&(capacity-1)){
+		if(a->hash==h&&a->len==len&&!memcmp(a->name,name,len)){
+			stats.hits++;
+			return a;
+			}
+		}
+	Atom *a=(Atom*)arenaAlloc(&atomsArena,sizeof(Atom)+len+1);
+	a->hash=h;
+	a->len=(uint32_t)len;
+	memcpy(a->name,name,len);
+	a->name[len]='\0';
+	table[i]=a;
+	stats.nAtoms++;
+	stats.misses++;
+	return a;
+	}
+
+const char *intern(const char *name,size_t len){
+	uint32_t h=hashName(name,len);
+	if(!shared)return internName(name,len,h)->name;
+	Atom **slot=&cache[h&(CACHE_SIZE-1)];
+	Atom *a=*slot;
+	if(a&&a->hash==h&&a->len==len&&!memcmp(a->name,name,len)){
+		cacheHits++;
+		return a->name;
+		}
+	pthread_mutex_lock(&lock);
+	a=internName(name,len,h);
+	pthread_mutex_unlock(&lock);
+	*slot=a;
+	return a->name;
+	}
+
+void flushAtomCache(){
+	pthread_mutex_lock(&lock);
+	stats.hits+=cacheHits;
+	pthread_mutex_unlock(&lock);
+	cacheHits=0;
+	memset(cache,0,sizeof(cache));
+	}
+
+const char *findAtom(const char *name,size_t len){
+	uint32_t h=hashName(name,len);
+	if(shared)pthread_mutex_lock(&lock);
+	const char *found=NULL;
+	size_t i=h&(capacity-1);
+	for(Atom *a;capacity&&(a=table[i]);i=(i+1)&(capacity-1)){
+		if(a->hash==h&&a->len==len&&!memcmp(a->name,name,len)){
+			found=a->name;
+			break;
+			}
+		}
+	if(shared)pthread_mutex_unlock(&lock);
+	return found;
+	}
+
+size_t atomLen(const char *atom){
+	return atomOf(atom)->len;
+	}
+
+AtomStats atomStats(){
+	AtomStats s=stats;
+	s.capacity=capacity;
+	return s;
+	}
+
+void showAtomStats(){
+	size_t lookups=stats.hits+stats.misses;
+	printf("Atoms: %zu distinct names, %zu lookups (%zu hits, %zu misses), dedup ratio %.2f\n",
+		stats.nAtoms,lookups,stats.hits,stats.misses,stats.nAtoms?(double)lookups/stats.nAtoms:0.0);
+	}
+
+void freeAtoms(){
+	arenaFree(&atomsArena);
+	free(table);
+	table=NULL;
+	capacity=0;
+	stats=(AtomStats){0};
+	}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// The atoms table keeps a single copy of each distinct name (identifier) from the input.
+// intern returns the same pointer for equal names, so two interned names
+// can be compared with == instead of strcmp.
+
+// returns the interned copy of the chars [name,name+len), followed by '\0'
+// if the name is not in the table, it is added
+const char *intern(const char *name,size_t len);
+
+// returns the interned copy of the chars [name,name+len) or NULL if the name is not in the table
+// the table is not changed
+const char *findAtom(const char *name,size_t len);
+
+// if shared is true, intern can be called from multiple threads (it uses a lock)
+void shareAtoms(bool shared);
+
+// each thread which called intern in shared mode must call this before the shared mode ends
+// it adds the thread statistics to the global ones and clears the thread cache
+void flushAtomCache();
+
+// returns the length of an interned name, without computing it
+size_t atomLen(const char *atom);
+
+typedef struct{
+	size_t nAtoms;		// nr of distinct names
+	size_t hits;		// nr of intern calls which found the name already in the table
+	size_t misses;		// nr of intern calls which added a new name
+	size_t capacity;		// nr of slots in the hash table
+	}AtomStats;
+
+AtomStats atomStats();
+
+// prints the atoms statistics and the deduplication ratio
+void showAtomStats();
+
+// deletes all the atoms
+// all the pointers returned by intern become invalid
+void freeAtoms();
@@ -0,0 +1,175 @@
+// Compares the x86-64 assembly backend (quick -S, then cc file.s) with the C backend (quick, then cc -O0 or -O2):
+// the time of quick, the time of the C compiler or of the assembler and linker, and the runtime of the executable.
+// Two programs are generated: one with many small functions, for the build time, and one with loops and calls,
+// for the runtime. The outputs of all the executables must be identical. The times are the medians of several runs.
+// usage: bench_asm [quick] [functions] [runs]		(default: ./quick, 2000 functions, 3 runs)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const char *runProgram =
+    "var total:int;\n"
+    "function fib(n:int):int\n"
+    "  if(n<2) return n; end\n"
+    "  return fib(n-1)+fib(n-2);\n"
+    "end\n"
+    "function work(n:int):int\n"
+    "  var i:int;\n"
+    "  var s:int;\n"
+    "  i=0; s=0;\n"
+    "  while(i<n)\n"
+    "    s=s+i*3-i/7;\n"
+    "    if(s>1000000) s=s-1000000; end\n"
+    "    i=i+1;\n"
+    "  end\n"
+    "  return s;\n"
+    "end\n"
+    "function series(n:int):real\n"
+    "  var i:int;\n"
+    "  var x:real;\n"
+    "  var s:real;\n"
+    "  i=0; x=1.0; s=0.0;\n"
+    "  while(i<n)\n"
+    "    s=s+1.0/x;\n"
+    "    x=x+2.0;\n"
+    "    i=i+1;\n"
+    "  end\n"
+    "  return s;\n"
+    "end\n"
+    "total=fib(32);\n"
+    "puti(total);\n"
+    "puti(work(100000000));\n"
+    "putr(series(50000000));\n";
+
+static void writeBuildProgram(const char *path, int nFns){
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "error: cannot write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fputs("var total:int;\n", f);
+    // each function calls the previous one, so all of them are used, and the values get smaller
+    for (int i = 0; i < nFns; i++) {
+        fprintf(f, "function f%d(x:int, y:int):int\n"
+            "  var t:int;\n"
+            "  var k:int;\n"
+            "  t=x/3+y*%d/11;\n"
+            "  k=0;\n"
+            "  while(k<3)\n"
+            "    t=t+k*2-x/(k+1);\n"
+            "    k=k+1;\n"
+            "  end\n"
+            "  if(t<y) return t/2; end\n", i, i % 7);
+        if (i) fprintf(f, "  return f%d(y/2,t/2)+1;\nend\n", i - 1);
+        else fprintf(f, "  return t-y;\nend\n");
+    }
+    fprintf(f, "total=f%d(30000,40000);\nputi(total);\n", nFns - 1);
+    fclose(f);
+}
+
+static double timed(const char *cmd){
+    double t0 = now();
+    if (system(cmd)) {
+        fprintf(stderr, "error: %s failed\n", cmd);
+        exit(EXIT_FAILURE);
+    }
+    return now() - t0;
+}
+
+static int compareDoubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n){
+    qsort(v, n, sizeof(double), compareDoubles);
+    return v[n / 2];
+}
+
+static char *readFile(const char *path){
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    char *buf = (char *)calloc(1, 1 << 16);
+    fread(buf, 1, (1 << 16) - 1, f);
+    fclose(f);
+    return buf;
+}
+
+enum{ASM, C_O0, C_O2, N_PATHS};
+static const char *pathNames[N_PATHS] = {"asm", "C -O0", "C -O2"};
+
+// builds and runs the program with each path and prints a row for each one
+static void bench(const char *quick, const char *cc, const char *qFile, const char *title, int runs){
+    char src[64], exe[64], outFile[64], cmd[1024];
+    double tQuick[N_PATHS][20], tBuild[N_PATHS][20], tRun[N_PATHS][20];
+    char *ref = NULL;
+    for (int k = 0; k < N_PATHS; k++) {
+        snprintf(src, sizeof(src), "/tmp/bench_asm_%d.%s", (int)getpid(), k == ASM ? "s" : "c");
+        snprintf(exe, sizeof(exe), "/tmp/bench_asm_%d.exe", (int)getpid());
+        snprintf(outFile, sizeof(outFile), "/tmp/bench_asm_%d.out", (int)getpid());
+        for (int r = 0; r < runs; r++) {
+            snprintf(cmd, sizeof(cmd), "%s %s -o %s %s >/dev/null", quick, k == ASM ? "-S" : "", src, qFile);
+            tQuick[k][r] = timed(cmd);
+            snprintf(cmd, sizeof(cmd), "%s %s -w -I. -o %s %s", cc, k == C_O2 ? "-O2" : k == C_O0 ? "-O0" : "", exe, src);
+            tBuild[k][r] = timed(cmd);
+            snprintf(cmd, sizeof(cmd), "%s >%s", exe, outFile);
+            tRun[k][r] = timed(cmd);
+        }
+        char *out = readFile(outFile);
+        if (!ref) {
+            ref = out;
+        } else {
+            if (!out || strcmp(out, ref)) {
+                fprintf(stderr, "error: different output for %s:\n%s\ninstead of:\n%s\n", pathNames[k], out, ref);
+                exit(EXIT_FAILURE);
+            }
+            free(out);
+        }
+        remove(src);
+        remove(exe);
+        remove(outFile);
+    }
+    free(ref);
+    printf("%s\n%-8s %10s %12s %12s %10s\n", title, "path", "quick ms", "cc/as ms", "build ms", "run ms");
+    for (int k = 0; k < N_PATHS; k++) {
+        double q = median(tQuick[k], runs), b = median(tBuild[k], runs);
+        printf("%-8s %10.1f %12.1f %12.1f %10.1f\n", pathNames[k], 1000 * q, 1000 * b, 1000 * (q + b),
+            1000 * median(tRun[k], runs));
+    }
+}
+
+int main(int argc, char *argv[]){
+    const char *quick = argc > 1 ? argv[1] : "./quick";
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    int nFns = argc > 2 ? atoi(argv[2]) : 2000;
+    int runs = argc > 3 ? atoi(argv[3]) : 3;
+    if (nFns < 1) nFns = 2000;
+    if (runs < 1 || runs > 20) runs = 3;
+    char qFile[64];
+    snprintf(qFile, sizeof(qFile), "/tmp/bench_asm_%d.q", (int)getpid());
+
+    writeBuildProgram(qFile, nFns);
+    char title[64];
+    snprintf(title, sizeof(title), "%d functions:", nFns);
+    bench(quick, cc, qFile, title, runs);
+
+    FILE *f = fopen(qFile, "w");
+    if (!f) {
+        fprintf(stderr, "error: cannot write %s\n", qFile);
+        return EXIT_FAILURE;
+    }
+    fputs(runProgram, f);
+    fclose(f);
+    printf("\n");
+    bench(quick, cc, qFile, "loops and calls:", runs);
+    remove(qFile);
+    return 0;
+}
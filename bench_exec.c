@@ -0,0 +1,122 @@
+// Measures the latency of quick exec (see exec.h): cold, when the shared object is built by the C compiler,
+// and warm, when it is found in the cache. The total time of the process and the time of each step
+// (from --exec-stats) are shown, and also the time of the classic path: quick, cc -O0 and the executable.
+// The program is small, like a script, so the times are dominated by the build and by the startup.
+// The times are the medians of several runs. The cache is a new directory on tmpfs (/dev/shm, if it exists),
+// which is deleted at the end.
+// usage: bench_exec [quick] [runs]		(default: ./quick, 10 runs)
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const char *program =
+    "var n:int;\n"
+    "function fib(n:int):int\n"
+    "  if(n<2) return n; end\n"
+    "  return fib(n-1)+fib(n-2);\n"
+    "end\n"
+    "n=20;\n"
+    "puti(fib(n));\n"
+    "puts(\"done\");\n";
+
+static int compareDoubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n){
+    qsort(v, n, sizeof(double), compareDoubles);
+    return v[n / 2];
+}
+
+enum{TOTAL, GENERATE, HASH, COMPILE, LOAD, RUN, N_TIMES};
+
+// runs quick exec and puts in t the total time and the times of its steps, in ms
+static void execOnce(const char *cmd, double *t){
+    double t0 = now();
+    FILE *p = popen(cmd, "r");
+    if (!p) {
+        fprintf(stderr, "error: cannot run %s\n", cmd);
+        exit(EXIT_FAILURE);
+    }
+    char line[512];
+    bool found = false;
+    while (fgets(line, sizeof(line), p)) {
+        char *s = strstr(line, "Exec: ");
+        if (!s) continue;
+        s = strchr(s, ';');
+        found = s && sscanf(s, "; generate %lf ms, hash %lf ms, %*s %lf ms, dlopen %lf ms, run %lf ms",
+            &t[GENERATE], &t[HASH], &t[COMPILE], &t[LOAD], &t[RUN]) == 5;
+    }
+    if (pclose(p) || !found) {
+        fprintf(stderr, "error: %s failed\n", cmd);
+        exit(EXIT_FAILURE);
+    }
+    t[TOTAL] = 1000 * (now() - t0);
+}
+
+static void row(const char *name, double t[N_TIMES][100], int runs){
+    printf("%-6s", name);
+    for (int k = 0; k < N_TIMES; k++) printf(" %10.2f", median(t[k], runs));
+    printf("\n");
+}
+
+int main(int argc, char *argv[]){
+    const char *quick = argc > 1 ? argv[1] : "./quick";
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    int runs = argc > 2 ? atoi(argv[2]) : 10;
+    if (runs < 1 || runs > 100) runs = 10;
+    char qFile[64], cache[64], cmd[512];
+    snprintf(qFile, sizeof(qFile), "/tmp/bench_exec_%d.q", (int)getpid());
+    snprintf(cache, sizeof(cache), "%s/bench_exec_%d", access("/dev/shm", W_OK) ? "/tmp" : "/dev/shm", (int)getpid());
+    FILE *f = fopen(qFile, "w");
+    if (!f) {
+        fprintf(stderr, "error: cannot write %s\n", qFile);
+        return EXIT_FAILURE;
+    }
+    fputs(program, f);
+    fclose(f);
+
+    static double cold[N_TIMES][100], warm[N_TIMES][100], classic[100];
+    double t[N_TIMES];
+    snprintf(cmd, sizeof(cmd), "QUICK_CACHE=%s %s exec --exec-stats %s", cache, quick, qFile);
+    for (int r = 0; r < runs; r++) {
+        // each cold run has an empty cache
+        char rm[128];
+        snprintf(rm, sizeof(rm), "rm -rf %s", cache);
+        system(rm);
+        execOnce(cmd, t);
+        for (int k = 0; k < N_TIMES; k++) cold[k][r] = t[k];
+    }
+    for (int r = 0; r < runs; r++) {
+        execOnce(cmd, t);
+        for (int k = 0; k < N_TIMES; k++) warm[k][r] = t[k];
+    }
+    for (int r = 0; r < runs; r++) {
+        snprintf(cmd, sizeof(cmd), "%s -o %s.c %s >/dev/null && %s -O0 -w -I. -o %s.exe %s.c && %s.exe >/dev/null",
+            quick, qFile, qFile, cc, qFile, qFile, qFile);
+        double t0 = now();
+        if (system(cmd)) {
+            fprintf(stderr, "error: %s failed\n", cmd);
+            return EXIT_FAILURE;
+        }
+        classic[r] = 1000 * (now() - t0);
+    }
+
+    printf("%-6s %10s %10s %10s %10s %10s %10s\n", "exec", "total ms", "generate", "hash", "cc/lookup", "dlopen", "run");
+    row("cold", cold, runs);
+    row("warm", warm, runs);
+    printf("quick + cc -O0 + run: %.2f ms\n", median(classic, runs));
+    snprintf(cmd, sizeof(cmd), "rm -rf %s %s %s.c %s.exe", cache, qFile, qFile, qFile);
+    system(cmd);
+    return 0;
+}
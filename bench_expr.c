@@ -0,0 +1,67 @@
+// Measures the parsing throughput on a program made mostly of expressions.
+// The program is parsed several times and the generated code is kept in memory.
+// usage: bench_expr [statements] [runs]		(default: 200000 statements, 5 runs)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "out.h"
+#include "utils.h"
+
+// the CPU time of the process, which is less noisy than the wall time for a single thread
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// global variables followed by nStatements assignments with arithmetic, comparisons and logical operators
+static char *makeSource(int nStatements, size_t *size){
+    static const char *stmts[] = {
+        "a=(b+c*2-d/3)*(a-1)+b*b-c;\n",
+        "b=a*2+b*3-c*4+d*5-a/2;\n",
+        "c=a<b&&b>=c||!d&&a!=0;\n",
+        "d=-(a+b)*(c-d)/((a*b)+1)-(c+d)*2;\n",
+        "x=x*1.5+y/2.5-(x-y)*(x+y);\n",
+        "a=(a+b<c*d)||(x*y>=2.5&&b==c);\n",
+    };
+    const char *vars = "var a:int;\nvar b:int;\nvar c:int;\nvar d:int;\nvar x:real;\nvar y:real;\n";
+    size_t cap = strlen(vars) + 64 * (size_t)nStatements + 1;
+    char *buf = (char *)safeAlloc(cap);
+    size_t n = strlen(vars);
+    memcpy(buf, vars, n);
+    for (int i = 0; i < nStatements; i++) {
+        const char *s = stmts[i % (sizeof(stmts) / sizeof(stmts[0]))];
+        size_t len = strlen(s);
+        memcpy(buf + n, s, len);
+        n += len;
+    }
+    buf[n] = '\0';
+    *size = n;
+    return buf;
+}
+
+int main(int argc, char *argv[]){
+    int nStatements = argc > 1 ? atoi(argv[1]) : 200000;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    size_t size;
+    char *src = makeSource(nStatements, &size);
+
+    double best = 1e30;
+    for (int r = 0; r < runs; r++) {
+        openMemoryOutput();
+        double t0 = now();
+        parse(src);
+        double dt = now() - t0;
+        closeOutput();
+        if (dt < best) best = dt;
+    }
+    ParserStats s = parserStats();
+    fprintf(stderr, "%d statements, %.1f MB: %.1f MB/s, %.3g statements/s, %.2f lookups per token\n",
+        nStatements, size / 1048576.0, size / best / 1048576.0, nStatements / best, (double)s.peeks / s.tokens);
+    free(src);
+    return 0;
+}
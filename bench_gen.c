@@ -0,0 +1,159 @@
+// Measures the throughput (MB/s) of the code emission into a Text buffer.
+// The same statements are emitted with the old Text_write (vsnprintf twice and exact realloc
+// for each call), with Text_write only (geometric growth) and with the specialized emitters.
+// The three outputs must be identical.
+// usage: bench_gen [MB]		(default: 32 MB)
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gen.h"
+#include "atoms.h"
+#include "utils.h"
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the Text_write from before the geometric growth
+static void oldWrite(Text *text, const char *fmt, ...){
+    va_list va;
+    va_start(va, fmt);
+    int n = vsnprintf(NULL, 0, fmt, va);
+    va_end(va);
+    char *p = (char *)realloc(text->buf, text->n + n + 1);
+    if (!p) err("not enough memory");
+    va_start(va, fmt);
+    vsnprintf(p + text->n, n + 1, fmt, va);
+    va_end(va);
+    text->buf = p;
+    text->n += n;
+}
+
+static const char *names[4];
+
+// the code generated for: if(x<n){ x=x+i; y=f(y,r); }else{ puts("..."); }
+static void emitOld(Text *t, int i){
+    const char *x = names[i & 3], *y = names[(i + 1) & 3];
+    oldWrite(t, "if(");
+    oldWrite(t, "%s", x);
+    oldWrite(t, "<");
+    oldWrite(t, "%d", i);
+    oldWrite(t, "){\n");
+    oldWrite(t, "%s=", x);
+    oldWrite(t, "%s", x);
+    oldWrite(t, "+");
+    oldWrite(t, "%d", -i);
+    oldWrite(t, ";\n");
+    oldWrite(t, "%s=", y);
+    oldWrite(t, "%s", "f");
+    oldWrite(t, "(");
+    oldWrite(t, "%s", y);
+    oldWrite(t, ",");
+    oldWrite(t, "%g", (i & 1023) * 0.25 + 0.125);
+    oldWrite(t, ")");
+    oldWrite(t, ";\n");
+    oldWrite(t, "}\n");
+    oldWrite(t, "else{\n");
+    oldWrite(t, "puts(");
+    oldWrite(t, "\"%.*s\"", 12, "a long string literal");
+    oldWrite(t, ")");
+    oldWrite(t, ";\n");
+    oldWrite(t, "}\n");
+}
+
+static void emitWrite(Text *t, int i){
+    const char *x = names[i & 3], *y = names[(i + 1) & 3];
+    Text_write(t, "if(");
+    Text_write(t, "%s", x);
+    Text_write(t, "<");
+    Text_write(t, "%d", i);
+    Text_write(t, "){\n");
+    Text_write(t, "%s=", x);
+    Text_write(t, "%s", x);
+    Text_write(t, "+");
+    Text_write(t, "%d", -i);
+    Text_write(t, ";\n");
+    Text_write(t, "%s=", y);
+    Text_write(t, "%s", "f");
+    Text_write(t, "(");
+    Text_write(t, "%s", y);
+    Text_write(t, ",");
+    Text_write(t, "%g", (i & 1023) * 0.25 + 0.125);
+    Text_write(t, ")");
+    Text_write(t, ";\n");
+    Text_write(t, "}\n");
+    Text_write(t, "else{\n");
+    Text_write(t, "puts(");
+    Text_write(t, "\"%.*s\"", 12, "a long string literal");
+    Text_write(t, ")");
+    Text_write(t, ";\n");
+    Text_write(t, "}\n");
+}
+
+static void emitFast(Text *t, int i){
+    const char *x = names[i & 3], *y = names[(i + 1) & 3];
+    Text_lit(t, "if(");
+    Text_id(t, x);
+    Text_putc(t, '<');
+    Text_int(t, i);
+    Text_lit(t, "){\n");
+    Text_id(t, x);
+    Text_putc(t, '=');
+    Text_id(t, x);
+    Text_putc(t, '+');
+    Text_int(t, -i);
+    Text_lit(t, ";\n");
+    Text_id(t, y);
+    Text_putc(t, '=');
+    Text_puts(t, "f");
+    Text_putc(t, '(');
+    Text_id(t, y);
+    Text_putc(t, ',');
+    Text_real(t, (i & 1023) * 0.25 + 0.125);
+    Text_putc(t, ')');
+    Text_lit(t, ";\n");
+    Text_lit(t, "}\n");
+    Text_lit(t, "else{\n");
+    Text_lit(t, "puts(");
+    Text_putc(t, '"');
+    Text_putn(t, "a long string literal", 12);
+    Text_putc(t, '"');
+    Text_putc(t, ')');
+    Text_lit(t, ";\n");
+    Text_lit(t, "}\n");
+}
+
+int main(int argc, char *argv[]){
+    size_t size = (size_t)(argc > 1 ? atol(argv[1]) : 32) << 20;
+    names[0] = intern("counter", 7);
+    names[1] = intern("accumulatedValue", 16);
+    names[2] = intern("i", 1);
+    names[3] = intern("elementIndex", 12);
+
+    const char *labels[] = {"old", "write", "fast"};
+    void (*emit[])(Text *, int) = {emitOld, emitWrite, emitFast};
+    Text ref = {0};
+    printf("%8s %10s %10s\n", "emitter", "MB/s", "calls/s");
+    for (int k = 0; k < 3; k++) {
+        Text t = {0};
+        long calls = 0;
+        double t0 = now();
+        for (int i = 0; t.n < size; i++, calls += 25) emit[k](&t, i);
+        double dt = now() - t0;
+        printf("%8s %10.1f %10.3g\n", labels[k], t.n / dt / (1 << 20), calls / dt);
+        if (k == 0) {
+            ref = t;
+        } else {
+            if (t.n != ref.n || memcmp(t.buf, ref.buf, t.n)) err("the %s output is different from the old one", labels[k]);
+            Text_clear(&t);
+        }
+    }
+    free(ref.buf);
+    freeArenas();
+    return 0;
+}
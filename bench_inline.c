@@ -0,0 +1,120 @@
+// Measures the runtime of a call-heavy Quick program compiled with and without inlining.
+// The program is compiled to C with -O and --inline-budget 0 or the given budget, then each C file
+// is compiled with the C compiler ($CC, by default cc) at -O0 and -O2 and executed.
+// The outputs of all the executables must be identical.
+// usage: bench_inline [iterations] [budget]		(default: 20000 iterations of the inner loop, budget 40)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "out.h"
+#include "utils.h"
+#include "opt.h"
+#include "prune.h"
+#include "inliner.h"
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// small helpers called from a hot loop; only step and the loop remain calls after inlining
+static const char *program =
+    "function max(x:int, y:int):int\n"
+    "  if(x<y) return y; end\n"
+    "  return x;\n"
+    "end\n"
+    "function min(x:int, y:int):int\n"
+    "  if(x<y) return x; end\n"
+    "  return y;\n"
+    "end\n"
+    "function absi(x:int):int\n"
+    "  if(x<0) return -x; end\n"
+    "  return x;\n"
+    "end\n"
+    "function clamp(x:int, lo:int, hi:int):int\n"
+    "  return max(lo, min(x, hi));\n"
+    "end\n"
+    "function step(s:int, i:int):int\n"
+    "  return clamp(s+absi(i-500)*3-min(i, 700), 0-1000000, 1000000);\n"
+    "end\n"
+    "function run(n:int):int\n"
+    "  var s:int;\n"
+    "  var i:int;\n"
+    "  var j:int;\n"
+    "  s=0;\n"
+    "  j=0;\n"
+    "  while(j<n)\n"
+    "    i=0;\n"
+    "    while(i<1000)\n"
+    "      s=step(s, i)-max(absi(s-j), i)/7;\n"
+    "      i=i+1;\n"
+    "    end\n"
+    "    j=j+1;\n"
+    "  end\n"
+    "  return s;\n"
+    "end\n"
+    "puti(run(%d));\n";
+
+static void compileQuick(const char *src, const char *cFile, int budget){
+    inlineBudget = budget;
+    openOutput(cFile);
+    parse(src);
+    closeOutput();
+}
+
+// compiles the C file and returns the output of the executable and its runtime
+static double run(const char *cFile, const char *level, char *out, size_t outSize){
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "%s %s -w -I. -o %s.exe %s", cc, level, cFile, cFile);
+    if (system(cmd)) err("cannot compile %s", cFile);
+    snprintf(cmd, sizeof(cmd), "%s.exe", cFile);
+    double t0 = now();
+    FILE *p = popen(cmd, "r");
+    if (!p) err("cannot run %s", cmd);
+    size_t n = fread(out, 1, outSize - 1, p);
+    out[n] = '\0';
+    pclose(p);
+    double dt = now() - t0;
+    remove(cmd);
+    return dt;
+}
+
+int main(int argc, char *argv[]){
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    int budget = argc > 2 ? atoi(argv[2]) : 40;
+    char src[4096];
+    snprintf(src, sizeof(src), program, iterations);
+    optLevel = 1;
+    pruning = true;
+
+    char plain[64], inlined[64];
+    snprintf(plain, sizeof(plain), "/tmp/bench_inline_%d_0.c", (int)getpid());
+    snprintf(inlined, sizeof(inlined), "/tmp/bench_inline_%d_1.c", (int)getpid());
+    compileQuick(src, plain, 0);
+    compileQuick(src, inlined, budget);
+    InlineStats s = inlineStats();
+    fprintf(stderr, "%d calls inlined (%d nodes)\n", s.inlined, s.nodes);
+
+    const char *levels[] = {"-O0", "-O2"};
+    char ref[64] = "", out[64];
+    fprintf(stderr, "%6s %12s %12s %8s\n", "cc", "no inline s", "inline s", "speedup");
+    for (int k = 0; k < 2; k++) {
+        double t0 = run(plain, levels[k], out, sizeof(out));
+        if (!ref[0]) strcpy(ref, out);
+        if (strcmp(out, ref)) err("different output without inlining at %s", levels[k]);
+        double t1 = run(inlined, levels[k], out, sizeof(out));
+        if (strcmp(out, ref)) err("different output with inlining at %s", levels[k]);
+        fprintf(stderr, "%6s %12.3f %12.3f %8.2f\n", levels[k], t0, t1, t0 / t1);
+    }
+    remove(plain);
+    remove(inlined);
+    freeArenas();
+    return 0;
+}
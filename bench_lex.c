@@ -0,0 +1,89 @@
+// Measures the lexing throughput (MB/s) of tokenize for each set of scanning kernels.
+// The tokens from all the kernels must be identical to the ones from the scalar kernels.
+// usage: bench_lex [MB]		(default: 64 MB)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "scan.h"
+#include "utils.h"
+
+static int sameTokens(const Token *a, const Token *b, int n){
+    for (int i = 0; i < n; i++) {
+        if (a[i].code != b[i].code || a[i].line != b[i].line) return 0;
+        switch (a[i].code) {
+            case INT: if (a[i].i != b[i].i) return 0; break;
+            case REAL: if (a[i].r != b[i].r) return 0; break;
+            case ID: if (a[i].name != b[i].name) return 0; break;
+            case STR: if (a[i].pos != b[i].pos || a[i].len != b[i].len) return 0; break;
+        }
+    }
+    return 1;
+}
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// a Quick source with long identifiers, numbers, strings, comments and indentation
+static char *makeSource(size_t size){
+    static const char chunk[] =
+        "# computes the score of an element from the current generation\n"
+        "function computeElementScore_v2(elementIndex:int, scaleFactor:real):real\n"
+        "        var accumulatedValue:real;\n"
+        "        accumulatedValue=scaleFactor*1234.5678;\n"
+        "        while(elementIndex>=100000)\n"
+        "                elementIndex=elementIndex-17;    # keeps it in range\n"
+        "                end\n"
+        "        puts(\"the accumulated value of the current element is:\");\n"
+        "        return accumulatedValue/3.0;\n"
+        "        end\r\n";
+    char *buf = (char *)safeAlloc(size + 1);
+    size_t n = 0;
+    while (n + sizeof(chunk) - 1 <= size) {
+        memcpy(buf + n, chunk, sizeof(chunk) - 1);
+        n += sizeof(chunk) - 1;
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+int main(int argc, char *argv[]){
+    size_t size = (size_t)(argc > 1 ? atol(argv[1]) : 64) << 20;
+    char *src = makeSource(size);
+    size_t n = strlen(src);
+
+    const char *names[] = {"scalar", "sse2", "avx2"};
+    Token *reference = NULL;
+    int nReference = 0;
+    printf("%8s %10s %10s\n", "kernels", "MB/s", "tokens");
+    for (int k = 0; k < 3; k++) {
+        if (!useScanKernels(names[k])) {
+            printf("%8s %10s\n", names[k], "n/a");
+            continue;
+        }
+        double best = 1e9;
+        for (int r = 0; r < 5; r++) {
+            nTokens = 0;
+            double t0 = now();
+            tokenize(src);
+            double t = now() - t0;
+            if (t < best) best = t;
+        }
+        if (!reference) {
+            reference = (Token *)safeAlloc(nTokens * sizeof(Token));
+            memcpy(reference, tokens, nTokens * sizeof(Token));
+            nReference = nTokens;
+        } else if (nTokens != nReference || !sameTokens(reference, tokens, nTokens)) {
+            err("the tokens from the %s kernels are different from the scalar ones", names[k]);
+        }
+        printf("%8s %10.1f %10d\n", names[k], n / best / 1e6, nTokens);
+    }
+    free(reference);
+    free(src);
+    return 0;
+}
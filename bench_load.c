@@ -0,0 +1,52 @@
+// Measures the time needed by loadSource for input files with sizes from 4 KB to 1 GB.
+// Because regular files are memory-mapped, the load time must remain almost constant.
+// usage: bench_load [maxMB] [dir]		(default: 1024 MB in /tmp)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// writes a Quick file of approximately "size" bytes, by repeating a small program
+static void writeQuickFile(const char *path, size_t size){
+    static const char chunk[] = "var i:int;\ni=0;    # iterator\nwhile(i<10)\n    puti(i);\n    i=i+1;\n    end\n";
+    FILE *fis = fopen(path, "wb");
+    if (!fis) err("cannot create %s", path);
+    for (size_t n = 0; n < size; n += sizeof(chunk) - 1) {
+        fwrite(chunk, 1, sizeof(chunk) - 1, fis);
+    }
+    fclose(fis);
+}
+
+int main(int argc, char *argv[]){
+    size_t maxSize = (size_t)(argc > 1 ? atol(argv[1]) : 1024) << 20;
+    const char *dir = argc > 2 ? argv[2] : "/tmp";
+    char path[256];
+    snprintf(path, sizeof(path), "%s/bench_load.q", dir);
+
+    printf("%12s %12s %12s\n", "size (KB)", "load (us)", "free (us)");
+    for (size_t size = 4 << 10; size <= maxSize; size *= 4) {
+        writeQuickFile(path, size);
+        const int runs = 10;
+        double tLoad = 0, tFree = 0;
+        for (int r = 0; r < runs; r++) {
+            double t0 = now();
+            Source src = loadSource(path);
+            double t1 = now();
+            if (src.text[src.n] != '\0') err("the source is not NUL-terminated");
+            freeSource(&src);
+            tLoad += t1 - t0;
+            tFree += now() - t1;
+        }
+        printf("%12zu %12.1f %12.1f\n", size >> 10, tLoad / runs * 1e6, tFree / runs * 1e6);
+    }
+    remove(path);
+    return 0;
+}
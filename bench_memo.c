@@ -0,0 +1,101 @@
+// Measures the runtime of classic recursive workloads compiled with and without --memoize.
+// Each Quick program is compiled to C in memory, then with the C compiler ($CC, by default cc) at -O2 and executed.
+// The outputs must be identical; the memoized executables also show on stderr how many calls were found in the tables.
+// usage: bench_memo [memo size]		(default: 4096 entries per function)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "out.h"
+#include "utils.h"
+#include "memo.h"
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct{
+    const char *name;
+    const char *program;
+}Workload;
+
+static const Workload workloads[] = {
+    {"fib(35)",
+        "function fib(n:int):int\n"
+        "  if(n<2) return n; end\n"
+        "  return fib(n-1)+fib(n-2);\n"
+        "end\n"
+        "puti(fib(35));\n"},
+    {"binom(30,15)",
+        "function binom(n:int, k:int):int\n"
+        "  if(k==0) return 1; end\n"
+        "  if(k==n) return 1; end\n"
+        "  return binom(n-1, k-1)+binom(n-1, k);\n"
+        "end\n"
+        "puti(binom(30, 15));\n"},
+    {"paths(15,15)",
+        "function paths(x:int, y:int):int\n"
+        "  if(x==0) return 1; end\n"
+        "  if(y==0) return 1; end\n"
+        "  return paths(x-1, y)+paths(x, y-1);\n"
+        "end\n"
+        "puti(paths(15, 15));\n"},
+    {"score(32,1.0)",
+        "function score(n:real, w:real):real\n"
+        "  var a:real;\n"
+        "  if(n)\n"
+        "    a=score(n-1.0, w*0.75);\n"
+        "    if(n-1.0) return a*0.5+score(n-2.0, w*0.5)+w; end\n"
+        "    return a+w;\n"
+        "  end\n"
+        "  return w;\n"
+        "end\n"
+        "putr(score(32.0, 1.0));\n"},
+};
+
+// compiles the C file, then returns the output of the executable and its runtime
+static double run(const char *cFile, char *out, size_t outSize){
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "%s -O2 -w -I. -o %s.exe %s", cc, cFile, cFile);
+    if (system(cmd)) err("cannot compile %s", cFile);
+    snprintf(cmd, sizeof(cmd), "%s.exe", cFile);
+    double t0 = now();
+    FILE *p = popen(cmd, "r");
+    if (!p) err("cannot run %s", cmd);
+    size_t n = fread(out, 1, outSize - 1, p);
+    out[n] = '\0';
+    pclose(p);
+    double dt = now() - t0;
+    remove(cmd);
+    return dt;
+}
+
+int main(int argc, char *argv[]){
+    if (argc > 1) memoSize = atoi(argv[1]);
+    char cFile[64];
+    snprintf(cFile, sizeof(cFile), "/tmp/bench_memo_%d.c", (int)getpid());
+    char ref[64], out[64];
+    fprintf(stderr, "%-14s %10s %10s %8s\n", "workload", "plain s", "memo s", "speedup");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        double t[2];
+        for (int m = 0; m < 2; m++) {
+            memoize = m;
+            openOutput(cFile);
+            parse(workloads[w].program);
+            closeOutput();
+            t[m] = run(cFile, m ? out : ref, sizeof(out));
+        }
+        if (strcmp(out, ref)) err("different output with memoization for %s", workloads[w].name);
+        fprintf(stderr, "%-14s %10.3f %10.3f %8.1f\n", workloads[w].name, t[0], t[1], t[0] / t[1]);
+    }
+    remove(cFile);
+    freeArenas();
+    return 0;
+}
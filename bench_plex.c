@@ -0,0 +1,86 @@
+// Measures how tokenizeParallel scales from 1 to 32 threads, compared with tokenize.
+// The tokens from all the runs must be identical to the ones from tokenize.
+// usage: bench_plex [MB]		(default: 64 MB)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "plexer.h"
+#include "utils.h"
+
+static int sameTokens(const Token *a, const Token *b, int n){
+    for (int i = 0; i < n; i++) {
+        if (a[i].code != b[i].code || a[i].line != b[i].line) return 0;
+        switch (a[i].code) {
+            case INT: if (a[i].i != b[i].i) return 0; break;
+            case REAL: if (a[i].r != b[i].r) return 0; break;
+            case ID: if (a[i].name != b[i].name) return 0; break;
+            case STR: if (a[i].pos != b[i].pos || a[i].len != b[i].len) return 0; break;
+        }
+    }
+    return 1;
+}
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// a Quick source with comments and with strings which contain newlines,
+// so some chunks start inside strings
+static char *makeSource(size_t size){
+    static const char chunk[] =
+        "# computes the score of an element\n"
+        "function computeElementScore(elementIndex:int, scaleFactor:real):real\n"
+        "        var accumulatedValue:real;\n"
+        "        accumulatedValue=scaleFactor*1234.5678;\n"
+        "        while(elementIndex>=100000)\n"
+        "                elementIndex=elementIndex-17;    # keeps it in range\n"
+        "                end\n"
+        "        puts(\"a string\n# which is not a comment\nand has (unbalanced parentheses\");\n"
+        "        return accumulatedValue/3.0;\n"
+        "        end\n";
+    char *buf = (char *)safeAlloc(size + 1);
+    size_t n = 0;
+    while (n + sizeof(chunk) - 1 <= size) {
+        memcpy(buf + n, chunk, sizeof(chunk) - 1);
+        n += sizeof(chunk) - 1;
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+int main(int argc, char *argv[]){
+    size_t size = (size_t)(argc > 1 ? atol(argv[1]) : 64) << 20;
+    char *src = makeSource(size);
+    size_t n = strlen(src);
+
+    double t0 = now();
+    tokenize(src);
+    double tSerial = now() - t0;
+    int nReference = nTokens;
+    Token *reference = (Token *)safeAlloc(nTokens * sizeof(Token));
+    memcpy(reference, tokens, nTokens * sizeof(Token));
+    printf("%8s %10s %10s\n", "threads", "MB/s", "speedup");
+    printf("%8s %10.1f %10.2f\n", "serial", n / tSerial / 1e6, 1.0);
+
+    for (int nThreads = 1; nThreads <= 32; nThreads *= 2) {
+        double best = 1e9;
+        for (int r = 0; r < 3; r++) {
+            t0 = now();
+            tokenizeParallel(src, nThreads);
+            double t = now() - t0;
+            if (t < best) best = t;
+        }
+        if (nTokens != nReference || !sameTokens(reference, tokens, nTokens)) {
+            err("the tokens from %d threads are different from the ones of tokenize", nThreads);
+        }
+        printf("%8d %10.1f %10.2f\n", nThreads, n / best / 1e6, tSerial / best);
+    }
+    free(reference);
+    free(src);
+    return 0;
+}
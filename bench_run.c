@@ -0,0 +1,126 @@
+// Measures the latency from the start of a Quick program to its first output, for quick run (bytecode)
+// and for the compilation through C: quick writes the C code, the C compiler ($CC, by default cc)
+// builds it at -O0 or -O2 (with quick.h from the current directory), then it is executed.
+// The outputs of all the paths must be identical. The times are the medians of several runs.
+// usage: bench_run [quick] [file.q] [runs]		(default: ./quick, a small generated program, 5 runs)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// a short job: a few functions and a loop
+static const char *program =
+    "var total:int;\n"
+    "function fib(n:int):int\n"
+    "  if(n<2) return n; end\n"
+    "  return fib(n-1)+fib(n-2);\n"
+    "end\n"
+    "function sum(n:int):int\n"
+    "  var i:int;\n"
+    "  var s:int;\n"
+    "  i=0; s=0;\n"
+    "  while(i<n)\n"
+    "    s=s+i*i/3;\n"
+    "    i=i+1;\n"
+    "  end\n"
+    "  return s;\n"
+    "end\n"
+    "function half(x:real):real\n"
+    "  return x/2.0;\n"
+    "end\n"
+    "puts(\"start\");\n"
+    "total=fib(20)+sum(10000);\n"
+    "puti(total);\n"
+    "putr(half(3.5));\n";
+
+static void runOrDie(const char *cmd){
+    if (system(cmd)) {
+        fprintf(stderr, "error: %s failed\n", cmd);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// executes the command and returns the time until its first output char and until its end
+static void measure(const char *cmd, double t0, double *first, double *total, char *out, size_t outSize){
+    FILE *p = popen(cmd, "r");
+    if (!p) {
+        fprintf(stderr, "error: cannot run %s\n", cmd);
+        exit(EXIT_FAILURE);
+    }
+    size_t n = 0;
+    int c = fgetc(p);
+    *first = now() - t0;
+    for (; c != EOF; c = fgetc(p)) {
+        if (n + 1 < outSize) out[n++] = (char)c;
+    }
+    out[n] = '\0';
+    pclose(p);
+    *total = now() - t0;
+}
+
+static int compareDoubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n){
+    qsort(v, n, sizeof(double), compareDoubles);
+    return v[n / 2];
+}
+
+int main(int argc, char *argv[]){
+    const char *quick = argc > 1 ? argv[1] : "./quick";
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    int runs = argc > 3 ? atoi(argv[3]) : 5;
+    if (runs < 1 || runs > 100) runs = 5;
+    char qFile[256], cFile[64], exe[64], cmd[1024];
+    snprintf(cFile, sizeof(cFile), "/tmp/bench_run_%d.c", (int)getpid());
+    snprintf(exe, sizeof(exe), "/tmp/bench_run_%d.exe", (int)getpid());
+    if (argc > 2 && *argv[2]) {
+        snprintf(qFile, sizeof(qFile), "%s", argv[2]);
+    } else {
+        snprintf(qFile, sizeof(qFile), "/tmp/bench_run_%d.q", (int)getpid());
+        FILE *f = fopen(qFile, "w");
+        if (!f) {
+            fprintf(stderr, "error: cannot write %s\n", qFile);
+            return EXIT_FAILURE;
+        }
+        fputs(program, f);
+        fclose(f);
+    }
+
+    const char *paths[] = {"quick run", "C -O0", "C -O2"};
+    double first[3][100], total[3][100];
+    char ref[4096], out[4096];
+    for (int r = 0; r < runs; r++) {
+        snprintf(cmd, sizeof(cmd), "%s run %s", quick, qFile);
+        measure(cmd, now(), &first[0][r], &total[0][r], ref, sizeof(ref));
+        for (int k = 1; k < 3; k++) {
+            double t0 = now();
+            snprintf(cmd, sizeof(cmd), "%s -o %s %s >/dev/null", quick, cFile, qFile);
+            runOrDie(cmd);
+            snprintf(cmd, sizeof(cmd), "%s %s -w -I. -o %s %s", cc, k == 1 ? "-O0" : "-O2", exe, cFile);
+            runOrDie(cmd);
+            measure(exe, t0, &first[k][r], &total[k][r], out, sizeof(out));
+            if (strcmp(out, ref)) {
+                fprintf(stderr, "error: different output for %s:\n%s\ninstead of:\n%s\n", paths[k], out, ref);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    printf("%-10s %16s %12s\n", "path", "first output ms", "total ms");
+    for (int k = 0; k < 3; k++) {
+        printf("%-10s %16.1f %12.1f\n", paths[k], 1000 * median(first[k], runs), 1000 * median(total[k], runs));
+    }
+    remove(cFile);
+    remove(exe);
+    if (argc <= 2 || !*argv[2]) remove(qFile);
+    return 0;
+}
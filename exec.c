@@ -0,0 +1,259 @@
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "exec.h"
+#include "opt.h"
+#include "out.h"
+#include "utils.h"
+
+bool execMode;
+
+static ExecStats stats;
+static double start;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void beginExec(void) {
+    memset(&stats, 0, sizeof(stats));
+    start = now();
+    openMemoryOutput();
+}
+
+// FNV-1a
+static uint64_t hash(uint64_t h, const char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// creates the cache directory if needed; another user must not be able to put a shared object in it
+static void cacheDir(char *dir, size_t size) {
+    const char *env = getenv("QUICK_CACHE"), *runtime = getenv("XDG_RUNTIME_DIR");
+    int k;
+    if (env && *env) k = snprintf(dir, size, "%s", env);
+    else if (runtime && *runtime) k = snprintf(dir, size, "%s/quick", runtime);
+    else k = snprintf(dir, size, "%s/quick-%d", access("/dev/shm", W_OK) ? "/tmp" : "/dev/shm", (int)getuid());
+    if (k >= (int)size) err("the path of the cache directory is too long");
+    if (mkdir(dir, 0700) && errno != EEXIST) err("cannot create the cache directory %s: %s", dir, strerror(errno));
+    struct stat st;
+    if (lstat(dir, &st) || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077)) {
+        err("the cache directory %s must be a directory which can be accessed only by its owner", dir);
+    }
+}
+
+#define MAX_CC_ARGS 64
+
+// the command of the C compiler, without the output: $CC (default cc), which can have its own arguments
+// separated by spaces, then the options of exec; the arguments are in buf
+static int ccCommand(char *buf, size_t size, const char **argv) {
+    const char *cc = getenv("CC") && *getenv("CC") ? getenv("CC") : "cc";
+    if (snprintf(buf, size, "%s", cc) >= (int)size) err("$CC is too long");
+    // the optimized C code is also built with the optimizations of the C compiler;
+    // the functions of the program are hidden and bound inside the shared object, so a function named like
+    // one of the C library or of quick (div, abs, free...) is not replaced by that one when the object is loaded,
+    // and -fno-builtin keeps the C compiler from using its own abs, exit...
+    const char *options[] = {"-shared", "-fPIC", "-fvisibility=hidden", "-Wl,-Bsymbolic", "-fno-builtin", "-w", "-I.",
+        optLevel ? "-O2" : "-O0", "-x", "c"};
+    const int nOptions = sizeof(options) / sizeof(options[0]);
+    int argc = 0;
+    for (char *arg = strtok(buf, " \t"); arg; arg = strtok(NULL, " \t")) {
+        // the options, -o file - and NULL must also fit
+        if (argc + nOptions + 4 > MAX_CC_ARGS) err("$CC has too many arguments");
+        argv[argc++] = arg;
+    }
+    if (!argc) err("$CC is empty");
+    for (int i = 0; i < nOptions; i++) argv[argc++] = options[i];
+    return argc;
+}
+
+// writes all the n bytes, or returns false on error
+static bool writeAll(int fd, const char *p, size_t n) {
+    while (n) {
+        ssize_t k = write(fd, p, n);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += k;
+        n -= (size_t)k;
+    }
+    return true;
+}
+
+// builds the shared object from the C code, which is written on the stdin of the C compiler;
+// the compiler is started without a shell, so the paths can have any chars;
+// it is built in a temporary file and then renamed, so a concurrent exec never loads a partial file
+static void compile(const char **argv, int argc, const char *code, size_t n, const char *so) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.%d.tmp", so, (int)getpid()) >= (int)sizeof(tmp)) err("%s is too long", so);
+    argv[argc++] = "-o";
+    argv[argc++] = tmp;
+    argv[argc++] = "-";
+    argv[argc] = NULL;
+    int fds[2];
+    if (pipe(fds)) err("cannot create a pipe: %s", strerror(errno));
+    pid_t pid = fork();
+    if (pid < 0) err("cannot run %s: %s", argv[0], strerror(errno));
+    if (!pid) {
+        dup2(fds[0], STDIN_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(argv[0], (char *const *)argv);
+        fprintf(stderr, "error: cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    close(fds[0]);
+    // if the C compiler ends before it reads all the code, the write fails with EPIPE instead of killing quick
+    void (*oldHandler)(int) = signal(SIGPIPE, SIG_IGN);
+    bool written = writeAll(fds[1], code, n);
+    close(fds[1]);
+    signal(SIGPIPE, oldHandler);
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) err("cannot wait for %s: %s", argv[0], strerror(errno));
+    }
+    if (!written || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        remove(tmp);
+        err("the C compiler failed: %s", argv[0]);
+    }
+    if (rename(tmp, so)) err("cannot rename %s: %s", tmp, strerror(errno));
+}
+
+// returns 1 if the file has the n bytes of data, 0 if it has other content and -1 if it does not exist
+static int compareFile(const char *file, const char *data, size_t n) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) return -1;
+        err("cannot open %s: %s", file, strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st)) err("cannot stat %s: %s", file, strerror(errno));
+    int same = 0;
+    if ((size_t)st.st_size == n) {
+        char *content = (char *)safeAlloc(n + 1);
+        size_t done = 0;
+        for (ssize_t k; done < n && (k = read(fd, content + done, n - done)) != 0;) {
+            if (k < 0) {
+                if (errno == EINTR) continue;
+                err("cannot read %s: %s", file, strerror(errno));
+            }
+            done += (size_t)k;
+        }
+        same = done == n && !memcmp(content, data, n);
+        free(content);
+    }
+    close(fd);
+    return same;
+}
+
+// creates the file with the n bytes of data, only if it does not exist; returns false if it exists
+// the content is written in a temporary file, which is then linked, so the file is never partial
+static bool createFile(const char *file, const char *data, size_t n) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.%d.tmp", file, (int)getpid()) >= (int)sizeof(tmp)) err("%s is too long", file);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) err("cannot create %s: %s", tmp, strerror(errno));
+    if (!writeAll(fd, data, n) || close(fd)) err("cannot write %s: %s", tmp, strerror(errno));
+    int result = link(tmp, file);
+    int linkErr = errno;
+    remove(tmp);
+    if (result && linkErr != EEXIST) err("cannot create %s: %s", file, strerror(linkErr));
+    return !result;
+}
+
+// the max number of cached programs with the same hash
+#define MAX_PROBES 16
+
+int execProgram(void) {
+    size_t n;
+    const char *code = outputMemory(&n);
+    double t = now();
+    stats.generate = t - start;
+
+    char ccBuf[1024];
+    const char *argv[MAX_CC_ARGS];
+    int argc = ccCommand(ccBuf, sizeof(ccBuf), argv);
+    // the key is the hash of the input of the C compiler: its arguments, quick.h and the C code
+    char *header = access("quick.h", R_OK) ? NULL : loadFile("quick.h");
+    size_t nHeader = header ? strlen(header) : 0, nInput = nHeader + 1 + n;
+    for (int i = 0; i < argc; i++) nInput += strlen(argv[i]) + 1;
+    char *input = (char *)safeAlloc(nInput), *p = input;
+    for (int i = 0; i < argc; i++) {
+        size_t k = strlen(argv[i]) + 1;
+        memcpy(p, argv[i], k);
+        p += k;
+    }
+    if (header) memcpy(p, header, nHeader);
+    p[nHeader] = '\0';
+    memcpy(p + nHeader + 1, code, n);
+    free(header);
+    stats.key = hash(0xcbf29ce484222325ULL, input, nInput);
+    stats.hash = now() - t;
+
+    // each shared object is kept with its input in a .src file, which is compared before the object is loaded;
+    // a different program with the same hash is kept with the next suffix; the .src file is created first
+    // and never replaced, so the programs which find it are the same and they build the same object
+    t = now();
+    char dir[PATH_MAX - 64], so[PATH_MAX], src[PATH_MAX];
+    cacheDir(dir, sizeof(dir));
+    for (int probe = 0;; probe++) {
+        if (probe == MAX_PROBES) {
+            err("too many programs in the cache %s with the hash %016llx", dir, (unsigned long long)stats.key);
+        }
+        snprintf(so, sizeof(so), "%s/%016llx-%d.so", dir, (unsigned long long)stats.key, probe);
+        snprintf(src, sizeof(src), "%s/%016llx-%d.src", dir, (unsigned long long)stats.key, probe);
+        int same = compareFile(src, input, nInput);
+        if (!same) continue;
+        if (same < 0 && !createFile(src, input, nInput)) {
+            // created by another exec in the meantime
+            probe--;
+            continue;
+        }
+        if (access(so, R_OK)) {
+            compile(argv, argc, code, n, so);
+            stats.compiled = true;
+        }
+        break;
+    }
+    free(input);
+    stats.compile = now() - t;
+
+    t = now();
+    void *lib = dlopen(so, RTLD_NOW | RTLD_LOCAL);
+    if (!lib) err("cannot load %s: %s", so, dlerror());
+    int (*entry)(void) = (int (*)(void))dlsym(lib, "main");
+    if (!entry) err("%s has no main", so);
+    stats.load = now() - t;
+
+    t = now();
+    fflush(stdout);
+    int result = entry();
+    fflush(stdout);
+    stats.run = now() - t;
+    // the library is not closed, because the program can have functions called at exit (see --memoize)
+    return result;
+}
+
+ExecStats execStats(void) {
+    return stats;
+}
+
+void showExecStats(void) {
+    printf("Exec: %016llx %s; generate %.2f ms, hash %.3f ms, %s %.2f ms, dlopen %.2f ms, run %.2f ms\n",
+        (unsigned long long)stats.key, stats.compiled ? "compiled" : "found in the cache",
+        1000 * stats.generate, 1000 * stats.hash, stats.compiled ? "compile" : "lookup", 1000 * stats.compile,
+        1000 * stats.load, 1000 * stats.run);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Executes a program in the process of the compiler, when execMode is true (quick exec file.q).
+// The C code is generated in memory (see openMemoryOutput), then it is given to the C compiler on its stdin,
+// which builds a shared object. The shared object is loaded with dlopen and its main is called directly.
+// Only main is exported from it; the other symbols are hidden, so they cannot bind to the ones of the process.
+// The shared objects are kept in a cache directory which is private to the user and on tmpfs if possible:
+// $QUICK_CACHE, else $XDG_RUNTIME_DIR/quick, else /dev/shm/quick-<uid>, else /tmp/quick-<uid>.
+// Their names are the hash of the C code, of the compiler command and of quick.h, so a program which was
+// already compiled is loaded without running the C compiler. Each one is kept with these inputs, which are
+// compared before it is loaded, so two programs with the same hash never share a shared object.
+// The C compiler is $CC (default cc, which can have arguments) and it is run without a shell.
+// quick.h is taken from the current directory, like for the C code in files.
+extern bool execMode;
+
+// starts the generation of the C code in memory, instead of openOutput
+void beginExec(void);
+
+// builds or finds in the cache the generated C code, then executes it and returns the result of its main
+int execProgram(void);
+
+typedef struct{
+    uint64_t key;       // the hash of the input of the C compiler, which is in the name of the shared object
+    bool compiled;      // the shared object was built, because it was not in the cache
+    double generate;    // the seconds from beginExec until the C code was ready, including the parsing
+    double hash;        // the seconds to compute the key
+    double compile;     // the seconds of the C compiler, or to find the shared object in the cache
+    double load;        // the seconds of dlopen and dlsym
+    double run;         // the seconds of the program
+}ExecStats;
+
+ExecStats execStats(void);
+void showExecStats(void);
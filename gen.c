@@ -1,40 +1,94 @@
+#include <limits.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lexer.h"
 #include "ad.h"
 #include "gen.h"
+#include "utils.h"
+#include "atoms.h"
+#include "ast.h"
+#include "ir.h"
 
-Text tBegin,tMain,tFunctions,tFnHeader;
-Text *crtCode;
-Text *crtVar;
+static Arena genArena=ARENA("code");
+Text tBegin,tMain,tFunctions;
+
+void Text_grow(Text *text,size_t n){
+	if(text->n+n<text->cap)return;
+	size_t cap=text->cap?text->cap*2:256;
+	while(cap<=text->n+n)cap*=2;
+	text->buf=(char*)arenaGrow(&genArena,text->buf,text->cap,cap);
+	text->cap=cap;
+	}
 
 void Text_write(Text *text,const char *fmt,...){
 	va_list va;	
 	va_start(va,fmt);	// "va" is an iterator to the variable list of arguments
-	// vsnprintf called with buffer==NULL, or max nb. of chars==0
-	// returns the total number of chars, without \0, which will be written
+	// tries to write directly in the free space of the buffer
+	// vsnprintf returns the total number of chars, without \0, which will be written
 	// if there is a suitable sized buffer
-	int n=vsnprintf(NULL,0,fmt,va);
-	// realloc the dynamic buffer to add the new chars
-	char *p=(char*)realloc(text->buf,(text->n+n+1)*sizeof(char));
-	if(p==NULL){
-		puts("not enough memory");
-		exit(EXIT_FAILURE);
-		}
-	// adds the new chars to the dynamic buffer
-	va_start(va,fmt);		// resets the iterator in the variable list of arguments
-	vsnprintf(p+text->n,n+1,fmt,va);
-	text->buf=p;
-	text->n+=n;
+	size_t room=text->cap-text->n;
+	int n=vsnprintf(room?text->buf+text->n:NULL,room,fmt,va);
 	va_end(va);
+	if((size_t)n>=room){
+		// there was not enough room, so grows the buffer and writes again
+		Text_grow(text,n);
+		va_start(va,fmt);		// resets the iterator in the variable list of arguments
+		vsnprintf(text->buf+text->n,n+1,fmt,va);
+		va_end(va);
+		}
+	text->n+=n;
+	}
+
+void Text_puts(Text *text,const char *s){
+	Text_putn(text,s,strlen(s));
+	}
+
+void Text_id(Text *text,const char *atom){
+	Text_putn(text,atom,atomLen(atom));
+	}
+
+void Text_int(Text *text,int i){
+	char digits[12];
+	char *p=digits+sizeof(digits);
+	unsigned u=i<0?-(unsigned)i:(unsigned)i;
+	do{
+		*--p='0'+u%10;
+		u/=10;
+		}while(u);
+	if(i<0)*--p='-';
+	Text_putn(text,p,digits+sizeof(digits)-p);
+	}
+
+void Text_real(Text *text,double r){
+	// %g has many special cases, so it remains formatted by snprintf
+	// the precision is increased only if the value cannot be read back exactly (for computed values)
+	Text_grow(text,32);
+	char *p=text->buf+text->n;
+	int n=snprintf(p,32,"%g",r);
+	for(int prec=15;prec<=17&&strtod(p,NULL)!=r;prec++)n=snprintf(p,32,"%.*g",prec,r);
+	// it must remain a real in C, else 1.0/2.0 would become the int division 1/2
+	if(!strpbrk(p,".en")){
+		p[n++]='.';
+		p[n++]='0';
+		p[n]='\0';
+		}
+	text->n+=n;
+	}
+
+void Text_truncate(Text *text,size_t n){
+	if(n>=text->n)return;
+	text->n=n;
+	text->buf[n]='\0';
 	}
 
 void Text_clear(Text *text){
-	free(text->buf);
-	text->buf=NULL;
+	// the buffer is kept for the next writes
 	text->n=0;
+	if(text->buf)text->buf[0]='\0';
 	}
 
 const char *cType(int type){
@@ -47,3 +101,466 @@ const char *cType(int type){
 			exit(EXIT_FAILURE);
 		}
 	}
+
+// the negative constants come only from folding and they are parenthesized,
+// so they remain correct after any operator (a- -1, not a--1)
+static void genInt(Text *t,int i){
+	if(i>=0)Text_int(t,i);
+	else if(i==INT_MIN)Text_lit(t,"(-2147483647-1)");
+	else{
+		Text_putc(t,'(');
+		Text_int(t,i);
+		Text_putc(t,')');
+		}
+	}
+
+// inf and NaN have no C literal, so they are written as the divisions which give them
+static void genReal(Text *t,double r){
+	if(isnan(r))Text_lit(t,"(0.0/0.0)");
+	else if(isinf(r))Text_puts(t,r>0?"(1.0/0.0)":"(-1.0/0.0)");
+	else if(!signbit(r))Text_real(t,r);
+	else{
+		Text_putc(t,'(');
+		Text_real(t,r);
+		Text_putc(t,')');
+		}
+	}
+
+static void genExpr(Text *t,int id){
+	const Node *n=&nodes[id];
+	switch(n->kind){
+		case N_INT:genInt(t,n->i);break;
+		case N_REAL:genReal(t,n->r);break;
+		case N_STR:
+			Text_putc(t,'"');
+			Text_putn(t,tkInput+n->pos,n->len);
+			Text_putc(t,'"');
+			break;
+		case N_VAR:Text_id(t,n->name);break;
+		case N_CALL:
+			Text_id(t,n->name);
+			Text_putc(t,'(');
+			for(int a=n->a;a;a=nodes[a].next){
+				genExpr(t,a);
+				if(nodes[a].next)Text_putc(t,',');
+				}
+			Text_putc(t,')');
+			break;
+		case N_NEG:Text_putc(t,'-');genExpr(t,n->a);break;
+		case N_NOT:Text_putc(t,'!');genExpr(t,n->a);break;
+		case N_PAREN:
+			Text_putc(t,'(');
+			genExpr(t,n->a);
+			Text_putc(t,')');
+			break;
+		case N_BIN:
+			genExpr(t,n->a);
+			Text_puts(t,opText(n->op));
+			genExpr(t,n->b);
+			break;
+		case N_ASSIGN:
+			Text_id(t,n->name);
+			Text_putc(t,'=');
+			genExpr(t,n->a);
+			break;
+		// the inlined code is parenthesized, because its operands can have any priority
+		case N_COND:
+			Text_putc(t,'(');
+			genExpr(t,n->a);
+			Text_putc(t,'?');
+			genExpr(t,n->b);
+			Text_putc(t,':');
+			genExpr(t,n->c);
+			Text_putc(t,')');
+			break;
+		case N_SEQ:
+			Text_putc(t,'(');
+			genExpr(t,n->a);
+			Text_putc(t,',');
+			genExpr(t,n->b);
+			Text_putc(t,')');
+			break;
+		default:
+			printf("wrong expression node: %d\n",n->kind);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+static void genVarDef(Text *t,const Node *n){
+	Text_puts(t,cType(n->type));
+	Text_putc(t,' ');
+	Text_id(t,n->name);
+	Text_lit(t,";\n");
+	}
+
+static void genInstrs(Text *t,int id);
+
+static const Node *crtFnNode;		// the function whose code is generated
+
+// the expression id reads or assigns the local variable or argument name
+static bool usesName(int id,const char *name){
+	const Node *n=&nodes[id];
+	switch(n->kind){
+		case N_INT:case N_REAL:case N_STR:return false;
+		case N_VAR:return n->local&&n->name==name;
+		case N_CALL:
+			for(int a=n->a;a;a=nodes[a].next)if(usesName(a,name))return true;
+			return false;
+		case N_ASSIGN:if(n->local&&n->name==name)return true;
+		// fallthrough
+		default:
+			return (n->a&&usesName(n->a,name))||(n->b&&usesName(n->b,name))||(n->c&&usesName(n->c,name));
+		}
+	}
+
+// the temporary of a parameter in a tail call: the parameter name prefixed with enough '_' to be a new name
+static void genParamTmp(Text *t,const char *param){
+	static Text name;
+	for(int k=1;;k++){
+		Text_clear(&name);
+		for(int i=0;i<k;i++)Text_putc(&name,'_');
+		Text_id(&name,param);
+		if(!findAtom(name.buf,name.n))break;
+		}
+	Text_putn(t,name.buf,name.n);
+	}
+
+// return f(args) in f: the arguments are evaluated in order and assigned to the parameters, then
+// it jumps to the start of f. An argument is kept in a temporary only if its parameter is used by the next arguments.
+static void genTailCall(Text *t,int id){
+	const Node *call=&nodes[tailCall(id)];
+	Text_lit(t,"{\n");
+	int p=crtFnNode->a;
+	for(int a=call->a;a;a=nodes[a].next,p=nodes[p].next){
+		const char *param=nodes[p].name;
+		int e=a;
+		while(nodes[e].kind==N_PAREN)e=nodes[e].a;
+		if(nodes[e].kind==N_VAR&&nodes[e].local&&nodes[e].name==param)continue;
+		bool usedLater=false;
+		for(int b=nodes[a].next;b&&!usedLater;b=nodes[b].next)usedLater=usesName(b,param);
+		if(usedLater){
+			Text_puts(t,cType(nodes[p].type));
+			Text_putc(t,' ');
+			genParamTmp(t,param);
+			}
+		else Text_id(t,param);
+		Text_putc(t,'=');
+		genExpr(t,a);
+		Text_lit(t,";\n");
+		}
+	p=crtFnNode->a;
+	for(int a=call->a;a;a=nodes[a].next,p=nodes[p].next){
+		const char *param=nodes[p].name;
+		bool usedLater=false;
+		for(int b=nodes[a].next;b&&!usedLater;b=nodes[b].next)usedLater=usesName(b,param);
+		if(!usedLater)continue;
+		Text_id(t,param);
+		Text_putc(t,'=');
+		genParamTmp(t,param);
+		Text_lit(t,";\n");
+		}
+	Text_lit(t,"goto start;\n}\n");
+	}
+
+static void genInstr(Text *t,int id){
+	const Node *n=&nodes[id];
+	switch(n->kind){
+		case N_EXPR:
+			genExpr(t,n->a);
+			Text_lit(t,";\n");
+			break;
+		case N_EMPTY:Text_lit(t,";\n");break;
+		case N_IF:
+			Text_lit(t,"if(");
+			genExpr(t,n->a);
+			Text_lit(t,"){\n");
+			genInstrs(t,n->b);
+			Text_lit(t,"}\n");
+			if(n->c){
+				Text_lit(t,"else{\n");
+				genInstrs(t,n->c);
+				Text_lit(t,"}\n");
+				}
+			break;
+		case N_WHILE:
+			Text_lit(t,"while(");
+			genExpr(t,n->a);
+			Text_lit(t,"){\n");
+			genInstrs(t,n->b);
+			Text_lit(t,"}\n");
+			break;
+		case N_RETURN:
+			if(tailCall(id)){
+				genTailCall(t,id);
+				break;
+				}
+			Text_lit(t,"return ");
+			genExpr(t,n->a);
+			Text_lit(t,";\n");
+			break;
+		case N_BLOCK:
+			Text_lit(t,"{\n");
+			for(int v=n->a;v;v=nodes[v].next)genVarDef(t,&nodes[v]);
+			genInstrs(t,n->b);
+			Text_lit(t,"}\n");
+			break;
+		default:
+			printf("wrong instruction node: %d\n",n->kind);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+static void genInstrs(Text *t,int id){
+	for(;id;id=nodes[id].next)genInstr(t,id);
+	}
+
+static void genFn(Text *t,const Node *fn){
+	Text_putc(t,'\n');
+	Text_puts(t,cType(fn->type));
+	Text_putc(t,' ');
+	Text_id(t,fn->name);
+	Text_putc(t,'(');
+	for(int a=fn->a;a;a=nodes[a].next){
+		Text_puts(t,cType(nodes[a].type));
+		Text_putc(t,' ');
+		Text_id(t,nodes[a].name);
+		if(nodes[a].next)Text_putc(t,',');
+		}
+	Text_lit(t,"){\n");
+	for(int v=fn->b;v;v=nodes[v].next)genVarDef(t,&nodes[v]);
+	crtFnNode=fn;
+	// the target of the tail calls
+	if(hasTailCall(fn->c))Text_lit(t,"start:;\n");
+	genInstrs(t,fn->c);
+	Text_lit(t,"}\n");
+	}
+
+void genItem(int id){
+	const Node *n=&nodes[id];
+	switch(n->kind){
+		case N_VARDEF:genVarDef(&tBegin,n);break;
+		case N_FN:genFn(&tFunctions,n);break;
+		default:genInstrs(&tMain,id);
+		}
+	}
+
+// The C code generated from the IR (see ir.h): each value is a temporary variable declared at the start,
+// the blocks are labels and the branches are gotos. The phis are copied through a second variable,
+// assigned at the end of each predecessor, so the phis of a block do not overwrite each other.
+// The temporaries are named _t<value> and _p<value>, with more '_' if such a name is already used in Quick.
+static int tmpLen;		// the nr of '_' at the start of the temporaries
+static int labelBase;		// the global code is in a single C function, so its labels must be different in each item
+
+static void genTmp(Text *t,char kind,int v){
+	Text_putn(t,"________",tmpLen);
+	Text_putc(t,kind);
+	Text_int(t,v);
+	}
+
+// a value has a temporary if it is computed in a block and it is used
+static bool hasTmp(int v){
+	return !isInline(v)&&insts[v].type&&irUses[v];
+	}
+
+static void chooseTmpPrefix(){
+	for(tmpLen=1;tmpLen<8;tmpLen++){
+		bool clash=false;
+		char name[32];
+		memset(name,'_',tmpLen);
+		for(int v=1;v<nInsts&&!clash;v++){
+			if(!hasTmp(v))continue;
+			char *p=name+sizeof(name);
+			for(unsigned u=v;u;u/=10)*--p='0'+u%10;
+			*--p='t';
+			memmove(name+tmpLen,p,name+sizeof(name)-p);
+			size_t n=tmpLen+(name+sizeof(name)-p);
+			clash=findAtom(name,n)!=NULL;
+			name[tmpLen]='p';
+			clash=clash||findAtom(name,n)!=NULL;
+			}
+		if(!clash)return;
+		}
+	err("cannot find names for the temporary variables");
+	}
+
+static void genValue(Text *t,int v){
+	const Inst *in=&insts[v];
+	switch(in->op){
+		case I_INT:genInt(t,in->i);break;
+		case I_REAL:genReal(t,in->r);break;
+		case I_STR:
+			Text_putc(t,'"');
+			Text_putn(t,tkInput+in->pos,in->len);
+			Text_putc(t,'"');
+			break;
+		case I_ARG:Text_id(t,in->name);break;
+		case I_UNDEF:Text_putc(t,'0');break;
+		default:genTmp(t,'t',v);
+		}
+	}
+
+static void genDecls(Text *t){
+	static const int types[]={TYPE_INT,TYPE_REAL,TYPE_STR};
+	for(int k=0;k<3;k++){
+		bool any=false;
+		for(int v=1;v<nInsts;v++){
+			if(!hasTmp(v)||insts[v].type!=types[k])continue;
+			if(!any){
+				Text_puts(t,cType(types[k]));
+				Text_putc(t,' ');
+				any=true;
+				}
+			else Text_putc(t,',');
+			genTmp(t,'t',v);
+			if(insts[v].op==I_PHI){
+				Text_putc(t,',');
+				genTmp(t,'p',v);
+				}
+			}
+		if(any)Text_lit(t,";\n");
+		}
+	}
+
+static bool hasPhis(int b){
+	int first=blocks[b].first;
+	return first&&insts[first].op==I_PHI;
+	}
+
+// the jump from the block "from" to "to", with the copies for the phis of "to"
+// if the jump is not needed, because "to" is the next block, fallThrough is true
+static void genEdge(Text *t,int from,int to,bool fallThrough){
+	const Block *b=&blocks[to];
+	int k=b->preds[0]==from?0:1;
+	for(int i=b->first;i&&insts[i].op==I_PHI;i=insts[i].next){
+		genTmp(t,'p',i);
+		Text_putc(t,'=');
+		genValue(t,k?insts[i].b:insts[i].a);
+		Text_lit(t,";\n");
+		}
+	if(!fallThrough){
+		Text_lit(t,"goto L");
+		Text_int(t,labelBase+to);
+		Text_lit(t,";\n");
+		}
+	}
+
+static void genInst(Text *t,int i){
+	const Inst *in=&insts[i];
+	// the calls are also generated when their value is not used, and then they are not assigned
+	// (the predefined functions are void in C)
+	if(hasTmp(i)){
+		genTmp(t,'t',i);
+		Text_putc(t,'=');
+		}
+	switch(in->op){
+		case I_PHI:genTmp(t,'p',i);break;
+		case I_LOAD:Text_id(t,in->name);break;
+		case I_STORE:
+			Text_id(t,in->name);
+			Text_putc(t,'=');
+			genValue(t,in->a);
+			break;
+		case I_BIN:
+			genValue(t,in->a);
+			Text_puts(t,opText(in->bin));
+			genValue(t,in->b);
+			break;
+		case I_NEG:Text_putc(t,'-');genValue(t,in->a);break;
+		case I_NOT:Text_putc(t,'!');genValue(t,in->a);break;
+		case I_CALL:
+			Text_id(t,in->name);
+			Text_putc(t,'(');
+			for(int k=0;k<in->b;k++){
+				if(k)Text_putc(t,',');
+				genValue(t,irArgs[in->a+k]);
+				}
+			Text_putc(t,')');
+			break;
+		case I_RET:
+			Text_lit(t,"return ");
+			genValue(t,in->a);
+			break;
+		default:
+			printf("wrong IR instruction: %d\n",in->op);
+			exit(EXIT_FAILURE);
+		}
+	Text_lit(t,";\n");
+	}
+
+static void genBlocks(Text *t){
+	chooseTmpPrefix();
+	genDecls(t);
+	// a block needs a label if it is reached by a goto
+	bool *labeled=(bool*)safeAlloc(nBlocks*sizeof(bool));
+	memset(labeled,0,nBlocks*sizeof(bool));
+	for(int b=0;b<nBlocks;b++){
+		const Block *bl=&blocks[b];
+		if(!bl->last)continue;
+		int op=insts[bl->last].op;
+		if(op==I_JMP&&bl->succ[0]!=b+1)labeled[bl->succ[0]]=true;
+		if(op==I_BR){
+			if(bl->succ[0]!=b+1||hasPhis(bl->succ[0]))labeled[bl->succ[0]]=true;
+			if(bl->succ[1]!=b+1)labeled[bl->succ[1]]=true;
+			}
+		}
+	for(int b=0;b<nBlocks;b++){
+		const Block *bl=&blocks[b];
+		if(labeled[b]){
+			Text_putc(t,'L');
+			Text_int(t,labelBase+b);
+			Text_lit(t,":;\n");
+			}
+		for(int i=bl->first;i;i=insts[i].next){
+			const Inst *in=&insts[i];
+			switch(in->op){
+				case I_JMP:genEdge(t,b,bl->succ[0],bl->succ[0]==b+1);break;
+				case I_BR:
+					if(bl->succ[0]==b+1&&!hasPhis(bl->succ[0])){
+						// the usual if and while: the true branch is the next block
+						Text_lit(t,"if(!");
+						genValue(t,in->a);
+						Text_lit(t,"){\n");
+						genEdge(t,b,bl->succ[1],false);
+						Text_lit(t,"}\n");
+						break;
+						}
+					Text_lit(t,"if(");
+					genValue(t,in->a);
+					Text_lit(t,"){\n");
+					genEdge(t,b,bl->succ[0],false);
+					Text_lit(t,"}\n");
+					genEdge(t,b,bl->succ[1],bl->succ[1]==b+1);
+					break;
+				default:genInst(t,i);
+				}
+			}
+		}
+	free(labeled);
+	labelBase+=nBlocks;
+	}
+
+void genIrItem(int id){
+	const Node *n=&nodes[id];
+	if(n->kind!=N_FN){
+		// the temporaries of each global instruction are local to its own C block
+		Text_lit(&tMain,"{\n");
+		genBlocks(&tMain);
+		Text_lit(&tMain,"}\n");
+		return;
+		}
+	Text *t=&tFunctions;
+	Text_putc(t,'\n');
+	Text_puts(t,cType(n->type));
+	Text_putc(t,' ');
+	Text_id(t,n->name);
+	Text_putc(t,'(');
+	for(int a=n->a;a;a=nodes[a].next){
+		Text_puts(t,cType(nodes[a].type));
+		Text_putc(t,' ');
+		Text_id(t,nodes[a].name);
+		if(nodes[a].next)Text_putc(t,',');
+		}
+	Text_lit(t,"){\n");
+	genBlocks(t);
+	Text_lit(t,"}\n");
+	}
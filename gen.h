@@ -4,27 +4,71 @@
 
 // A simple implementation of a dynamic buffer in which chars are written.
 // As chars are written, the buffer will grow.
+// The buffers are allocated in the code generator arena and their capacity grows geometrically,
+// so writing a program is linear in its size. The chars are always followed by \0.
 typedef struct{
 	char *buf;		// buffer
 	size_t n;		// nr de caractere din buf
+	size_t cap;		// nr of allocated chars
 	}Text;
 
+// Makes room for at least n more chars and the final \0.
+void Text_grow(Text *text,size_t n);
+
 // Same as printf, but the chars are written in the "text" buffer, not on screen.
+// It is slower than the specialized functions below, so it should be used only for complex formats.
 void Text_write(Text *text,const char *fmt,...);
 
-// Deletes the chars from a buffer
+// Writes n chars from s
+static inline void Text_putn(Text *text,const char *s,size_t n){
+	if(text->n+n>=text->cap)Text_grow(text,n);
+	char *p=text->buf+text->n;
+	for(size_t i=0;i<n;i++)p[i]=s[i];
+	p[n]='\0';
+	text->n+=n;
+	}
+
+// Writes a single char
+static inline void Text_putc(Text *text,char c){
+	if(text->n+1>=text->cap)Text_grow(text,1);
+	text->buf[text->n++]=c;
+	text->buf[text->n]='\0';
+	}
+
+// Writes a string literal; the length is computed at compile time.
+#define Text_lit(text,s)		Text_putn((text),"" s,sizeof(s)-1)
+
+// Writes a \0 terminated string
+void Text_puts(Text *text,const char *s);
+
+// Writes an identifier, which must be an atom (see intern()), so its length is already known.
+void Text_id(Text *text,const char *atom);
+
+// Same as Text_write(text,"%d",i)
+void Text_int(Text *text,int i);
+
+// Same as Text_write(text,"%g",r), but with more digits if needed to keep the exact value,
+// and with ".0" added to the integer values, so they remain reals in C
+void Text_real(Text *text,double r);
+
+// Deletes the chars after the first n
+void Text_truncate(Text *text,size_t n);
+
+// Deletes the chars from a buffer, but keeps its memory for the next writes
 void Text_clear(Text *text);
 
 extern Text tBegin	// for header file and global variabiles
 	,tMain		// the Quick global code, which will be considered as the body of the C main function
 	,tFunctions	// the functions from Quick
-	,tFnHeader	// used temporarily at the function header generation
 	;
 
-// these pointers will point to different buffers
-// depending on the current domain (in a function or global)
-extern Text *crtCode;		// if in a function, it points to tFunctions, else to tMain
-extern Text *crtVar;		// if in a function, it points to tFunctions, else to tBegin
+// Generates the C code of a top-level item from its AST (see ast.h):
+// a global variable in tBegin, a function in tFunctions and a list of instructions in tMain.
+void genItem(int id);
+
+// Same as genItem for a function or for global instructions, but the instructions are generated
+// from the optimized IR of the item (see ir.h), which must be already built.
+void genIrItem(int id);
 
 // returns the C name for a Quick type (ex: TYPE_REAL -> double)
 // type = TYPE_*
@@ -0,0 +1,403 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ast.h"
+#include "atoms.h"
+#include "inliner.h"
+#include "lexer.h"
+#include "utils.h"
+
+int inlineBudget;
+int inlineDepth = 2;
+static InlineStats stats;
+static Arena inlineArena = ARENA("inliner");
+
+// a function which can be inlined
+typedef struct{
+    const char *name;
+    int nParams;
+    const char **params;
+    const char **globals;   // the global variables and functions used by the body
+    int nGlobals;
+    int root;               // the expression of the body, in bodies
+    int size;               // the nr of nodes of the expression
+}Inlinable;
+
+// the expressions of the inlinable functions, with the same format as the AST, but kept for all the program
+static Node *bodies;
+static int nBodies, capBodies;
+static Inlinable *fns;
+static int nFns, capFns;
+static int *table;          // the index+1 of each function in fns, by name
+static int capTable;
+
+static void *grow(void *p, int *cap, int n, size_t size) {
+    if (n < *cap) return p;
+    int newCap = *cap ? *cap * 2 : 64;
+    while (newCap <= n) newCap *= 2;
+    p = arenaGrow(&inlineArena, p, *cap * size, newCap * size);
+    *cap = newCap;
+    return p;
+}
+
+static size_t slotOf(const char *name) {
+    return (size_t)(((uintptr_t)name >> 3) * 0x9E3779B97F4A7C15ull >> 32) & (capTable - 1);
+}
+
+static const Inlinable *findFn(const char *name) {
+    if (!capTable) return NULL;
+    for (size_t h = slotOf(name); table[h]; h = (h + 1) & (capTable - 1)) {
+        if (fns[table[h] - 1].name == name) return &fns[table[h] - 1];
+    }
+    return NULL;
+}
+
+static void addToTable(int fn) {
+    if (2 * (nFns + 1) > capTable) {
+        int oldCap = capTable;
+        int *old = table;
+        capTable = capTable ? capTable * 2 : 256;
+        table = (int *)arenaAlloc(&inlineArena, capTable * sizeof(int));
+        memset(table, 0, capTable * sizeof(int));
+        for (int k = 0; k < oldCap; k++) {
+            if (!old[k]) continue;
+            size_t h = slotOf(fns[old[k] - 1].name);
+            while (table[h]) h = (h + 1) & (capTable - 1);
+            table[h] = old[k];
+        }
+    }
+    size_t h = slotOf(fns[fn].name);
+    while (table[h]) h = (h + 1) & (capTable - 1);
+    table[h] = fn + 1;
+}
+
+void resetInliner(void) {
+    arenaFree(&inlineArena);
+    bodies = NULL;
+    nBodies = capBodies = 0;
+    fns = NULL;
+    nFns = capFns = 0;
+    table = NULL;
+    capTable = 0;
+}
+
+// The conversion of a function body to an expression.
+
+static Inlinable crt;       // the function being converted
+static int fnType;
+static bool ok;             // the body can still be converted
+
+static int paramIndex(const Inlinable *f, const char *name) {
+    for (int i = 0; i < f->nParams; i++) {
+        if (f->params[i] == name) return i;
+    }
+    return -1;
+}
+
+static int storeNode(const Node *n) {
+    if (!nBodies) nBodies = 1;      // the index 0 means "no node"
+    bodies = (Node *)grow(bodies, &capBodies, nBodies, sizeof(Node));
+    bodies[nBodies] = *n;
+    bodies[nBodies].next = 0;
+    return nBodies++;
+}
+
+static void addGlobal(const char *name) {
+    for (int i = 0; i < crt.nGlobals; i++) {
+        if (crt.globals[i] == name) return;
+    }
+    crt.globals = (const char **)arenaGrow(&inlineArena, crt.globals, crt.nGlobals * sizeof(const char *),
+        (crt.nGlobals + 1) * sizeof(const char *));
+    crt.globals[crt.nGlobals++] = name;
+}
+
+static int copyExpr(int id) {
+    if (!ok) return 0;
+    Node n = nodes[id];
+    switch (n.kind) {
+        case N_INT: case N_REAL: case N_STR:
+            break;
+        case N_VAR:
+            // the local variables are never assigned, so they cannot be used
+            if (n.local && paramIndex(&crt, n.name) < 0) ok = false;
+            if (!n.local) addGlobal(n.name);
+            break;
+        case N_CALL: {
+            addGlobal(n.name);
+            int first = 0, last = 0;
+            for (int a = n.a; a && ok; a = nodes[a].next) {
+                int k = copyExpr(a);
+                if (last) bodies[last].next = k;
+                else first = k;
+                last = k;
+            }
+            n.a = first;
+            break;
+        }
+        case N_NEG: case N_NOT: case N_PAREN:
+            n.a = copyExpr(n.a);
+            break;
+        case N_BIN: case N_SEQ:
+            n.a = copyExpr(n.a);
+            n.b = copyExpr(n.b);
+            break;
+        case N_COND:
+            n.a = copyExpr(n.a);
+            n.b = copyExpr(n.b);
+            n.c = copyExpr(n.c);
+            break;
+        default:
+            ok = false;     // the assignments
+    }
+    return ok ? storeNode(&n) : 0;
+}
+
+// converts a list of instructions, which must return on all paths
+static int convertList(int id) {
+    while (id && nodes[id].kind == N_EMPTY) id = nodes[id].next;
+    if (!id || !ok) {
+        ok = false;
+        return 0;
+    }
+    const Node *n = &nodes[id];
+    if (n->kind == N_RETURN) return copyExpr(n->a);     // the instructions after it are not reachable
+    if (n->kind != N_IF) {
+        ok = false;
+        return 0;
+    }
+    Node cond = *n;
+    cond.kind = N_COND;
+    cond.type = fnType;
+    cond.a = copyExpr(n->a);
+    cond.b = convertList(n->b);
+    // without else, the instructions after if are executed when the condition is false
+    cond.c = convertList(n->c ? n->c : n->next);
+    return ok ? storeNode(&cond) : 0;
+}
+
+void addInlinable(int id) {
+    if (!inlineBudget) return;
+    const Node *fn = &nodes[id];
+    memset(&crt, 0, sizeof(crt));
+    crt.name = fn->name;
+    for (int a = fn->a; a; a = nodes[a].next) crt.nParams++;
+    crt.params = (const char **)arenaAlloc(&inlineArena, crt.nParams * sizeof(const char *));
+    int i = 0;
+    for (int a = fn->a; a; a = nodes[a].next) crt.params[i++] = nodes[a].name;
+    fnType = fn->type;
+    ok = true;
+    int start = nBodies ? nBodies : 1;
+    crt.root = convertList(fn->c);
+    crt.size = nBodies - start;
+    if (!ok || crt.size > inlineBudget) {
+        nBodies = start;
+        return;
+    }
+    fns = (Inlinable *)grow(fns, &capFns, nFns, sizeof(Inlinable));
+    fns[nFns] = crt;
+    addToTable(nFns++);
+    stats.candidates++;
+}
+
+// The inlining in an item.
+
+static int crtItem;             // the root of the item
+static bool inFn;               // the item is a function
+static int tempsFirst, tempsLast;       // the new local variables
+static int grown;               // the nodes added to the item
+static int *argNodes;           // for each parameter of the inlined function: the node which replaces it
+static int capArgNodes;
+static int nTemps;              // for the names of the new local variables
+
+// a function can use a global name which in the current function is a local variable or an argument
+static bool hidesGlobal(const Inlinable *f) {
+    if (!inFn) return false;
+    const Node *fn = &nodes[crtItem];
+    for (int k = 0; k < f->nGlobals; k++) {
+        for (int a = fn->a; a; a = nodes[a].next) {
+            if (nodes[a].name == f->globals[k]) return true;
+        }
+        for (int v = fn->b; v; v = nodes[v].next) {
+            if (nodes[v].name == f->globals[k]) return true;
+        }
+    }
+    return false;
+}
+
+// an expression made only of constants, which is computed by the constant folding
+static bool isConstant(int id) {
+    const Node *n = &nodes[id];
+    switch (n->kind) {
+        case N_INT: case N_REAL: case N_STR: return true;
+        case N_NEG: case N_NOT: case N_PAREN: return isConstant(n->a);
+        case N_BIN: return n->op != AND && n->op != OR && isConstant(n->a) && isConstant(n->b);
+        default: return false;
+    }
+}
+
+// the argument has no effects and it cannot be changed by the inlined code, so it can be copied for each parameter use
+static bool isTrivial(int id) {
+    return isConstant(id) || (nodes[id].kind == N_VAR && nodes[id].local);
+}
+
+// a new local variable, with a name which is not used in the program
+static const char *newTemp(int type, int line) {
+    char name[32];
+    int n;
+    do {
+        n = snprintf(name, sizeof(name), "_in%d", ++nTemps);
+    } while (findAtom(name, n));
+    const char *atom = intern(name, n);
+    int v = newNode(N_VARDEF, line);
+    nodes[v].name = atom;
+    nodes[v].type = type;
+    nodes[v].local = true;
+    appendNode(&tempsFirst, &tempsLast, v);
+    return atom;
+}
+
+// copies a trivial argument
+static int copyTree(int id) {
+    Node n = nodes[id];
+    if (n.kind == N_NEG || n.kind == N_NOT || n.kind == N_PAREN || n.kind == N_BIN) {
+        n.a = copyTree(n.a);
+        if (n.kind == N_BIN) n.b = copyTree(n.b);
+    }
+    int copy = newNode(n.kind, n.line);
+    nodes[copy] = n;
+    nodes[copy].next = 0;
+    return copy;
+}
+
+static int cloneList(const Inlinable *f, int k);
+
+static int cloneNode(const Inlinable *f, int k) {
+    Node src = bodies[k];
+    if (src.kind == N_VAR && src.local) {
+        return copyTree(argNodes[paramIndex(f, src.name)]);
+    }
+    src.a = cloneList(f, src.a);
+    src.b = cloneList(f, src.b);
+    src.c = cloneList(f, src.c);
+    int id = newNode(src.kind, src.line);
+    nodes[id] = src;
+    return id;
+}
+
+static int cloneList(const Inlinable *f, int k) {
+    int first = 0, last = 0;
+    for (; k; k = bodies[k].next) {
+        int id = cloneNode(f, k);
+        appendNode(&first, &last, id);
+    }
+    return first;
+}
+
+// returns the inlined code which replaces the call, or 0 if the call remains
+static int expand(int call, int depth) {
+    const Inlinable *f = findFn(nodes[call].name);
+    if (!f) return 0;
+    // each item can grow with several inlined functions, but not without a limit
+    if (depth >= inlineDepth || grown + f->size > 8 * inlineBudget || hidesGlobal(f)) {
+        stats.rejected++;
+        return 0;
+    }
+    argNodes = (int *)grow(argNodes, &capArgNodes, f->nParams, sizeof(int));
+    int line = nodes[call].line, type = nodes[call].type;
+    int result = 0, lastSeq = 0, k = 0;
+    for (int a = nodes[call].a, next; a; a = next, k++) {
+        next = nodes[a].next;
+        nodes[a].next = 0;
+        if (isTrivial(a)) {
+            argNodes[k] = a;
+            continue;
+        }
+        // (tmp=arg, ...): the argument is evaluated once, before the body
+        const char *tmp = newTemp(nodes[a].type, line);
+        int assign = newNode(N_ASSIGN, line);
+        nodes[assign].name = tmp;
+        nodes[assign].type = nodes[a].type;
+        nodes[assign].local = true;
+        nodes[assign].a = a;
+        int var = newNode(N_VAR, line);
+        nodes[var].name = tmp;
+        nodes[var].type = nodes[a].type;
+        nodes[var].local = true;
+        argNodes[k] = var;
+        int seq = newNode(N_SEQ, line);
+        nodes[seq].type = type;
+        nodes[seq].a = assign;
+        if (lastSeq) nodes[lastSeq].b = seq;
+        else result = seq;
+        lastSeq = seq;
+    }
+    // the body is parenthesized, so its operators remain grouped in any place
+    int body = cloneNode(f, f->root);
+    int paren = newNode(N_PAREN, line);
+    nodes[paren].type = type;
+    nodes[paren].a = body;
+    if (lastSeq) nodes[lastSeq].b = paren;
+    else result = paren;
+    grown += f->size;
+    stats.inlined++;
+    stats.nodes += f->size;
+    return result;
+}
+
+static int *field(int id, int f) {
+    return f == 0 ? &nodes[id].a : f == 1 ? &nodes[id].b : &nodes[id].c;
+}
+
+// inlines the calls from the subtree id and returns its new root
+// the lists are walked by index, because the nodes array can move when nodes are added
+static int inlineNode(int id, int depth) {
+    for (int f = 0; f < 3; f++) {
+        int prev = 0;
+        for (int child = *field(id, f), next; child; child = next) {
+            next = nodes[child].next;
+            int r = inlineNode(child, depth);
+            if (r != child) {
+                nodes[r].next = next;
+                if (prev) nodes[prev].next = r;
+                else *field(id, f) = r;
+            }
+            prev = r;
+        }
+    }
+    if (nodes[id].kind != N_CALL) return id;
+    int r = expand(id, depth);
+    // the inlined code can contain calls which can be inlined too
+    return r ? inlineNode(r, depth + 1) : id;
+}
+
+int inlineCalls(int id) {
+    if (!inlineBudget || !nFns || nodes[id].kind == N_VARDEF) return id;
+    crtItem = id;
+    inFn = nodes[id].kind == N_FN;
+    tempsFirst = tempsLast = 0;
+    grown = 0;
+    inlineNode(id, 0);
+    if (!tempsFirst) return id;
+    if (inFn) {
+        // the new variables are added after the other local variables
+        int last = nodes[id].b;
+        while (last && nodes[last].next) last = nodes[last].next;
+        if (last) nodes[last].next = tempsFirst;
+        else nodes[id].b = tempsFirst;
+        return id;
+    }
+    int block = newNode(N_BLOCK, nodes[id].line);
+    nodes[block].a = tempsFirst;
+    nodes[block].b = id;
+    return block;
+}
+
+InlineStats inlineStats(void) {
+    return stats;
+}
+
+void showInlineStats(void) {
+    printf("Inliner: %d inlinable functions, %d calls inlined (%d nodes), %d calls not inlined because of the limits\n",
+        stats.candidates, stats.inlined, stats.nodes, stats.rejected);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Inlining of the small Quick functions, done on the AST (see ast.h) when inlineBudget>0.
+// A function can be inlined if its body is made only of if and return instructions, without assignments
+// and without local variables, so it is equivalent to a single expression: if(a) return b; ... return c;
+// becomes a ? b : c. The expression is kept after the function is compiled and its calls from the
+// next items are replaced with a copy of it, in which the parameters are replaced with the arguments.
+// The arguments which are not constant expressions or local variables are first assigned to new local variables,
+// so they are evaluated only once and before the body, like for a call.
+extern int inlineBudget;        // the max size (in AST nodes) of an inlined function; 0 disables the inlining
+extern int inlineDepth;         // how many times the inlined code can be inlined again, which limits the recursion
+
+// deletes the inlinable functions, before a new program is compiled
+void resetInliner(void);
+
+// inlines the calls from the item id and returns the new root of the item
+// for global instructions which need new local variables, the root becomes an N_BLOCK
+int inlineCalls(int id);
+
+// keeps the function id if it can be inlined
+void addInlinable(int id);
+
+typedef struct{
+    int candidates;     // the functions which can be inlined
+    int inlined;        // the inlined calls
+    int nodes;          // the AST nodes added by inlining
+    int rejected;       // the calls not inlined because of the budget, the depth or a name conflict
+}InlineStats;
+
+InlineStats inlineStats(void);
+void showInlineStats(void);
@@ -0,0 +1,1018 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ast.h"
+#include "ir.h"
+#include "lexer.h"
+#include "utils.h"
+
+Inst *insts;
+int nInsts;
+int *irArgs;
+int *irUses;
+Block *blocks;
+int nBlocks;
+FILE *irDump;
+static int capInsts, nIrArgs, capIrArgs, capBlocks;
+static Arena irArena = ARENA("ir");
+static IrStats stats;
+static double passTimes[P_COUNT];
+static const char *passNames[P_COUNT] = {"build", "copyprop", "dominators", "licm", "cse", "dse", "emit"};
+
+// a while loop: its blocks are [header,end) and pre is the only block before the loop which jumps to header
+typedef struct{
+    int header, end, pre;
+}Loop;
+
+static Loop *loops;         // in the order in which they end, so the inner loops are before the outer ones
+static int nLoops, capLoops;
+
+// the build state
+static const char **vars;       // the names of the local variables and arguments
+static unsigned char *varTypes;
+static int nVars;
+static int cur;                 // the current block, -1 after a return
+static int undefs[TYPE_STR + 1];        // the I_UNDEF value of each type
+static int *consts;             // a hash table with the int and real constants, so equal constants are the same value
+static int capConsts;
+static ArenaMark itemMark;      // the state of the arena before the current item
+static int fnStart;             // the block after the arguments, which is the target of the tail calls
+static int *tailEnds;           // the blocks which end with a tail call
+static int nTailEnds, capTailEnds;
+
+double passStart(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void passEnd(int pass, double start) {
+    passTimes[pass] += passStart() - start;
+}
+
+int resolve(int v) {
+    while (insts[v].forward) v = insts[v].forward;
+    return v;
+}
+
+bool isInline(int v) {
+    return insts[v].op <= I_UNDEF;
+}
+
+static int newInst(int op, int type) {
+    if (nInsts >= capInsts) {
+        int newCap = capInsts ? capInsts * 2 : 1024;
+        insts = (Inst *)arenaGrow(&irArena, insts, capInsts * sizeof(Inst), newCap * sizeof(Inst));
+        capInsts = newCap;
+    }
+    Inst *i = &insts[nInsts];
+    memset(i, 0, sizeof(Inst));
+    i->op = op;
+    i->type = type;
+    i->block = -1;
+    return nInsts++;
+}
+
+// adds a new instruction at the end of the current block
+static int append(int op, int type) {
+    int id = newInst(op, type);
+    Block *b = &blocks[cur];
+    insts[id].block = cur;
+    if (b->last) insts[b->last].next = id;
+    else b->first = id;
+    b->last = id;
+    stats.built++;
+    return id;
+}
+
+static int newBlock(void) {
+    if (nBlocks >= capBlocks) {
+        int newCap = capBlocks ? capBlocks * 2 : 64;
+        blocks = (Block *)arenaGrow(&irArena, blocks, capBlocks * sizeof(Block), newCap * sizeof(Block));
+        capBlocks = newCap;
+    }
+    Block *b = &blocks[nBlocks];
+    memset(b, 0, sizeof(Block));
+    b->succ[0] = b->succ[1] = -1;
+    b->idom = -1;
+    b->defs = (int *)arenaAlloc(&irArena, nVars * sizeof(int));
+    memset(b->defs, 0, nVars * sizeof(int));
+    return nBlocks++;
+}
+
+static void addPred(int b, int pred) {
+    Block *bl = &blocks[b];
+    if (bl->nPreds == 2) err("internal error: block %d has more than 2 predecessors", b);
+    bl->preds[bl->nPreds++] = pred;
+}
+
+// ends the current block with a terminator
+// a successor can be -1 if it is not created yet, and it is set later
+static void terminate(int op, int a, int succ0, int succ1) {
+    insts[append(op, 0)].a = a;
+    blocks[cur].succ[0] = succ0;
+    blocks[cur].succ[1] = succ1;
+}
+
+static int constant(int op, int type, int i, double r) {
+    if (2 * nInsts >= capConsts) {
+        // the table is rebuilt when there is a risk to become half full
+        int newCap = capConsts ? capConsts * 2 : 256;
+        while (newCap <= 2 * nInsts) newCap *= 2;
+        int *table = (int *)arenaAlloc(&irArena, newCap * sizeof(int));
+        memset(table, 0, newCap * sizeof(int));
+        for (int k = 0; k < capConsts; k++) {
+            int c = consts[k];
+            if (!c) continue;
+            uint64_t bits = insts[c].op == I_INT ? (uint64_t)(unsigned)insts[c].i : 0;
+            if (insts[c].op == I_REAL) memcpy(&bits, &insts[c].r, sizeof(bits));
+            size_t h = (size_t)((bits ^ insts[c].op) * 0x9E3779B97F4A7C15ull >> 32) & (newCap - 1);
+            while (table[h]) h = (h + 1) & (newCap - 1);
+            table[h] = c;
+        }
+        consts = table;
+        capConsts = newCap;
+    }
+    uint64_t bits = op == I_INT ? (uint64_t)(unsigned)i : 0;
+    if (op == I_REAL) memcpy(&bits, &r, sizeof(bits));
+    size_t h = (size_t)((bits ^ op) * 0x9E3779B97F4A7C15ull >> 32) & (capConsts - 1);
+    for (int c; (c = consts[h]); h = (h + 1) & (capConsts - 1)) {
+        // the reals are compared by bits, so 0.0 and -0.0 remain different
+        if (insts[c].op == op && (op == I_INT ? insts[c].i == i : !memcmp(&insts[c].r, &r, sizeof(r)))) return c;
+    }
+    int c = newInst(op, type);
+    if (op == I_INT) insts[c].i = i;
+    else insts[c].r = r;
+    consts[h] = c;
+    return c;
+}
+
+static int constInt(int i) {
+    return constant(I_INT, TYPE_INT, i, 0);
+}
+
+static int undef(int type) {
+    if (!undefs[type]) undefs[type] = newInst(I_UNDEF, type);
+    return undefs[type];
+}
+
+static int varIndex(const Node *n) {
+    if (!n->local) return -1;
+    for (int i = 0; i < nVars; i++) {
+        if (vars[i] == n->name) return i;
+    }
+    return -1;
+}
+
+// SSA construction without a dominance frontier (Braun et al., "Simple and Efficient Construction of SSA Form"):
+// each block knows the current value of the variables assigned in it, and a read in a block without
+// an assignment asks its predecessors. A loop header is sealed only after the whole loop was built,
+// so the reads in the loop create incomplete phis in it, which are completed when it is sealed.
+
+// creates a phi at the start of the block b; the phis are before the other instructions
+static int newPhi(int b, int type) {
+    int id = newInst(I_PHI, type);
+    Block *bl = &blocks[b];
+    insts[id].block = b;
+    insts[id].next = bl->first;
+    bl->first = id;
+    if (!bl->last) bl->last = id;
+    stats.built++;
+    return id;
+}
+
+static int readVar(int v, int b);
+
+static void addPhiOperands(int phi, int v, int b) {
+    int a = readVar(v, blocks[b].preds[0]);
+    insts[phi].a = a;
+    if (blocks[b].nPreds == 2) {
+        int op = readVar(v, blocks[b].preds[1]);
+        insts[phi].b = op;
+    }
+}
+
+static int readVar(int v, int b) {
+    int val = blocks[b].defs[v];
+    if (val) return val;
+    if (!blocks[b].sealed) {
+        val = newPhi(b, varTypes[v]);
+        insts[val].i = v + 1;       // incomplete
+    } else if (!blocks[b].nPreds) {
+        val = undef(varTypes[v]);
+    } else if (blocks[b].nPreds == 1) {
+        val = readVar(v, blocks[b].preds[0]);
+    } else {
+        val = newPhi(b, varTypes[v]);
+        blocks[b].defs[v] = val;    // breaks the cycles through the loops
+        addPhiOperands(val, v, b);
+    }
+    blocks[b].defs[v] = val;
+    return val;
+}
+
+static void seal(int b) {
+    for (int i = blocks[b].first; i && insts[i].op == I_PHI; i = insts[i].next) {
+        if (insts[i].i) {
+            addPhiOperands(i, insts[i].i - 1, b);
+            insts[i].i = 0;
+        }
+    }
+    blocks[b].sealed = true;
+}
+
+// a new block whose predecessors are all known
+static int newSealedBlock(int pred) {
+    int b = newBlock();
+    addPred(b, pred);
+    blocks[b].sealed = true;
+    return b;
+}
+
+static int lowerExpr(int id);
+
+// a&&b and a||b: b is evaluated in its own block and the result is a phi of the two paths
+static int lowerLogic(int id) {
+    const Node *n = &nodes[id];
+    bool isAnd = n->op == AND;
+    int left = lowerExpr(n->a);
+    int from = cur;
+    int right = newSealedBlock(from);
+    terminate(I_BR, left, isAnd ? right : -1, isAnd ? -1 : right);
+    cur = right;
+    int value = lowerExpr(n->b);
+    int zero = nodes[n->b].type == TYPE_REAL ? constant(I_REAL, TYPE_REAL, 0, 0) : constInt(0);
+    int isTrue = append(I_BIN, TYPE_INT);
+    insts[isTrue].bin = NOTEQ;
+    insts[isTrue].a = value;
+    insts[isTrue].b = zero;
+    int rightEnd = cur;
+    int merge = newBlock();
+    terminate(I_JMP, 0, merge, -1);
+    blocks[from].succ[isAnd ? 1 : 0] = merge;
+    addPred(merge, from);
+    addPred(merge, rightEnd);
+    blocks[merge].sealed = true;
+    int phi = newPhi(merge, TYPE_INT);
+    int shortCircuit = constInt(!isAnd);
+    insts[phi].a = shortCircuit;
+    insts[phi].b = isTrue;
+    cur = merge;
+    return phi;
+}
+
+// a ? b : c, where b and c are evaluated in their own blocks
+static int lowerCond(int id) {
+    const Node *n = &nodes[id];
+    int cond = lowerExpr(n->a);
+    int from = cur;
+    int thenBlock = newSealedBlock(from);
+    terminate(I_BR, cond, thenBlock, -1);
+    cur = thenBlock;
+    int thenValue = lowerExpr(n->b);
+    int thenEnd = cur;
+    terminate(I_JMP, 0, -1, -1);
+    int elseBlock = newSealedBlock(from);
+    blocks[from].succ[1] = elseBlock;
+    cur = elseBlock;
+    int elseValue = lowerExpr(n->c);
+    int elseEnd = cur;
+    int merge = newBlock();
+    terminate(I_JMP, 0, merge, -1);
+    blocks[thenEnd].succ[0] = merge;
+    addPred(merge, thenEnd);
+    addPred(merge, elseEnd);
+    blocks[merge].sealed = true;
+    int phi = newPhi(merge, n->type);
+    insts[phi].a = thenValue;
+    insts[phi].b = elseValue;
+    cur = merge;
+    return phi;
+}
+
+static int lowerExpr(int id) {
+    const Node *n = &nodes[id];
+    switch (n->kind) {
+        case N_INT: return constInt(n->i);
+        case N_REAL: return constant(I_REAL, TYPE_REAL, 0, n->r);
+        case N_STR: {
+            int s = newInst(I_STR, TYPE_STR);
+            insts[s].pos = n->pos;
+            insts[s].len = n->len;
+            return s;
+        }
+        case N_VAR: {
+            int v = varIndex(n);
+            if (v >= 0) return readVar(v, cur);
+            int load = append(I_LOAD, n->type);
+            insts[load].name = n->name;
+            return load;
+        }
+        case N_CALL: {
+            // the slots of the arguments are reserved before the arguments are lowered, because they can contain calls
+            int nArgs = 0;
+            for (int a = n->a; a; a = nodes[a].next) nArgs++;
+            if (nIrArgs + nArgs > capIrArgs) {
+                int newCap = capIrArgs ? capIrArgs * 2 : 256;
+                while (newCap < nIrArgs + nArgs) newCap *= 2;
+                irArgs = (int *)arenaGrow(&irArena, irArgs, capIrArgs * sizeof(int), newCap * sizeof(int));
+                capIrArgs = newCap;
+            }
+            int first = nIrArgs, k = first;
+            nIrArgs += nArgs;
+            for (int a = n->a; a; a = nodes[a].next) {
+                int value = lowerExpr(a);
+                irArgs[k++] = value;
+            }
+            int call = append(I_CALL, n->type);
+            insts[call].name = n->name;
+            insts[call].a = first;
+            insts[call].b = nArgs;
+            return call;
+        }
+        case N_NEG: case N_NOT: {
+            int a = lowerExpr(n->a);
+            int i = append(n->kind == N_NEG ? I_NEG : I_NOT, n->type);
+            insts[i].a = a;
+            return i;
+        }
+        case N_PAREN:
+            return lowerExpr(n->a);
+        case N_COND:
+            return lowerCond(id);
+        case N_SEQ:
+            lowerExpr(n->a);
+            return lowerExpr(n->b);
+        case N_BIN: {
+            if (n->op == AND || n->op == OR) return lowerLogic(id);
+            int a = lowerExpr(n->a);
+            int b = lowerExpr(n->b);
+            int i = append(I_BIN, n->type);
+            insts[i].bin = n->op;
+            insts[i].a = a;
+            insts[i].b = b;
+            return i;
+        }
+        case N_ASSIGN: {
+            int value = lowerExpr(n->a);
+            int v = varIndex(n);
+            if (v >= 0) {
+                int copy = append(I_COPY, n->type);
+                insts[copy].a = value;
+                blocks[cur].defs[v] = copy;
+                return copy;
+            }
+            int store = append(I_STORE, 0);
+            insts[store].name = n->name;
+            insts[store].a = value;
+            return value;
+        }
+        default:
+            err("internal error: wrong expression node %d in IR", n->kind);
+    }
+}
+
+static void lowerList(int id);
+
+static void lowerIf(const Node *n) {
+    int cond = lowerExpr(n->a);
+    int from = cur;
+    int thenBlock = newSealedBlock(from);
+    terminate(I_BR, cond, thenBlock, -1);
+    cur = thenBlock;
+    lowerList(n->b);
+    int thenEnd = cur, elseEnd = from;
+    if (n->c) {
+        int elseBlock = newSealedBlock(from);
+        blocks[from].succ[1] = elseBlock;
+        cur = elseBlock;
+        lowerList(n->c);
+        elseEnd = cur;
+    }
+    if (thenEnd < 0 && elseEnd < 0) return;     // both branches return
+    int merge = newBlock();
+    if (thenEnd >= 0) {
+        cur = thenEnd;
+        terminate(I_JMP, 0, merge, -1);
+        addPred(merge, thenEnd);
+    }
+    if (!n->c) {
+        blocks[from].succ[1] = merge;
+        addPred(merge, from);
+    } else if (elseEnd >= 0) {
+        cur = elseEnd;
+        terminate(I_JMP, 0, merge, -1);
+        addPred(merge, elseEnd);
+    }
+    seal(merge);
+    cur = merge;
+}
+
+static void lowerWhile(const Node *n) {
+    // the current block becomes the preheader, the place of the instructions moved out of the loop
+    int pre = cur;
+    int header = newBlock();
+    terminate(I_JMP, 0, header, -1);
+    addPred(header, pre);
+    cur = header;
+    int cond = lowerExpr(n->a);
+    int condEnd = cur;
+    int body = newSealedBlock(condEnd);
+    terminate(I_BR, cond, body, -1);
+    cur = body;
+    lowerList(n->b);
+    if (cur >= 0) {
+        terminate(I_JMP, 0, header, -1);
+        addPred(header, cur);
+    }
+    seal(header);
+    int exit = newSealedBlock(condEnd);
+    blocks[condEnd].succ[1] = exit;
+    if (nLoops >= capLoops) {
+        int newCap = capLoops ? capLoops * 2 : 16;
+        loops = (Loop *)arenaGrow(&irArena, loops, capLoops * sizeof(Loop), newCap * sizeof(Loop));
+        capLoops = newCap;
+    }
+    loops[nLoops++] = (Loop){header, exit, pre};
+    cur = exit;
+}
+
+// return f(args) in f: the arguments become the new values of the parameters, which are the first
+// variables, and the block jumps to fnStart; the jump is completed by joinTailCalls
+static void lowerTailCall(int id) {
+    const Node *call = &nodes[tailCall(id)];
+    int nArgs = 0;
+    for (int a = call->a; a; a = nodes[a].next) nArgs++;
+    int *values = (int *)arenaAlloc(&irArena, nArgs * sizeof(int));
+    int i = 0;
+    for (int a = call->a; a; a = nodes[a].next) values[i++] = lowerExpr(a);
+    for (i = 0; i < nArgs; i++) blocks[cur].defs[i] = values[i];
+    terminate(I_JMP, 0, fnStart, -1);
+    if (nTailEnds >= capTailEnds) {
+        int newCap = capTailEnds ? capTailEnds * 2 : 16;
+        tailEnds = (int *)arenaGrow(&irArena, tailEnds, capTailEnds * sizeof(int), newCap * sizeof(int));
+        capTailEnds = newCap;
+    }
+    tailEnds[nTailEnds++] = cur;
+    cur = -1;
+}
+
+// a block has at most 2 predecessors, so the tail calls are joined in pairs by new blocks,
+// and only the last one jumps to fnStart; the new blocks are after the tail calls, so the
+// jump to fnStart is the only back edge, like at the end of a while loop
+static void joinTailCalls(void) {
+    int last = tailEnds[0];
+    for (int k = 1; k < nTailEnds; k++) {
+        int join = newBlock();
+        addPred(join, last);
+        addPred(join, tailEnds[k]);
+        blocks[last].succ[0] = join;
+        blocks[tailEnds[k]].succ[0] = join;
+        seal(join);
+        cur = join;
+        terminate(I_JMP, 0, fnStart, -1);
+        last = join;
+    }
+    addPred(fnStart, last);
+    seal(fnStart);
+}
+
+// the instructions after a return are not reachable, so they are not lowered
+static void lowerList(int id) {
+    for (; id && cur >= 0; id = nodes[id].next) {
+        const Node *n = &nodes[id];
+        switch (n->kind) {
+            case N_EXPR: lowerExpr(n->a); break;
+            case N_EMPTY: break;
+            case N_IF: lowerIf(n); break;
+            case N_WHILE: lowerWhile(n); break;
+            case N_RETURN: {
+                if (tailCall(id)) {
+                    lowerTailCall(id);
+                    break;
+                }
+                int a = lowerExpr(n->a);
+                terminate(I_RET, a, -1, -1);
+                cur = -1;
+                break;
+            }
+            default:
+                err("internal error: wrong instruction node %d in IR", n->kind);
+        }
+    }
+}
+
+void buildIr(int id) {
+    double t0 = passStart();
+    itemMark = arenaMark(&irArena);
+    newInst(I_UNDEF, 0);        // the index 0 means "no value", and it is never replaced
+    const Node *n = &nodes[id];
+    nVars = 0;
+    if (n->kind == N_FN) {
+        for (int a = n->a; a; a = nodes[a].next) nVars++;
+        for (int v = n->b; v; v = nodes[v].next) nVars++;
+    } else if (n->kind == N_BLOCK) {
+        for (int v = n->a; v; v = nodes[v].next) nVars++;
+    }
+    vars = (const char **)arenaAlloc(&irArena, nVars * sizeof(const char *));
+    varTypes = (unsigned char *)arenaAlloc(&irArena, nVars);
+    cur = newBlock();
+    blocks[cur].sealed = true;
+    if (n->kind == N_FN) {
+        int i = 0;
+        for (int a = n->a; a; a = nodes[a].next, i++) {
+            vars[i] = nodes[a].name;
+            varTypes[i] = nodes[a].type;
+            int arg = newInst(I_ARG, nodes[a].type);
+            insts[arg].name = nodes[a].name;
+            blocks[cur].defs[i] = arg;
+        }
+        for (int v = n->b; v; v = nodes[v].next, i++) {
+            vars[i] = nodes[v].name;
+            varTypes[i] = nodes[v].type;
+        }
+        nTailEnds = 0;
+        fnStart = 0;
+        if (hasTailCall(n->c)) {
+            // fnStart is sealed after all the tail calls are known
+            fnStart = newBlock();
+            terminate(I_JMP, 0, fnStart, -1);
+            addPred(fnStart, cur);
+            cur = fnStart;
+        }
+        lowerList(n->c);
+        // the tail calls can all be unreachable (after a return), then fnStart has only its entry
+        if (nTailEnds) joinTailCalls();
+        else if (fnStart) seal(fnStart);
+    } else if (n->kind == N_BLOCK) {
+        int i = 0;
+        for (int v = n->a; v; v = nodes[v].next, i++) {
+            vars[i] = nodes[v].name;
+            varTypes[i] = nodes[v].type;
+        }
+        lowerList(n->b);
+    } else {
+        lowerList(id);
+    }
+    passEnd(P_BUILD, t0);
+}
+
+// calls f for each operand of the instruction i which is a value
+#define FOR_OPERANDS(i, f) do{ \
+        Inst *in_ = &insts[i]; \
+        switch (in_->op) { \
+            case I_CALL: for (int k_ = 0; k_ < in_->b; k_++) f(irArgs[in_->a + k_]); break; \
+            case I_BIN: case I_PHI: f(in_->a); if (in_->b) f(in_->b); break; \
+            case I_STORE: case I_NEG: case I_NOT: case I_COPY: case I_BR: case I_RET: f(in_->a); break; \
+            default: break; \
+        } \
+    }while(0)
+
+#define RESOLVE(v)  ((v) = resolve(v))
+
+// removes the dead instructions from the lists of the blocks and replaces the operands with their final values
+static void sweep(void) {
+    for (int b = 0; b < nBlocks; b++) {
+        int *link = &blocks[b].first, last = 0;
+        while (*link) {
+            int i = *link;
+            if (insts[i].dead) {
+                *link = insts[i].next;
+                continue;
+            }
+            FOR_OPERANDS(i, RESOLVE);
+            last = i;
+            link = &insts[i].next;
+        }
+        blocks[b].last = last;
+    }
+}
+
+static void replace(int i, int value) {
+    insts[i].forward = value;
+    insts[i].dead = true;
+}
+
+// removes the copies and the phis whose operands are all the same value or the phi itself
+// removing a phi can make other phis trivial, so it repeats until nothing changes
+static void copyPropagation(void) {
+    double t0 = passStart();
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 0; b < nBlocks; b++) {
+            for (int i = blocks[b].first; i; i = insts[i].next) {
+                Inst *in = &insts[i];
+                if (in->dead) continue;
+                if (in->op == I_COPY) {
+                    replace(i, resolve(in->a));
+                    stats.copies++;
+                } else if (in->op == I_PHI) {
+                    int same = 0;
+                    bool trivial = true;
+                    for (int k = 0; k < blocks[b].nPreds; k++) {
+                        int op = resolve(k ? in->b : in->a);
+                        if (op == i || op == same) continue;
+                        if (same) {
+                            trivial = false;
+                            break;
+                        }
+                        same = op;
+                    }
+                    if (trivial) {
+                        replace(i, same ? same : undef(in->type));
+                        stats.copies++;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+    sweep();
+    passEnd(P_COPYPROP, t0);
+}
+
+// The blocks are created in the code order, so each block is after all its predecessors,
+// except the loop headers, which are also reached from the end of their loop.
+// A loop header is dominated by the block before the loop, so its back edge can be ignored
+// and the immediate dominators are found in a single pass (Cooper, Harvey and Kennedy),
+// with the block indexes used as the order of the dominator tree.
+static int intersect(int a, int b) {
+    while (a != b) {
+        while (a > b) a = blocks[a].idom;
+        while (b > a) b = blocks[b].idom;
+    }
+    return a;
+}
+
+static void dominators(void) {
+    double t0 = passStart();
+    for (int b = 1; b < nBlocks; b++) {
+        int idom = -1;
+        for (int k = 0; k < blocks[b].nPreds; k++) {
+            int p = blocks[b].preds[k];
+            if (p >= b) continue;      // a back edge
+            idom = idom < 0 ? p : intersect(idom, p);
+        }
+        blocks[b].idom = idom;
+    }
+    passEnd(P_DOMINATORS, t0);
+}
+
+static bool dominates(int a, int b) {
+    while (b > a) b = blocks[b].idom;
+    return a == b;
+}
+
+static bool isCommutative(int bin) {
+    return bin == ADD || bin == MUL || bin == EQUAL || bin == NOTEQ;
+}
+
+// the operands in the order used to compare the expressions
+static void cseKey(const Inst *in, int *a, int *b) {
+    *a = in->a;
+    *b = in->b;
+    if (in->op == I_BIN && isCommutative(in->bin) && *a > *b) {
+        int t = *a;
+        *a = *b;
+        *b = t;
+    }
+}
+
+static uint32_t cseHash(const Inst *in) {
+    int a, b;
+    cseKey(in, &a, &b);
+    uint32_t h = in->op * 31u + in->bin;
+    h = h * 0x9E3779B1u + (uint32_t)a;
+    h = h * 0x9E3779B1u + (uint32_t)b;
+    return h ^ h >> 15;
+}
+
+static bool sameExpr(const Inst *x, const Inst *y) {
+    int xa, xb, ya, yb;
+    cseKey(x, &xa, &xb);
+    cseKey(y, &ya, &yb);
+    return x->op == y->op && x->bin == y->bin && x->type == y->type && xa == ya && xb == yb;
+}
+
+// replaces an operation with an equal one which dominates it
+// the blocks are visited in the order of the dominator tree, so the dominating instruction is seen first
+static void cse(void) {
+    double t0 = passStart();
+    ArenaMark mark = arenaMark(&irArena);
+    int cap = 64;
+    while (cap < 2 * nInsts) cap *= 2;
+    int *table = (int *)arenaAlloc(&irArena, cap * sizeof(int));
+    memset(table, 0, cap * sizeof(int));
+    for (int b = 0; b < nBlocks; b++) {
+        for (int i = blocks[b].first; i; i = insts[i].next) {
+            Inst *in = &insts[i];
+            if (in->op != I_BIN && in->op != I_NEG && in->op != I_NOT) continue;
+            RESOLVE(in->a);
+            RESOLVE(in->b);
+            size_t h = cseHash(in) & (cap - 1);
+            int found = 0;
+            for (int e; (e = table[h]); h = (h + 1) & (cap - 1)) {
+                if (sameExpr(&insts[e], in) && dominates(insts[e].block, b)) {
+                    found = e;
+                    break;
+                }
+            }
+            if (found) {
+                replace(i, found);
+                stats.cse++;
+            } else {
+                table[h] = i;
+            }
+        }
+    }
+    arenaRelease(&irArena, mark);
+    sweep();
+    passEnd(P_CSE, t0);
+}
+
+// the instruction gives the same result and has no effects if it is executed before the loop,
+// even if the loop would not execute it (an int division can trap, so its divisor must be a safe constant)
+static bool canHoist(const Inst *in, bool loopHasCalls, const char **stored, int nStored) {
+    switch (in->op) {
+        case I_NEG: case I_NOT:
+            return true;
+        case I_BIN:
+            if (in->bin != DIV || in->type == TYPE_REAL) return true;
+            return insts[in->b].op == I_INT && insts[in->b].i != 0 && insts[in->b].i != -1;
+        case I_LOAD:
+            if (loopHasCalls) return false;
+            for (int k = 0; k < nStored; k++) {
+                if (stored[k] == in->name) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool inLoop(int v, const Loop *loop) {
+    int b = insts[v].block;
+    return b >= loop->header && b < loop->end;
+}
+
+static bool isInvariant(int i, const Loop *loop) {
+    const Inst *in = &insts[i];
+    if (in->a && inLoop(in->a, loop)) return false;
+    if (in->op == I_BIN && inLoop(in->b, loop)) return false;
+    return true;
+}
+
+// moves the loop invariant instructions to the end of the preheader, before its jump to the loop
+// the inner loops are processed first, so an instruction can move out of several nested loops
+static void licm(void) {
+    double t0 = passStart();
+    for (int l = 0; l < nLoops; l++) {
+        const Loop *loop = &loops[l];
+        ArenaMark mark = arenaMark(&irArena);
+        bool hasCalls = false;
+        const char **stored = NULL;
+        int nStored = 0;
+        for (int b = loop->header; b < loop->end; b++) {
+            for (int i = blocks[b].first; i; i = insts[i].next) {
+                if (insts[i].op == I_CALL) hasCalls = true;
+                if (insts[i].op == I_STORE) {
+                    stored = (const char **)arenaGrow(&irArena, stored, nStored * sizeof(const char *), (nStored + 1) * sizeof(const char *));
+                    stored[nStored++] = insts[i].name;
+                }
+            }
+        }
+        Block *pre = &blocks[loop->pre];
+        int beforeJmp = 0;
+        for (int i = pre->first; i != pre->last; i = insts[i].next) beforeJmp = i;
+        // the blocks are in the dominator order, so the operands of an instruction are checked before it
+        for (int b = loop->header; b < loop->end; b++) {
+            int *link = &blocks[b].first, last = 0;
+            while (*link) {
+                int i = *link;
+                if (!canHoist(&insts[i], hasCalls, stored, nStored) || !isInvariant(i, loop)) {
+                    last = i;
+                    link = &insts[i].next;
+                    continue;
+                }
+                *link = insts[i].next;
+                insts[i].block = loop->pre;
+                insts[i].next = pre->last;
+                if (beforeJmp) insts[beforeJmp].next = i;
+                else pre->first = i;
+                beforeJmp = i;
+                stats.hoisted++;
+            }
+            blocks[b].last = last;
+        }
+        arenaRelease(&irArena, mark);
+    }
+    passEnd(P_LICM, t0);
+}
+
+static void countUse(int v) {
+    irUses[v]++;
+}
+
+// the instructions which are kept even if their value is not used
+static bool hasEffects(int op) {
+    return op == I_STORE || op == I_CALL || op >= I_JMP;
+}
+
+static bool *live;
+static int *liveStack;
+static int nLive;
+
+static void markLive(int v) {
+    if (!live[v]) {
+        live[v] = true;
+        liveStack[nLive++] = v;
+    }
+}
+
+// removes the stores to global variables which are overwritten in the same block before any read
+// (a load or a call), then the instructions whose values are not used by any instruction with effects
+static void dse(void) {
+    double t0 = passStart();
+    for (int b = 0; b < nBlocks; b++) {
+        for (int i = blocks[b].first; i; i = insts[i].next) {
+            if (insts[i].op != I_STORE) continue;
+            for (int j = insts[i].next; j; j = insts[j].next) {
+                const Inst *in = &insts[j];
+                if (in->op == I_CALL || (in->op == I_LOAD && in->name == insts[i].name)) break;
+                if (in->op == I_STORE && in->name == insts[i].name) {
+                    insts[i].dead = true;
+                    stats.deadStores++;
+                    break;
+                }
+            }
+        }
+    }
+    // the live values are found from the instructions with effects, so the unused cycles of phis are also removed
+    ArenaMark mark = arenaMark(&irArena);
+    live = (bool *)arenaAlloc(&irArena, nInsts * sizeof(bool));
+    memset(live, 0, nInsts * sizeof(bool));
+    liveStack = (int *)arenaAlloc(&irArena, nInsts * sizeof(int));
+    nLive = 0;
+    for (int b = 0; b < nBlocks; b++) {
+        for (int i = blocks[b].first; i; i = insts[i].next) {
+            if (!insts[i].dead && hasEffects(insts[i].op)) markLive(i);
+        }
+    }
+    while (nLive) {
+        int v = liveStack[--nLive];
+        FOR_OPERANDS(v, markLive);
+    }
+    for (int b = 0; b < nBlocks; b++) {
+        for (int i = blocks[b].first; i; i = insts[i].next) {
+            if (!live[i] && !insts[i].dead) {
+                insts[i].dead = true;
+                stats.deadValues++;
+            }
+        }
+    }
+    arenaRelease(&irArena, mark);
+    sweep();
+    passEnd(P_DSE, t0);
+}
+
+void optimizeIr(void) {
+    copyPropagation();
+    dominators();
+    // the invariants are moved first, so the equal ones from different loops are together in a preheader
+    licm();
+    cse();
+    dse();
+    // the uses are needed by the code generator
+    irUses = (int *)arenaAlloc(&irArena, nInsts * sizeof(int));
+    memset(irUses, 0, nInsts * sizeof(int));
+    for (int b = 0; b < nBlocks; b++) {
+        for (int i = blocks[b].first; i; i = insts[i].next) FOR_OPERANDS(i, countUse);
+    }
+}
+
+void resetIr(void) {
+    // all the memory of the IR is used only by the current item
+    arenaRelease(&irArena, itemMark);
+    insts = NULL;
+    nInsts = capInsts = 0;
+    blocks = NULL;
+    nBlocks = capBlocks = 0;
+    irArgs = NULL;
+    nIrArgs = capIrArgs = 0;
+    loops = NULL;
+    nLoops = capLoops = 0;
+    tailEnds = NULL;
+    nTailEnds = capTailEnds = 0;
+    consts = NULL;
+    capConsts = 0;
+    irUses = NULL;
+    memset(undefs, 0, sizeof(undefs));
+}
+
+static const char *typeName(int type) {
+    switch (type) {
+        case TYPE_INT: return "int";
+        case TYPE_REAL: return "real";
+        case TYPE_STR: return "str";
+        default: return "?";
+    }
+}
+
+static void dumpValue(FILE *fis, int v) {
+    const Inst *in = &insts[v];
+    switch (in->op) {
+        case I_INT: fprintf(fis, "%d", in->i); break;
+        case I_REAL: fprintf(fis, "%g", in->r); break;
+        case I_STR: fprintf(fis, "\"%.*s\"", (int)in->len, tkInput + in->pos); break;
+        case I_ARG: fputs(in->name, fis); break;
+        case I_UNDEF: fputs("undef", fis); break;
+        default: fprintf(fis, "%%%d", v);
+    }
+}
+
+static void dumpInst(FILE *fis, int i) {
+    const Inst *in = &insts[i];
+    fputs("    ", fis);
+    if (in->type && in->op != I_STORE) fprintf(fis, "%%%d = %s ", i, typeName(in->type));
+    switch (in->op) {
+        case I_LOAD: fprintf(fis, "load %s", in->name); break;
+        case I_STORE: fprintf(fis, "store %s, ", in->name); dumpValue(fis, in->a); break;
+        case I_BIN:
+            dumpValue(fis, in->a);
+            fprintf(fis, " %s ", opText(in->bin));
+            dumpValue(fis, in->b);
+            break;
+        case I_NEG: fputc('-', fis); dumpValue(fis, in->a); break;
+        case I_NOT: fputc('!', fis); dumpValue(fis, in->a); break;
+        case I_CALL:
+            fprintf(fis, "call %s(", in->name);
+            for (int k = 0; k < in->b; k++) {
+                if (k) fputs(", ", fis);
+                dumpValue(fis, irArgs[in->a + k]);
+            }
+            fputc(')', fis);
+            break;
+        case I_PHI: {
+            const Block *b = &blocks[in->block];
+            fputs("phi", fis);
+            for (int k = 0; k < b->nPreds; k++) {
+                fputs(k ? ", [" : " [", fis);
+                dumpValue(fis, k ? in->b : in->a);
+                fprintf(fis, ", b%d]", b->preds[k]);
+            }
+            break;
+        }
+        case I_COPY: dumpValue(fis, in->a); break;
+        case I_JMP: fprintf(fis, "jmp b%d", blocks[in->block].succ[0]); break;
+        case I_BR:
+            fputs("br ", fis);
+            dumpValue(fis, in->a);
+            fprintf(fis, ", b%d, b%d", blocks[in->block].succ[0], blocks[in->block].succ[1]);
+            break;
+        case I_RET: fputs("ret ", fis); dumpValue(fis, in->a); break;
+        default: fprintf(fis, "?%d", in->op);
+    }
+    fputc('\n', fis);
+}
+
+void dumpIr(FILE *fis, int id) {
+    const Node *n = &nodes[id];
+    if (n->kind == N_FN) {
+        fprintf(fis, "fn %s(", n->name);
+        for (int a = n->a; a; a = nodes[a].next) {
+            fprintf(fis, "%s:%s%s", nodes[a].name, typeName(nodes[a].type), nodes[a].next ? ", " : "");
+        }
+        fprintf(fis, "):%s\n", typeName(n->type));
+    } else {
+        fprintf(fis, "main, line %d\n", n->line);
+    }
+    for (int b = 0; b < nBlocks; b++) {
+        const Block *bl = &blocks[b];
+        fprintf(fis, "  b%d:", b);
+        if (bl->nPreds) fputs("\t\t; preds", fis);
+        for (int k = 0; k < bl->nPreds; k++) fprintf(fis, " b%d", bl->preds[k]);
+        fputc('\n', fis);
+        for (int i = bl->first; i; i = insts[i].next) dumpInst(fis, i);
+    }
+    fputc('\n', fis);
+}
+
+IrStats irStats(void) {
+    return stats;
+}
+
+void showPassTimes(void) {
+    double total = 0;
+    for (int p = 0; p < P_COUNT; p++) total += passTimes[p];
+    printf("%-12s %10s %7s\n", "pass", "ms", "%");
+    for (int p = 0; p < P_COUNT; p++) {
+        printf("%-12s %10.3f %7.1f\n", passNames[p], passTimes[p] * 1e3, total ? passTimes[p] * 100 / total : 0);
+    }
+    printf("%-12s %10.3f\n", "total", total * 1e3);
+    printf("IR: %ld instructions built, %ld copies and phis removed, %ld common subexpressions, %ld hoisted out of loops, "
+        "%ld dead values, %ld dead stores\n",
+        stats.built, stats.copies, stats.cse, stats.hoisted, stats.deadValues, stats.deadStores);
+}
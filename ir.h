@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+// The SSA intermediate representation of a top-level item (a function or an instruction of the global code),
+// built from its AST when optLevel>=2 (the -O2 option) and optimized before the C code is generated from it.
+// The instructions and the basic blocks are stored in arrays and they refer to each other by index.
+// Each instruction which has a result is also the SSA value of that result, so an operand is an instruction index.
+// The index 0 of the instructions is not used, so it means "no value".
+// The local variables and arguments exist only during the build: each assignment creates a new value
+// and the reads are replaced with the reaching value or with a phi of the values from the predecessors.
+// The global variables remain in memory, so they are accessed with I_LOAD and I_STORE.
+enum{
+    // the constants and the arguments are not in any block: they are written directly in the operands
+    I_INT, I_REAL, I_STR,
+    I_ARG,          // the initial value of an argument: name
+    I_UNDEF,        // the value of a local variable read before any assignment
+    // the instructions from the blocks
+    I_LOAD,         // name
+    I_STORE,        // name=a
+    I_BIN,          // a op b
+    I_NEG, I_NOT,   // -a, !a
+    I_CALL,         // name(args), with nArgs values from irArgs[a...]
+    I_PHI,          // the value a when the block was entered from preds[0], b from preds[1]
+    I_COPY,         // a; an assignment of a local variable, removed by the copy propagation
+    // the terminators, which are the last instruction of their block
+    I_JMP,          // goto succ[0]
+    I_BR,           // if(a) goto succ[0] else goto succ[1]
+    I_RET,          // return a
+};
+
+typedef struct{
+    unsigned char op;       // I_*
+    unsigned char type;     // TYPE_* of the result, 0 for the instructions without a result
+    unsigned char bin;      // I_BIN: the token code of the operator
+    bool dead:1;            // removed by an optimization
+    int block;              // the block which contains the instruction, -1 for constants and arguments
+    int a, b;               // the operands; I_CALL: the first argument in irArgs and the nr of arguments
+    int next;               // the next instruction in the block
+    int forward;            // if not 0, the instruction was replaced with this value
+    union{
+        int i;              // I_INT; I_PHI: the variable, while the phi is incomplete
+        double r;           // I_REAL
+        const char *name;   // I_ARG, I_LOAD, I_STORE, I_CALL: an atom
+        struct{unsigned pos, len;};     // I_STR: the chars are tkInput[pos,pos+len)
+    };
+}Inst;
+
+typedef struct{
+    int first, last;        // the list of instructions
+    int preds[2];           // the structured code has at most 2 predecessors for each block
+    int nPreds;
+    int succ[2];            // from the terminator
+    int idom;               // the immediate dominator, -1 for the entry block
+    bool sealed;            // all the predecessors are known
+    int *defs;              // during the build: the current value of each local variable, 0 if not assigned
+}Block;
+
+extern Inst *insts;
+extern int nInsts;
+extern int *irArgs;         // the arguments of the calls
+extern int *irUses;         // after optimizeIr: the nr of uses of each value
+extern Block *blocks;       // the block 0 is the entry block, and the blocks are in their code order
+extern int nBlocks;
+
+// builds the IR of a function (N_FN) or of a list of global instructions (see ast.h)
+void buildIr(int id);
+
+// runs the optimization passes: copy propagation, dominators, loop invariant code motion,
+// common subexpressions elimination and dead code and stores elimination
+void optimizeIr(void);
+
+// returns the final value of v, after the replacements done by the optimizations
+int resolve(int v);
+
+// returns true if the instruction is not in a block, so it is written directly in its uses
+bool isInline(int v);
+
+// deletes the IR, after the C code was generated from it
+void resetIr(void);
+
+// writes the IR in a readable format, with one block per paragraph
+void dumpIr(FILE *fis, int id);
+
+extern FILE *irDump;        // if not NULL, the optimized IR of each item is written in it
+
+// the timing of the compilation phases which use the IR
+enum{P_BUILD, P_COPYPROP, P_DOMINATORS, P_LICM, P_CSE, P_DSE, P_EMIT, P_COUNT};
+
+// returns the current time in seconds, used as the start of a pass
+double passStart(void);
+
+// adds the time since start to the pass
+void passEnd(int pass, double start);
+
+typedef struct{
+    long built;         // the instructions created by the build, without the constants
+    long copies;        // the copies and trivial phis removed
+    long cse;           // the common subexpressions removed
+    long hoisted;       // the instructions moved out of loops
+    long deadValues;    // the unused instructions removed
+    long deadStores;    // the stores to global variables overwritten before being read
+}IrStats;
+
+IrStats irStats(void);
+
+// shows the time of each pass and what it has done
+void showPassTimes(void);
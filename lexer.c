@@ -1,140 +1,260 @@
 #include <stdio.h>
-#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <setjmp.h>
 
 #include "lexer.h"
 #include "utils.h"
+#include "atoms.h"
+#include "scan.h"
 
-Token tokens[MAX_TOKENS];
+Token *tokens;
 int nTokens;
-
-int line = 1, column = 1;  // the current line and column in the input file
-int lpara = 0, rpara = 0;
+Arena tokenArena = ARENA("tokens");
+static int capTokens;   // the number of allocated tokens
+const char *tkInput;
+
+// The state of the lexer is per thread, so multiple threads can extract tokens
+// from different parts of the same input (see plexer.h).
+_Thread_local int line = 1;  // the current line in the input file
+static _Thread_local const char *lineStart;   // the first char of the current line
+
+// the column of the char p from the current line, computed only when needed (for error messages)
+#define COLUMN(p) ((int)((p) - lineStart) + 1)
+_Thread_local int lpara = 0, rpara = 0;
+
+static _Thread_local const char *lexPos;   // the position of the lexer in the input
+static _Thread_local bool lexLast;    // false if the input continues after the current chunk
+static _Thread_local Token *crtTk;    // the token which is extracted by nextTk
+static _Thread_local bool tkReady;    // true when crtTk was set
+static _Thread_local const char *tkBegin;     // the first char of the last extracted token
+static _Thread_local jmp_buf *errJump;     // if set, the lexical errors jump here instead of exiting
+
+// Same as err, but if errJump is set, the error is not shown and the execution jumps to errJump
+_Noreturn static void lexErr(const char *fmt, ...) {
+    if (errJump) longjmp(*errJump, 1);
+    fprintf(stderr, "error: ");
+    va_list va;
+    va_start(va, fmt);
+    vfprintf(stderr, fmt, va);
+    va_end(va);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
 
 // Adds a token to the end of the tokens list and returns it
-// Sets its code and line
-Token *addTk(int code) {
-    if (nTokens == MAX_TOKENS) err("Too many tokens");
-    Token *tk = &tokens[nTokens];
-    tk->code = code;
-    tk->line = line;
-    nTokens++;
-    return tk;
+// The list doubles its capacity when it is full
+static Token *newTk(void) {
+    if (nTokens == capTokens) {
+        int newCap = capTokens ? capTokens * 2 : 4096;
+        tokens = (Token *)arenaGrow(&tokenArena, tokens, capTokens * sizeof(Token), newCap * sizeof(Token));
+        capTokens = newCap;
+    }
+    return &tokens[nTokens++];
 }
 
-// Copy in the dst buffer the string between [begin,end)
-char *copyn(char *dst, const char *begin, const char *end) {
-    char *p = dst;
-    if (end - begin > MAX_STR) err("String too long");
-    while (begin != end) *p++ = *begin++;
-    *p = '\0';
-    return dst;
+// Sets the code and line of the token which is extracted by nextTk and returns it
+static Token *addTk(int code) {
+    crtTk->code = code;
+    crtTk->line = line;
+    tkReady = true;
+    return crtTk;
 }
 
-void tokenize(const char *pch) {
+// Sets the slice [begin,end) of the input as the chars of tk
+static void setText(Token *tk, const char *begin, const char *end) {
+    tk->pos = (unsigned)(begin - tkInput);
+    tk->len = (unsigned)(end - begin);
+}
+
+char *tkDupText(const Token *tk) {
+    char *s = (char *)safeAlloc(tk->len + 1);
+    memcpy(s, tkText(tk), tk->len);
+    s[tk->len] = '\0';
+    return s;
+}
+
+// The keywords of Quick
+// To add a new keyword, only a new entry is needed here.
+static const struct {
+    const char *text;
+    int code;
+} keywords[] = {
+    {"var", VAR}, {"function", FUNCTION}, {"if", IF}, {"else", ELSE}, {"while", WHILE},
+    {"end", END}, {"return", RETURN}, {"int", TYPE_INT}, {"real", TYPE_REAL}, {"str", TYPE_STR},
+};
+
+#define KW_SLOTS 64     // power of 2
+// kwSlots[kwHash(text)] is the index+1 in keywords, or 0 for an empty slot
+static unsigned char kwSlots[KW_SLOTS];
+static size_t kwMinLen = (size_t)-1, kwMaxLen;
+
+// A hash which uses only the length, the first and the last char,
+// so it can be computed without scanning the identifier.
+// For the current keywords it is perfect (no collisions).
+static unsigned kwHash(const char *text, size_t len) {
+    return (unsigned)(len + (unsigned char)text[0] + (unsigned char)text[len - 1]) & (KW_SLOTS - 1);
+}
+
+// Fills kwSlots from keywords
+// A C compiler cannot index string literals in constant expressions, so the slots are filled once, at the first use.
+// A collision introduced by a new keyword is reported immediately.
+static void initKeywords(void) {
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        size_t len = strlen(keywords[i].text);
+        unsigned h = kwHash(keywords[i].text, len);
+        if (kwSlots[h]) err("keywords %s and %s have the same hash", keywords[kwSlots[h] - 1].text, keywords[i].text);
+        kwSlots[h] = (unsigned char)(i + 1);
+        if (len < kwMinLen) kwMinLen = len;
+        if (len > kwMaxLen) kwMaxLen = len;
+    }
+}
+
+// Returns the code of the keyword [text,text+len) or ID if it is not a keyword
+static int keywordCode(const char *text, size_t len) {
+    if (len < kwMinLen || len > kwMaxLen) return ID;
+    unsigned slot = kwSlots[kwHash(text, len)];
+    if (!slot) return ID;
+    const char *kw = keywords[slot - 1].text;
+    // strncmp stops at the end of kw, and only if all the len chars match, kw[len] is valid
+    if (strncmp(kw, text, len) || kw[len] != '\0') return ID;
+    return keywords[slot - 1].code;
+}
+
+void startLexer(const char *input) {
+    tkInput = lexPos = input;
+    lexLast = true;
+    line = 1;
+    lineStart = input;
+    lpara = rpara = 0;
+    if (!kwMaxLen) {
+        initKeywords();
+        initScan();
+    }
+}
+
+void continueLexer(const char *chunk, bool last) {
+    lexPos = lineStart = chunk;
+    lexLast = last;
+}
+
+void resumeLexer(const char *pos, int atLine, const char *atLineStart) {
+    lexPos = pos;
+    lexLast = false;
+    line = atLine;
+    lineStart = atLineStart;
+    lpara = rpara = 0;
+}
+
+const char *lastTkBegin(void) {
+    return tkBegin;
+}
+
+void lexerParens(int *nLpar, int *nRpar) {
+    *nLpar = lpara;
+    *nRpar = rpara;
+}
+
+void setLexerErrorJump(jmp_buf *jump) {
+    errJump = jump;
+}
+
+void adoptTokens(Token *tks, int n) {
+    tokens = tks;
+    nTokens = capTokens = n;
+}
+
+int nextTk(Token *tk) {
+    const char *pch = lexPos;
     const char *start;
-    Token *tk;
-    char buf[MAX_STR + 1];
-    
-    while (1) {
+
+    crtTk = tk;
+    tkReady = false;
+    while (!tkReady) {
+        tkBegin = pch;
         switch (*pch) {
             case ' ': 
             case '\t':
-                pch++;
-                column++;  // Increment column for whitespace
+            case '\n':
+                // skips a whole run of whitespace and counts its newlines
+                pch = scan.space(pch, &line, &lineStart);
                 break;
 
             case '\r':
                 if (pch[1] == '\n') pch++;  // Skip the newline on Windows
-                // Fall through to handle newline
-
-            case '\n':
                 line++; 
                 pch++; 
-                column = 1;  // Reset column on new line
+                lineStart = pch;
                 break;
 
             case '\0':
                 addTk(FINISH); 
                 // Check for matching parentheses
-                if (lpara != rpara) {
-                    err("Invalid number of parentheses.");
+                if (lexLast && lpara != rpara) {
+                    lexErr("Invalid number of parentheses.");
                 }
-                return;
+                break;
 
             case ',':
                 addTk(COMMA); 
                 pch++; 
-                column++; 
                 break;
 
             case ':':
                 addTk(COLON); 
                 pch++; 
-                column++; 
                 break;
 
             case ';':
                 addTk(SEMICOLON); 
                 pch++; 
-                column++; 
                 break;
 
             case '(': 
                 addTk(LPAR); 
                 pch++; 
                 lpara++; 
-                column++; 
                 break;
 
             case ')': 
                 addTk(RPAR); 
                 pch++; 
                 rpara++; 
-                column++; 
                 break;
 
             case '+':
                 addTk(ADD); 
                 pch++; 
-                column++; 
                 break;
 
             case '-':
                 addTk(SUB); 
                 pch++; 
-                column++; 
                 break;
 
             case '*':
                 addTk(MUL); 
                 pch++; 
-                column++; 
                 break;
 
             case '/':
                 addTk(DIV); 
                 pch++; 
-                column++; 
                 break;
 
             case '#':  // Handle comment
-                while (*pch != '\n' && *pch != '\0') {
-                    pch++; 
-                    column++; // Increment column in comments
-                }
+                pch = scan.comment(pch);
                 break;
 
             case '=':
                 if (pch[1] == '=') {
                     addTk(EQUAL);
                     pch += 2;
-                    column += 2; // Update column for both characters
                 } else {
                     addTk(ASSIGN);
                     pch++;
-                    column++; 
                 }
                 break;
 
@@ -142,9 +262,8 @@ void tokenize(const char *pch) {
                 if (pch[1] == '&') {
                     addTk(AND);
                     pch += 2;
-                    column += 2; // Update column for both characters
                 } else {
-                    err("Malformed and at line %d, column %d", line, column);
+                    lexErr("Malformed and at line %d, column %d", line, COLUMN(pch));
                 }
                 break;
 
@@ -152,9 +271,8 @@ void tokenize(const char *pch) {
                 if (pch[1] == '|') {
                     addTk(OR);
                     pch += 2;
-                    column += 2; // Update column for both characters
                 } else {
-                    err("Malformed or at line %d, column %d", line, column);
+                    lexErr("Malformed or at line %d, column %d", line, COLUMN(pch));
                 }
                 break;
 
@@ -162,11 +280,9 @@ void tokenize(const char *pch) {
                 if (pch[1] == '=') {
                     addTk(NOTEQ);
                     pch += 2;
-                    column += 2; // Update column for both characters
                 } else {
                     addTk(NOT);
                     pch++;
-                    column++; 
                 }
                 break;
 
@@ -174,11 +290,9 @@ void tokenize(const char *pch) {
                 if (pch[1] == '=') {
                     addTk(LESSEQ);
                     pch += 2;
-                    column += 2; // Update column for both characters
                 } else {
                     addTk(LESS);
                     pch++;
-                    column++; 
                 }
                 break;
 
@@ -186,155 +300,189 @@ void tokenize(const char *pch) {
                 if (pch[1] == '=') {
                     addTk(GREATEREQ);
                     pch += 2;
-                    column += 2; // Update column for both characters
                 } else {
                     addTk(GREATER);
                     pch++;
-                    column++; 
                 }
                 break;
 
             case '"':
                 start = ++pch;  // Skip the opening quote
-                int length = 0;
-                while (*pch != '"' && *pch != '\0') {
-                    if (length >= MAX_STR) {
-                        err("String literal too long at line %d, column %d", line, column);
-                        return;
-                    }
-                    pch++;
-                    length++;
-                    column++; // Increment column for each character in the string
-                }
+                pch = scan.string(pch);
                 if (*pch == '"') {
                     tk = addTk(STR);
-                    copyn(tk->text, start, pch);
+                    setText(tk, start, pch);
                     pch++;
-                    column++; // Increment for the closing quote
                 } else {
-                    err("Unterminated string at line %d", line);
+                    lexErr("Unterminated string at line %d", line);
                 }
                 break;
 
             default:
-                if (isdigit(*pch)) {
+                if (charClass[(unsigned char)*pch] & CC_DIGIT) {
                     start = pch;
-                    int number_of_dots = 0;
-
-                    while (isdigit(*pch)) {
-                        pch++;
-                        column++; // Increment column for each digit
-                    }
+                    pch = scan.digits(pch);
 
                     if (*pch == '.') {
-                        number_of_dots++;
                         pch++;
 
-                        if (!isdigit(*pch)) {
-                            err("Malformed real number at line %d and column %d.", line, column);
-                            return;
+                        if (!(charClass[(unsigned char)*pch] & CC_DIGIT)) {
+                            lexErr("Malformed real number at line %d and column %d.", line, COLUMN(pch));
                         }
 
-                        while (isdigit(*pch)) {
-                            pch++;
-                            column++; // Increment column for each digit after the dot
-                        }
-
-                        // if (!isdigit(*pch)) {
-                        //     tokenize(pch);
-                        //     err("Malformed real number at line %d and column %d", line, column);
-                        //     return;
-                        // }
+                        pch = scan.digits(pch);
 
                         tk = addTk(REAL);
-                        tk->r = atof(copyn(buf, start, pch));
+                        char *endReal;
+                        tk->r = strtod(start, &endReal);
+                        if (endReal != pch) {
+                            // strtod also accepts exponents and hex numbers, so it went past the number
+                            Token slice;
+                            setText(&slice, start, pch);
+                            char *text = tkDupText(&slice);
+                            tk->r = strtod(text, NULL);
+                            free(text);
+                        }
                     } else {
                         tk = addTk(INT);
-                        tk->i = atoi(copyn(buf, start, pch));
+                        unsigned value = 0;
+                        for (const char *p = start; p != pch; p++) value = value * 10 + (unsigned)(*p - '0');
+                        tk->i = (int)value;
                     }
-                } else if (isalpha(*pch) || *pch == '_') {
+                } else if (charClass[(unsigned char)*pch] & CC_ALPHA) {
                     start = pch;
-                    int id_length = 0;
-                    while (isalnum(*pch) || *pch == '_') {
-                        if (id_length >= MAX_STR) {
-                            err("Identifier too long at line %d, column %d", line, column);
-                            return;
-                        }
-                        pch++;
-                        id_length++;
-                        column++; // Increment column for each character in identifier
-                    }
-                    char *text = copyn(buf, start, pch);
-                    
-                    // Check for keywords
-                    if (strcmp(text, "var") == 0) addTk(VAR);
-                    else if (strcmp(text, "function") == 0) addTk(FUNCTION);
-                    else if (strcmp(text, "if") == 0) addTk(IF);
-                    else if (strcmp(text, "else") == 0) addTk(ELSE);
-                    else if (strcmp(text, "while") == 0) addTk(WHILE);
-                    else if (strcmp(text, "end") == 0) addTk(END);
-                    else if (strcmp(text, "return") == 0) addTk(RETURN);
-                    else if (strcmp(text, "int") == 0) addTk(TYPE_INT);
-                    else if (strcmp(text, "real") == 0) addTk(TYPE_REAL);
-                    else if (strcmp(text, "str") == 0) addTk(TYPE_STR);
-                    else {
-                        tk = addTk(ID);
-                        strcpy(tk->text, text);
-                    }
+                    pch = scan.ident(pch + 1);
+                    size_t n = (size_t)(pch - start);
+
+                    int code = keywordCode(start, n);
+                    tk = addTk(code);
+                    if (code == ID) tk->name = intern(start, n);
                 } else {
-                    err("Invalid character: %c (%d)", *pch, *pch);
-                    return;
+                    lexErr("Invalid character: %c (%d)", *pch, *pch);
                 }
                 break;
         }
     }
+    lexPos = pch;
+    return tk->code;
+}
+
+void tokenize(const char *pch) {
+    startLexer(pch);
+    while (nextTk(newTk()) != FINISH) {}
+}
+
+// The token window is a ring buffer with the tokens [tkPos,nFetched).
+// The window grows only if the lookahead does not fit in it.
+static Token *window;
+static int windowSize;      // power of 2
+static int (*tkSource)(Token *tk);     // extracts the next token
+static int nFetched;        // nr of tokens extracted from the input
+static int tkPos;           // the index of the current token
+
+void startTokens(const char *input) {
+    startLexer(input);
+    startTokenSource(nextTk);
+}
+
+void startTokenSource(int (*next)(Token *tk)) {
+    tkSource = next;
+    if (!window) {
+        windowSize = 16;
+        window = (Token *)safeAlloc(windowSize * sizeof(Token));
+    }
+    nFetched = tkPos = 0;
+}
+
+static int iArrayTk;    // the next token from the tokens array
+
+// the token source for startTokensArray
+static int nextArrayTk(Token *tk) {
+    *tk = tokens[iArrayTk];
+    if (iArrayTk < nTokens - 1) iArrayTk++;     // the final FINISH is repeated
+    return tk->code;
+}
+
+void startTokensArray(void) {
+    iArrayTk = 0;
+    startTokenSource(nextArrayTk);
+}
+
+// doubles the window size, keeping each token at its index modulo the window size
+static void growWindow(int windowBase) {
+    int newSize = windowSize * 2;
+    Token *p = (Token *)safeAlloc(newSize * sizeof(Token));
+    for (int i = windowBase; i < nFetched; i++) {
+        p[i & (newSize - 1)] = window[i & (windowSize - 1)];
+    }
+    free(window);
+    window = p;
+    windowSize = newSize;
+}
+
+Token *peekTk(int k) {
+    while (nFetched <= tkPos + k) {
+        if (nFetched - tkPos == windowSize) growWindow(tkPos);
+        tkSource(&window[nFetched & (windowSize - 1)]);
+        nFetched++;
+    }
+    return &window[(tkPos + k) & (windowSize - 1)];
+}
+
+void advanceTk(void) {
+    tkPos++;
+}
+
+int tkWindowSize(void) {
+    return windowSize;
 }
 
 void showTokens() {
     printf("[\n");
     for (int i = 0; i < nTokens; i++) {
         Token *tk = &tokens[i];
-        char tokenType[MAX_STR];
+        const char *tokenType;
+        printf("  { \"line\": %d, \"token\": \"", tk->line);
 
        switch (tk->code) {
-            case FINISH: strcpy(tokenType, "FINISH"); break;
-            case COMMA: strcpy(tokenType, "COMMA"); break;
-            case COLON: strcpy(tokenType, "COLON"); break;
-            case SEMICOLON: strcpy(tokenType, "SEMICOLON"); break;
-            case LPAR: strcpy(tokenType, "LPAR"); break;
-            case RPAR: strcpy(tokenType, "RPAR"); break;
-            case ADD: strcpy(tokenType, "ADD"); break;
-            case SUB: strcpy(tokenType, "SUB"); break;
-            case AND: strcpy(tokenType, "AND"); break;
-            case OR: strcpy(tokenType, "OR"); break;
-            case MUL: strcpy(tokenType, "MUL"); break;
-            case DIV: strcpy(tokenType, "DIV"); break;
-            case EQUAL: strcpy(tokenType, "EQUAL"); break;
-            case ASSIGN: strcpy(tokenType, "ASSIGN"); break;
-            case NOTEQ: strcpy(tokenType, "NOTEQ"); break;
-            case NOT: strcpy(tokenType, "NOT"); break;
-            case LESSEQ: strcpy(tokenType, "LESSEQ"); break;
-            case LESS: strcpy(tokenType, "LESS"); break;
-            case GREATEREQ: strcpy(tokenType, "GREATEREQ"); break;
-            case GREATER: strcpy(tokenType, "GREATER"); break;
-            case STR: sprintf(tokenType, "STR(\"%s\")", tk->text); break;
-            case REAL: sprintf(tokenType, "REAL(%.2f)", tk->r); break;
-            case INT: sprintf(tokenType, "INT(%d)", tk->i); break;
-            case VAR: strcpy(tokenType, "VAR"); break;
-            case FUNCTION: strcpy(tokenType, "FUNCTION"); break;
-            case IF: strcpy(tokenType, "IF"); break;
-            case ELSE: strcpy(tokenType, "ELSE"); break;
-            case WHILE: strcpy(tokenType, "WHILE"); break;
-            case END: strcpy(tokenType, "END"); break;
-            case RETURN: strcpy(tokenType, "RETURN"); break;
-            case TYPE_INT: strcpy(tokenType, "TYPE_INT"); break;
-            case TYPE_REAL: strcpy(tokenType, "TYPE_REAL"); break;
-            case TYPE_STR: strcpy(tokenType, "TYPE_STR"); break;
-            case ID: sprintf(tokenType, "ID(\"%s\")", tk->text); break;
-            default: strcpy(tokenType, "UNKNOWN"); break;
+            case FINISH: tokenType = "FINISH"; break;
+            case COMMA: tokenType = "COMMA"; break;
+            case COLON: tokenType = "COLON"; break;
+            case SEMICOLON: tokenType = "SEMICOLON"; break;
+            case LPAR: tokenType = "LPAR"; break;
+            case RPAR: tokenType = "RPAR"; break;
+            case ADD: tokenType = "ADD"; break;
+            case SUB: tokenType = "SUB"; break;
+            case AND: tokenType = "AND"; break;
+            case OR: tokenType = "OR"; break;
+            case MUL: tokenType = "MUL"; break;
+            case DIV: tokenType = "DIV"; break;
+            case EQUAL: tokenType = "EQUAL"; break;
+            case ASSIGN: tokenType = "ASSIGN"; break;
+            case NOTEQ: tokenType = "NOTEQ"; break;
+            case NOT: tokenType = "NOT"; break;
+            case LESSEQ: tokenType = "LESSEQ"; break;
+            case LESS: tokenType = "LESS"; break;
+            case GREATEREQ: tokenType = "GREATEREQ"; break;
+            case GREATER: tokenType = "GREATER"; break;
+            case STR: printf("STR(\"%.*s\")", (int)tk->len, tkText(tk)); tokenType = ""; break;
+            case REAL: printf("REAL(%.2f)", tk->r); tokenType = ""; break;
+            case INT: printf("INT(%d)", tk->i); tokenType = ""; break;
+            case VAR: tokenType = "VAR"; break;
+            case FUNCTION: tokenType = "FUNCTION"; break;
+            case IF: tokenType = "IF"; break;
+            case ELSE: tokenType = "ELSE"; break;
+            case WHILE: tokenType = "WHILE"; break;
+            case END: tokenType = "END"; break;
+            case RETURN: tokenType = "RETURN"; break;
+            case TYPE_INT: tokenType = "TYPE_INT"; break;
+            case TYPE_REAL: tokenType = "TYPE_REAL"; break;
+            case TYPE_STR: tokenType = "TYPE_STR"; break;
+            case ID: printf("ID(\"%s\")", tk->name); tokenType = ""; break;
+            default: tokenType = "UNKNOWN"; break;
         }
 
-        printf("  { \"line\": %d, \"token\": \"%s\" }", tk->line, tokenType);
+        printf("%s\" }", tokenType);
         if (i < nTokens - 1) printf(",");
         printf("\n");
     }
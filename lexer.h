@@ -1,5 +1,11 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+#include "utils.h"
+
 enum {
     ID,
     TYPE_INT, TYPE_REAL, TYPE_STR,
@@ -9,23 +15,90 @@ enum {
     INT, REAL, STR,
 };
 
-
-#define MAX_STR		127
-
+// A token has 16 bytes, so 4 tokens fit in a cache line.
+// STR does not store its chars: it keeps a slice [pos,pos+len) of the input.
+// ID keeps its name interned in the atoms table, so equal names have equal pointers.
 typedef struct{
 	int code;		// ID, TYPE_INT, ...
 	int line;		// the line from the input file
 	union{
-		char text[MAX_STR+1];		// the chars for ID, STR
+		struct{
+			unsigned pos;		// for STR: the index of the first char in the input
+			unsigned len;		// for STR: the number of chars
+			};
+		const char *name;		// for ID: the interned name
 		int i;		// the value for INT
 		double r;		// the value for REAL
 		};
 	}Token;
 
-#define MAX_TOKENS		4096
-extern Token tokens[];
+extern Token *tokens;		// dynamic array, which grows as tokens are added, allocated in tokenArena
+extern Arena tokenArena;
 extern int nTokens;
+extern const char *tkInput;		// the input from which the tokens were extracted
+
+// returns the first char of a STR (the chars are not followed by '\0')
+static inline const char *tkText(const Token *tk){return tkInput+tk->pos;}
+
+// returns a dynamically allocated copy of the chars of a STR, followed by '\0'
+char *tkDupText(const Token *tk);
+
+// prepares the lexer to extract tokens from the beginning of the input
+void startLexer(const char *input);
+
+// the input continues with a new chunk, which ends with '\0'
+// the chunk must be placed after the previous ones, in the same buffer which starts at tkInput
+// the line numbers continue from the previous chunk
+// last is true if it is the last chunk of the input
+void continueLexer(const char *chunk, bool last);
+
+// continues the extraction from pos, which is the beginning of a token or of a whitespace
+// this is the same as continueLexer, but pos can be anywhere in the input and the line is given
+// the parentheses counters are reset
+void resumeLexer(const char *pos, int atLine, const char *atLineStart);
+
+// returns the first char of the last token extracted by nextTk
+const char *lastTkBegin(void);
 
+// returns the number of '(' and ')' extracted since the last start or resume of the lexer
+void lexerParens(int *nLpar, int *nRpar);
+
+// if jump is not NULL, a lexical error makes a longjmp to it, instead of showing the error and exiting
+// it is set per thread
+void setLexerErrorJump(jmp_buf *jump);
+
+// replaces the tokens array with tks, which was allocated in tokenArena and has n tokens
+void adoptTokens(Token *tks, int n);
+
+// extracts the next token from the input in tk and returns its code
+// at the end of a chunk which is not the last, it returns FINISH, without checking the parentheses
+// after the end of the input, it always returns FINISH
+int nextTk(Token *tk);
+
+// extracts all the tokens from the input in the tokens array
 void tokenize(const char *pch);
 void showTokens();
 
+// The parser does not need all the tokens: it pulls them on demand through a small window.
+// The window keeps only the lookahead tokens, so its size does not depend on the input size.
+// A Token* returned by peekTk is valid only until the next call of peekTk.
+
+// prepares the extraction of the tokens from the input
+void startTokens(const char *input);
+
+// prepares the extraction of the tokens with the function next instead of the lexer
+// next has the same contract as nextTk
+void startTokenSource(int (*next)(Token *tk));
+
+// prepares the extraction of the tokens from the tokens array, filled by tokenize or tokenizeParallel
+void startTokensArray(void);
+
+// returns the k-th token after the current one, extracting it if needed
+// peekTk(0) is the current token
+Token *peekTk(int k);
+
+// moves to the next token
+void advanceTk(void);
+
+// the current size of the window (in tokens)
+int tkWindowSize(void);
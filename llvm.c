@@ -0,0 +1,543 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ast.h"
+#include "lexer.h"
+#include "llvm.h"
+#include "utils.h"
+
+bool llvmMode;
+static Arena llvmArena = ARENA("llvm");
+
+#define TYPE_BOOL -1            // the i1 results of the comparisons, before they become int
+
+static Text mainAllocas, mainBody;      // the local variables and the instructions of main
+static Text chars;                      // the chars of a string constant
+static int nTmps, nLabels, nStrs;
+
+// the code which is generated: a function in tFunctions or the global instructions in mainBody
+static Text *code;
+static Text *allocas;           // where the local variables of the current item are allocated
+static const Node *crtFn;       // NULL for the global instructions
+static int crtLabel;            // the current basic block, -1 for entry
+static bool terminated;         // the current block ends with br or ret, so the next instruction needs a new block
+static int mainLabel;           // crtLabel and terminated of main, kept while the functions are generated
+static bool mainTerminated;
+
+enum{V_TMP, V_INT, V_REAL, V_STR, V_NULL};
+
+typedef struct{
+    int kind;           // V_*
+    int type;           // TYPE_* or TYPE_BOOL
+    int n;              // V_TMP: the temporary %.t<n>; V_INT: the value; V_STR: the constant @.str<n>
+    double r;           // V_REAL
+}Value;
+
+static const char *llType(int type) {
+    switch (type) {
+        case TYPE_BOOL: return "i1";
+        case TYPE_INT: return "i32";
+        case TYPE_REAL: return "double";
+        default: return "ptr";
+    }
+}
+
+static Value zero(int type) {
+    return (Value){type == TYPE_INT ? V_INT : type == TYPE_REAL ? V_REAL : V_NULL, type, 0, 0};
+}
+
+static void blockName(Text *t, int n) {
+    if (n < 0) {
+        Text_lit(t, "entry");
+        return;
+    }
+    Text_lit(t, ".L");
+    Text_int(t, n);
+}
+
+static void startBlock(int n) {
+    blockName(code, n);
+    Text_lit(code, ":\n");
+    crtLabel = n;
+    terminated = false;
+}
+
+// the start of an instruction; the instructions after a terminator (after return) are in a new block,
+// which is not reachable, because LLVM does not allow them in the same block
+static void inst(void) {
+    if (terminated) startBlock(nLabels++);
+    Text_lit(code, "  ");
+}
+
+static void operand(Text *t, Value v) {
+    switch (v.kind) {
+        case V_TMP:
+            Text_lit(t, "%.t");
+            Text_int(t, v.n);
+            break;
+        case V_INT:
+            Text_int(t, v.n);
+            break;
+        case V_REAL: {
+            // the exact bits of the double
+            uint64_t bits;
+            memcpy(&bits, &v.r, sizeof(bits));
+            Text_write(t, "0x%016llX", (unsigned long long)bits);
+            break;
+        }
+        case V_STR:
+            Text_lit(t, "@.str");
+            Text_int(t, v.n);
+            break;
+        default:
+            Text_lit(t, "null");
+    }
+}
+
+// "type value"
+static void typed(Text *t, Value v) {
+    Text_puts(t, llType(v.type));
+    Text_putc(t, ' ');
+    operand(t, v);
+}
+
+static void var(Text *t, const char *name, bool local) {
+    Text_putc(t, local ? '%' : '@');
+    Text_id(t, name);
+}
+
+// the start of an instruction with a result in a new temporary: "%.t<n> = "
+static Value result(int type) {
+    inst();
+    Value v = {V_TMP, type, nTmps++, 0};
+    operand(code, v);
+    Text_lit(code, " = ");
+    return v;
+}
+
+static void br(int n) {
+    inst();
+    Text_lit(code, "br label %");
+    blockName(code, n);
+    Text_putc(code, '\n');
+    terminated = true;
+}
+
+static void condBr(Value c, int yes, int no) {
+    inst();
+    Text_lit(code, "br ");
+    typed(code, c);
+    Text_lit(code, ", label %");
+    blockName(code, yes);
+    Text_lit(code, ", label %");
+    blockName(code, no);
+    Text_putc(code, '\n');
+    terminated = true;
+}
+
+// a string constant, with its escape sequences replaced, written in the global constants
+static Value str(const Node *n) {
+    const char *p = tkInput + n->pos, *end = p + n->len;
+    Text_clear(&chars);
+    while (p < end) {
+        if (*p != '\\' || p + 1 == end) {
+            Text_putc(&chars, *p++);
+            continue;
+        }
+        switch (p[1]) {
+            case 'n': Text_putc(&chars, '\n'); break;
+            case 't': Text_putc(&chars, '\t'); break;
+            case 'r': Text_putc(&chars, '\r'); break;
+            case '0': Text_putc(&chars, '\0'); break;
+            case 'a': Text_putc(&chars, '\a'); break;
+            case 'b': Text_putc(&chars, '\b'); break;
+            case 'f': Text_putc(&chars, '\f'); break;
+            case 'v': Text_putc(&chars, '\v'); break;
+            default: Text_putc(&chars, p[1]);
+        }
+        p += 2;
+    }
+    Value v = {V_STR, TYPE_STR, nStrs++, 0};
+    Text *t = &tBegin;
+    operand(t, v);
+    Text_lit(t, " = private unnamed_addr constant [");
+    Text_int(t, (int)chars.n + 1);
+    Text_lit(t, " x i8] c\"");
+    for (size_t i = 0; i < chars.n; i++) {
+        unsigned char c = chars.buf[i];
+        if (c >= ' ' && c < 127 && c != '"' && c != '\\') Text_putc(t, c);
+        else Text_write(t, "\\%02X", c);
+    }
+    Text_lit(t, "\\00\"\n");
+    return v;
+}
+
+static Value zext(Value c) {
+    Value v = result(TYPE_INT);
+    Text_lit(code, "zext ");
+    typed(code, c);
+    Text_lit(code, " to i32\n");
+    return v;
+}
+
+// v!=0 as i1, like a condition in C
+static Value toBool(Value v) {
+    Value c = result(TYPE_BOOL);
+    Text_puts(code, v.type == TYPE_REAL ? "fcmp une " : "icmp ne ");
+    typed(code, v);
+    Text_puts(code, v.type == TYPE_REAL ? ", 0.0\n" : v.type == TYPE_INT ? ", 0\n" : ", null\n");
+    return c;
+}
+
+static Value expr(int id);
+
+// the comparisons, in the order LESS, LESSEQ, GREATER, GREATEREQ, EQUAL, NOTEQ
+// the reals are ordered (false for NaN), except !=, like in C; the strings are compared as pointers
+static const char *const intCmp[] = {"icmp slt ", "icmp sle ", "icmp sgt ", "icmp sge ", "icmp eq ", "icmp ne "};
+static const char *const strCmp[] = {"icmp ult ", "icmp ule ", "icmp ugt ", "icmp uge ", "icmp eq ", "icmp ne "};
+static const char *const realCmp[] = {"fcmp olt ", "fcmp ole ", "fcmp ogt ", "fcmp oge ", "fcmp oeq ", "fcmp une "};
+
+static int comparison(int op) {
+    switch (op) {
+        case LESS: return 0;
+        case LESSEQ: return 1;
+        case GREATER: return 2;
+        case GREATEREQ: return 3;
+        case EQUAL: return 4;
+        case NOTEQ: return 5;
+        default: return -1;
+    }
+}
+
+// a&&b and a||b: b is evaluated in its own block and the result is a phi of the two paths
+static Value logic(const Node *n) {
+    bool isAnd = n->op == AND;
+    Value c = toBool(expr(n->a));
+    int from = crtLabel, right = nLabels++, merge = nLabels++;
+    condBr(c, isAnd ? right : merge, isAnd ? merge : right);
+    startBlock(right);
+    Value r = toBool(expr(n->b));
+    int rightEnd = crtLabel;
+    br(merge);
+    startBlock(merge);
+    Value v = result(TYPE_BOOL);
+    Text_puts(code, isAnd ? "phi i1 [ false, %" : "phi i1 [ true, %");
+    blockName(code, from);
+    Text_lit(code, " ], [ ");
+    operand(code, r);
+    Text_lit(code, ", %");
+    blockName(code, rightEnd);
+    Text_lit(code, " ]\n");
+    return zext(v);
+}
+
+static Value binary(const Node *n) {
+    if (n->op == AND || n->op == OR) return logic(n);
+    Value a = expr(n->a), b = expr(n->b);
+    int type = nodes[n->a].type, cmp = comparison(n->op);
+    Value v;
+    if (cmp >= 0) {
+        v = result(TYPE_BOOL);
+        Text_puts(code, (type == TYPE_INT ? intCmp : type == TYPE_REAL ? realCmp : strCmp)[cmp]);
+    } else {
+        if (type == TYPE_STR) err("the strings cannot be added or subtracted");
+        v = result(type);
+        bool real = type == TYPE_REAL;
+        switch (n->op) {
+            case ADD: Text_puts(code, real ? "fadd " : "add "); break;
+            case SUB: Text_puts(code, real ? "fsub " : "sub "); break;
+            case MUL: Text_puts(code, real ? "fmul " : "mul "); break;
+            default: Text_puts(code, real ? "fdiv " : "sdiv ");
+        }
+    }
+    typed(code, a);
+    Text_lit(code, ", ");
+    operand(code, b);
+    Text_putc(code, '\n');
+    return cmp >= 0 ? zext(v) : v;
+}
+
+// a ? b : c, where b and c are evaluated in their own blocks
+static Value cond(const Node *n) {
+    Value c = toBool(expr(n->a));
+    int yes = nLabels++, no = nLabels++, merge = nLabels++;
+    condBr(c, yes, no);
+    startBlock(yes);
+    Value a = expr(n->b);
+    int yesEnd = crtLabel;
+    br(merge);
+    startBlock(no);
+    Value b = expr(n->c);
+    int noEnd = crtLabel;
+    br(merge);
+    startBlock(merge);
+    Value v = result(n->type);
+    Text_lit(code, "phi ");
+    Text_puts(code, llType(n->type));
+    Text_lit(code, " [ ");
+    operand(code, a);
+    Text_lit(code, ", %");
+    blockName(code, yesEnd);
+    Text_lit(code, " ], [ ");
+    operand(code, b);
+    Text_lit(code, ", %");
+    blockName(code, noEnd);
+    Text_lit(code, " ]\n");
+    return v;
+}
+
+// the call, with the arguments evaluated in order; tail is "musttail " for a tail call, else ""
+static Value call(const Node *n, const char *tail) {
+    int nArgs = 0;
+    for (int a = n->a; a; a = nodes[a].next) nArgs++;
+    Value *args = (Value *)arenaAlloc(&llvmArena, (nArgs + 1) * sizeof(Value));
+    int k = 0;
+    for (int a = n->a; a; a = nodes[a].next) args[k++] = expr(a);
+    if (!strcmp(n->name, "puts")) {
+        // the C puts returns an int, so the result in Quick is its argument
+        inst();
+        Text_lit(code, "call i32 @puts(");
+        typed(code, args[0]);
+        Text_lit(code, ")\n");
+        return args[0];
+    }
+    Value v = result(n->type);
+    Text_puts(code, tail);
+    Text_lit(code, "call ");
+    Text_puts(code, llType(n->type));
+    Text_lit(code, " @");
+    Text_id(code, n->name);
+    Text_putc(code, '(');
+    for (k = 0; k < nArgs; k++) {
+        if (k) Text_lit(code, ", ");
+        typed(code, args[k]);
+    }
+    Text_lit(code, ")\n");
+    return v;
+}
+
+static Value expr(int id) {
+    const Node *n = &nodes[id];
+    switch (n->kind) {
+        case N_INT: return (Value){V_INT, TYPE_INT, n->i, 0};
+        case N_REAL: return (Value){V_REAL, TYPE_REAL, 0, n->r};
+        case N_STR: return str(n);
+        case N_VAR: {
+            Value v = result(n->type);
+            Text_lit(code, "load ");
+            Text_puts(code, llType(n->type));
+            Text_lit(code, ", ptr ");
+            var(code, n->name, n->local);
+            Text_putc(code, '\n');
+            return v;
+        }
+        case N_CALL: return call(n, "");
+        case N_NEG: {
+            Value a = expr(n->a);
+            Value v = result(n->type);
+            Text_puts(code, n->type == TYPE_REAL ? "fneg " : "sub i32 0, ");
+            if (n->type == TYPE_REAL) typed(code, a);
+            else operand(code, a);
+            Text_putc(code, '\n');
+            return v;
+        }
+        case N_NOT: {
+            Value a = expr(n->a);
+            Value c = result(TYPE_BOOL);
+            Text_puts(code, a.type == TYPE_REAL ? "fcmp oeq " : "icmp eq ");
+            typed(code, a);
+            Text_puts(code, a.type == TYPE_REAL ? ", 0.0\n" : ", 0\n");
+            return zext(c);
+        }
+        case N_PAREN: return expr(n->a);
+        case N_BIN: return binary(n);
+        case N_ASSIGN: {
+            Value v = expr(n->a);
+            inst();
+            Text_lit(code, "store ");
+            typed(code, v);
+            Text_lit(code, ", ptr ");
+            var(code, n->name, n->local);
+            Text_putc(code, '\n');
+            return v;
+        }
+        case N_COND: return cond(n);
+        case N_SEQ:
+            expr(n->a);
+            return expr(n->b);
+        default:
+            err("internal error: wrong expression node %d in the LLVM generator", n->kind);
+    }
+}
+
+// a local variable, set to 0 like the other backends, or to the argument of the function
+static void allocVar(const Node *v, bool arg) {
+    Text *t = allocas;
+    Text_lit(t, "  ");
+    var(t, v->name, true);
+    Text_lit(t, " = alloca ");
+    Text_puts(t, llType(v->type));
+    Text_lit(t, "\n  store ");
+    if (arg) {
+        Text_puts(t, llType(v->type));
+        Text_lit(t, " %");
+        Text_id(t, v->name);
+        Text_lit(t, ".arg");
+    } else {
+        typed(t, zero(v->type));
+    }
+    Text_lit(t, ", ptr ");
+    var(t, v->name, true);
+    Text_putc(t, '\n');
+}
+
+static void ret(Value v) {
+    inst();
+    Text_lit(code, "ret ");
+    typed(code, v);
+    Text_putc(code, '\n');
+    terminated = true;
+}
+
+static void list(int id);
+
+static void instr(int id) {
+    const Node *n = &nodes[id];
+    switch (n->kind) {
+        case N_EXPR: expr(n->a); break;
+        case N_EMPTY: break;
+        case N_IF: {
+            Value c = toBool(expr(n->a));
+            int yes = nLabels++, no = n->c ? nLabels++ : -1, merge = nLabels++;
+            condBr(c, yes, n->c ? no : merge);
+            startBlock(yes);
+            list(n->b);
+            if (!terminated) br(merge);
+            if (n->c) {
+                startBlock(no);
+                list(n->c);
+                if (!terminated) br(merge);
+            }
+            startBlock(merge);
+            break;
+        }
+        case N_WHILE: {
+            int head = nLabels++, body = nLabels++, end = nLabels++;
+            br(head);
+            startBlock(head);
+            Value c = toBool(expr(n->a));
+            condBr(c, body, end);
+            startBlock(body);
+            list(n->b);
+            if (!terminated) br(head);
+            startBlock(end);
+            break;
+        }
+        case N_RETURN: {
+            int tail = tailCall(id);
+            Value v = tail ? call(&nodes[tail], "musttail ") : expr(n->a);
+            if (!crtFn && v.type != TYPE_INT) {
+                // the result of main is an int, like the conversion done by the C compiler
+                Value i = result(TYPE_INT);
+                Text_puts(code, v.type == TYPE_REAL ? "fptosi " : "ptrtoint ");
+                typed(code, v);
+                Text_lit(code, " to i32\n");
+                v = i;
+            }
+            ret(v);
+            break;
+        }
+        case N_BLOCK:
+            for (int v = n->a; v; v = nodes[v].next) allocVar(&nodes[v], false);
+            list(n->b);
+            break;
+        default:
+            err("internal error: wrong instruction node %d in the LLVM generator", n->kind);
+    }
+}
+
+static void list(int id) {
+    for (; id; id = nodes[id].next) instr(id);
+}
+
+static void genFn(const Node *fn) {
+    code = allocas = &tFunctions;
+    crtFn = fn;
+    crtLabel = -1;
+    terminated = false;
+    Text_lit(code, "\ndefine internal ");
+    Text_puts(code, llType(fn->type));
+    Text_lit(code, " @");
+    Text_id(code, fn->name);
+    Text_putc(code, '(');
+    for (int a = fn->a; a; a = nodes[a].next) {
+        Text_puts(code, llType(nodes[a].type));
+        Text_lit(code, " %");
+        Text_id(code, nodes[a].name);
+        Text_lit(code, ".arg");
+        if (nodes[a].next) Text_lit(code, ", ");
+    }
+    Text_lit(code, ") {\nentry:\n");
+    for (int a = fn->a; a; a = nodes[a].next) allocVar(&nodes[a], true);
+    for (int v = fn->b; v; v = nodes[v].next) allocVar(&nodes[v], false);
+    list(fn->c);
+    // a function without return returns 0
+    if (!terminated) ret(zero(fn->type));
+    Text_lit(code, "}\n");
+}
+
+void genLlvmHeader(Text *begin) {
+    nTmps = nLabels = nStrs = 0;
+    mainLabel = -1;
+    mainTerminated = false;
+    Text_clear(&mainAllocas);
+    Text_clear(&mainBody);
+    Text_lit(begin, "; generated by quick: run with \"lli file.ll\" or build with \"clang file.ll\"\n"
+        "; the LLVM 14 tools need the -opaque-pointers option\n\n");
+}
+
+void genLlvmItem(int id) {
+    const Node *n = &nodes[id];
+    if (n->kind == N_VARDEF) {
+        Text *t = &tBegin;
+        Text_putc(t, '@');
+        Text_id(t, n->name);
+        Text_lit(t, " = internal global ");
+        typed(t, zero(n->type));
+        Text_putc(t, '\n');
+        return;
+    }
+    ArenaMark mark = arenaMark(&llvmArena);
+    if (n->kind == N_FN) {
+        genFn(n);
+    } else {
+        code = &mainBody;
+        allocas = &mainAllocas;
+        crtFn = NULL;
+        crtLabel = mainLabel;
+        terminated = mainTerminated;
+        list(id);
+        mainLabel = crtLabel;
+        mainTerminated = terminated;
+    }
+    arenaRelease(&llvmArena, mark);
+}
+
+void genLlvmEnd(Text *main) {
+    Text_lit(main, "\ndefine i32 @main() {\nentry:\n");
+    Text_putn(main, mainAllocas.buf, mainAllocas.n);
+    Text_putn(main, mainBody.buf, mainBody.n);
+    if (!mainTerminated) Text_lit(main, "  ret i32 0\n");
+    Text_lit(main, "}\n\n"
+        "declare i32 @printf(ptr, ...)\n"
+        "declare i32 @puts(ptr)\n\n"
+        "@.fmti = private unnamed_addr constant [4 x i8] c\"%d\\0A\\00\"\n"
+        "@.fmtr = private unnamed_addr constant [4 x i8] c\"%g\\0A\\00\"\n\n"
+        "define internal i32 @puti(i32 %v) {\nentry:\n"
+        "  %r = call i32 (ptr, ...) @printf(ptr @.fmti, i32 %v)\n  ret i32 %v\n}\n\n"
+        "define internal double @putr(double %v) {\nentry:\n"
+        "  %r = call i32 (ptr, ...) @printf(ptr @.fmtr, double %v)\n  ret double %v\n}\n");
+    Text_clear(&mainAllocas);
+    Text_clear(&mainBody);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "gen.h"
+
+// An LLVM backend, used instead of the C code generator when llvmMode is true (the --emit-llvm option).
+// It writes a module in the textual LLVM IR, which can be optimized with opt, compiled with llc or clang,
+// or executed with lli, without a C compiler and without linking with the LLVM libraries.
+// The code is generated from the AST (see ast.h), like the code of clang -O0: each variable is an alloca
+// (or a global) which is loaded and stored, so the SSA form is left to the mem2reg pass of LLVM.
+// The types are i32 (int), double (real) and ptr (str), so LLVM 15 or newer is needed,
+// or the -opaque-pointers option of the LLVM 14 tools.
+// printf and puts are declared from the C library, and puti and putr are defined with them, like in quick.h.
+// The tail calls of a function to itself (see Node.tail) are "musttail" calls, so they are always jumps.
+extern bool llvmMode;
+
+// writes the start of the module in begin
+void genLlvmHeader(Text *begin);
+
+// generates the code of a top-level item: a global variable in tBegin and a function in tFunctions;
+// the global instructions are kept in the body of main, which is written by genLlvmEnd
+void genLlvmItem(int id);
+
+// writes main and the declarations of the runtime functions
+void genLlvmEnd(Text *main);
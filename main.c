@@ -1,29 +1,210 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "lexer.h"
 #include "parser.h"
+#include "utils.h"
+#include "atoms.h"
+#include "pipeline.h"
+#include "plexer.h"
+#include "out.h"
+#include "ast.h"
+#include "opt.h"
+#include "ir.h"
+#include "prune.h"
+#include "inliner.h"
+#include "memo.h"
+#include "vm.h"
+#include "asm.h"
+#include "llvm.h"
+#include "exec.h"
+#include "ad.h"
 
-#define MAX_INPUT_SIZE 4096
+// usage: quick [-o file] [-S] [--emit-llvm] [-O] [-O2] [--inline-budget N] [--inline-depth N] [--memoize] [--memo-size N] [--emit-ir] [--time-passes] [--opt-stats] [--tokens] [--lex-threads N] [--pipeline] [--pipeline-stats] [--ast] [--mem-stats] [--out-stats] [--parser-stats] [--lexer-stats] [file]
+//   -o, --output file  writes the generated C code in file, by default in ./test/1.c; with "-" the code is written
+//                      to stdout, the statistics to stderr and the symbol table is not traced
+//   -S                 generates x86-64 assembly for GNU as instead of C code (built with "cc file.s"),
+//                      by default in ./test/1.s; it is generated from the optimized IR, like with -O2
+//   --emit-llvm        generates textual LLVM IR instead of C code (run with "lli file.ll" or built with
+//                      "clang file.ll"), by default in ./test/1.ll; the IR optimizations are left to LLVM
+//   -O                 optimizes the generated code: constant folding and propagation, and removes
+//                      the functions and global variables not used by the global code and the instructions after return
+//   -O2                also translates the functions and the global code to an SSA IR and optimizes it:
+//                      copy propagation, common subexpressions, loop invariant code motion, dead stores
+//   --inline-budget N  inlines the functions with at most N AST nodes which are made only of if and return
+//                      (default: 40 with -O and -O2, else 0, which disables the inlining)
+//   --inline-depth N   how many times the inlined code is inlined again, for the recursive functions (default: 2)
+//   --memoize          calls the pure functions with int and real arguments through a table with their last results
+//                      and shows at exit how many calls were found in it
+//   --memo-size N      the entries of the table of each memoized function, rounded up to a power of 2 (default: 4096)
+//   --emit-ir          shows the optimized IR of each function and global instruction (with -O2)
+//   --time-passes      shows the time of each IR pass and what it has done (with -O2)
+//   --opt-stats        shows what the optimizer has done and what was removed
+//   --tokens           shows all the tokens before parsing
+//   --lex-threads N    extracts all the tokens with N threads, before parsing
+//   --pipeline         reads, extracts the tokens and parses on separate threads
+//   --pipeline-stats   same as --pipeline, but also shows the busy and stall time of each thread
+//   --ast              shows the AST of each global variable, function and global instruction
+//   --mem-stats        shows the memory allocated by each subsystem and by the AST nodes
+//   --out-stats        shows how the generated code was written
+//   --parser-stats     shows how many times the parser looked at the tokens
+//   --lexer-stats      shows the distinct names and the lookups of the atoms table,
+//                      and the max number of tokens kept by the parser (without --pipeline)
+// without a file name, or with "-", the program is read from stdin
+// an unknown option, an option without its value and the options which cannot be used together are errors
+//
+// usage: quick run [options] [file]
+//   compiles the program to bytecode and executes it, without generating C code; the options are the same,
+//   except -o, -S, --emit-llvm and --memoize, and only the requested statistics are shown
+//   --emit-bytecode    shows the bytecode of each function and of the global code
+//
+// usage: quick exec [options] [file]
+//   generates the C code in memory, builds it as a shared object (with quick.h from the current directory),
+//   loads it and calls its main; the shared object is cached, so the next exec of the same code does not
+//   build it again (see exec.h); the options are the same, except -o, -S and --emit-llvm,
+//   and only the requested statistics are shown; the exit status is the one returned by the program
+//   --exec-stats       shows if the program was found in the cache and the time of each step
 
-int main(int argc, char* argv[]){
-    FILE *fd = fopen(argv[1], "r");
+// the statistics requested by the options
+static int memStats, outStats, parseStats, lexerStats, showOpt, timePasses, showExec;
 
-    if(fd == NULL){
-        fprintf(stderr, "File not found\n");
-        exit(1);
+// after parsing: closes the output (and executes the program for exec), shows the requested statistics
+// and frees the memory; src is NULL when the source was read by the pipeline
+static int finish(Source *src) {
+    int status = EXIT_SUCCESS;
+    if (!vmMode) closeOutput();
+    if (execMode) {
+        status = execProgram();
+        if (showExec) showExecStats();
+    }
+    if (lexerStats) {
+        showAtomStats();
+        if (src) printf("Token window: %d tokens\n", tkWindowSize());
+    }
+    if (outStats) showOutputStats();
+    if (parseStats) showParserStats();
+    if (showOpt) {
+        showOptStats();
+        showPruneStats();
+        showInlineStats();
+        showMemoStats();
+        if (asmMode) showAsmStats();
+    }
+    if (timePasses) showPassTimes();
+    if (memStats) {
+        showAstStats();
+        if (vmMode) showVmStats();
+        showArenaStats();
     }
+    if (src) freeSource(src);
+    freeAtoms();
+    freeArenas();
+    return status;
+}
 
-    char input[MAX_INPUT_SIZE];
+// the value of the option argv[*i], which must follow it
+static const char *optionValue(int argc, char *argv[], int *i) {
+    if (*i + 1 >= argc) err("%s needs a value", argv[*i]);
+    return argv[++*i];
+}
 
-    size_t bytes_read = fread(input, sizeof(char), MAX_INPUT_SIZE - 1, fd);
-    input[bytes_read] = '\0';
+// the value of the option argv[*i], which must be a number >= 0
+static int intValue(int argc, char *argv[], int *i) {
+    const char *option = argv[*i], *value = optionValue(argc, argv, i);
+    char *end;
+    errno = 0;
+    long n = strtol(value, &end, 10);
+    if (!*value || *end || errno || n < 0 || n > INT_MAX) err("%s needs a number, not %s", option, value);
+    return (int)n;
+}
 
-    fclose(fd);
-    tokenize(input);
+int main(int argc, char* argv[]){
+    const char *fileName = NULL, *outName = NULL;
+    int showTks = 0, pipelined = 0, pipelineStats = 0, lexThreads = 0;
+    int budget = -1, first = 1;
+    if (argc > 1 && !strcmp(argv[1], "run")) {
+        vmMode = true;
+        traceSymbols = false;
+        first = 2;
+    } else if (argc > 1 && !strcmp(argv[1], "exec")) {
+        execMode = true;
+        traceSymbols = false;
+        first = 2;
+    }
+    for (int i = first; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) outName = optionValue(argc, argv, &i);
+        else if (!strcmp(argv[i], "-S")) asmMode = true;
+        else if (!strcmp(argv[i], "--emit-llvm")) llvmMode = true;
+        else if (!strcmp(argv[i], "-O")) optLevel = 1, pruning = true;
+        else if (!strcmp(argv[i], "-O2")) optLevel = 2, pruning = true;
+        else if (!strcmp(argv[i], "--inline-budget")) budget = intValue(argc, argv, &i);
+        else if (!strcmp(argv[i], "--inline-depth")) inlineDepth = intValue(argc, argv, &i);
+        else if (!strcmp(argv[i], "--memoize")) memoize = true;
+        else if (!strcmp(argv[i], "--memo-size")) memoSize = intValue(argc, argv, &i);
+        else if (!strcmp(argv[i], "--emit-ir")) irDump = stdout;
+        else if (!strcmp(argv[i], "--emit-bytecode")) vmDump = stdout;
+        else if (!strcmp(argv[i], "--exec-stats")) showExec = 1;
+        else if (!strcmp(argv[i], "--time-passes")) timePasses = 1;
+        else if (!strcmp(argv[i], "--opt-stats")) showOpt = 1;
+        else if (!strcmp(argv[i], "--tokens")) showTks = 1;
+        else if (!strcmp(argv[i], "--lex-threads")) lexThreads = intValue(argc, argv, &i);
+        else if (!strcmp(argv[i], "--pipeline")) pipelined = 1;
+        else if (!strcmp(argv[i], "--pipeline-stats")) pipelined = pipelineStats = 1;
+        else if (!strcmp(argv[i], "--ast")) astDump = stdout;
+        else if (!strcmp(argv[i], "--mem-stats")) memStats = 1;
+        else if (!strcmp(argv[i], "--out-stats")) outStats = 1;
+        else if (!strcmp(argv[i], "--parser-stats")) parseStats = 1;
+        else if (!strcmp(argv[i], "--lexer-stats")) lexerStats = 1;
+        // "-" is stdin
+        else if (argv[i][0] == '-' && argv[i][1]) err("unknown option %s", argv[i]);
+        else if (fileName) err("only one input file can be given, not %s and %s", fileName, argv[i]);
+        else fileName = argv[i];
+    }
+    // the options which would be ignored
+    const char *mode = vmMode ? "quick run" : execMode ? "quick exec" : NULL;
+    if (mode && outName) err("-o cannot be used with %s", mode);
+    if (mode && asmMode) err("-S cannot be used with %s", mode);
+    if (mode && llvmMode) err("--emit-llvm cannot be used with %s", mode);
+    if (vmMode && memoize) err("--memoize cannot be used with quick run");
+    if (vmDump && !vmMode) err("--emit-bytecode can be used only with quick run");
+    if (showExec && !execMode) err("--exec-stats can be used only with quick exec");
+    if (asmMode && llvmMode) err("-S cannot be used with --emit-llvm");
+    if (memoize && (asmMode || llvmMode)) err("--memoize cannot be used with %s", asmMode ? "-S" : "--emit-llvm");
+    if (pipelined && showTks) err("--tokens cannot be used with --pipeline");
+    if (pipelined && lexThreads) err("--lex-threads cannot be used with --pipeline");
+    inlineBudget = budget >= 0 ? budget : optLevel ? 40 : 0;
+    int memoEntries = 2;
+    while (memoEntries < memoSize && memoEntries < (1 << 24)) memoEntries *= 2;
+    memoSize = memoEntries;
+    // the VM runs all the functions which it compiled
+    if (vmMode) pruning = false;
+    // the code written to stdout must not be mixed with the traces of the symbol table
+    if (outName && !strcmp(outName, "-")) traceSymbols = false;
+    if (!outName) outName = llvmMode ? "./test/1.ll" : asmMode ? "./test/1.s" : "./test/1.c";
 
-    printf("Tokens: \n");
-    showTokens();
+    if (execMode) beginExec();
+    else if (!vmMode) openOutput(outName);
+
+    if (pipelined) {
+        parsePipelined(fileName, pipelineStats);
+        return finish(NULL);
+    }
+
+    Source src = loadSource(fileName);
+
+    if (lexThreads) {
+        tokenizeParallel(src.text, lexThreads);
+    } else if (showTks) {
+        tokenize(src.text);
+    }
+    if (showTks) {
+        printf("Tokens: \n");
+        showTokens();
+    }
     
-    parse();
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    if (lexThreads) parseTokens();
+    else parse(src.text);
+    return finish(&src);
+}
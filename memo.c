@@ -0,0 +1,232 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ast.h"
+#include "atoms.h"
+#include "lexer.h"
+#include "memo.h"
+#include "utils.h"
+
+bool memoize;
+int memoSize = 4096;
+static MemoStats stats;
+static Arena memoArena = ARENA("memo");
+
+// the names of the pure functions, in an open addressing table
+// the names are atoms, so they are compared by pointer
+static const char **pureFns;
+static int capPure;
+
+static const char *fnName;      // the original name of the function between genMemoBefore and genMemoAfter
+static Text memoName;           // the name of the wrapped function
+
+static size_t slotOf(const char *name) {
+    return (size_t)(((uintptr_t)name >> 3) * 0x9E3779B97F4A7C15ull >> 32) & (capPure - 1);
+}
+
+static bool isPureFn(const char *name) {
+    if (!capPure) return false;
+    for (size_t h = slotOf(name); pureFns[h]; h = (h + 1) & (capPure - 1)) {
+        if (pureFns[h] == name) return true;
+    }
+    return false;
+}
+
+static void addPureFn(const char *name) {
+    if (2 * (stats.pure + 1) > capPure) {
+        int oldCap = capPure;
+        const char **old = pureFns;
+        capPure = capPure ? capPure * 2 : 256;
+        pureFns = (const char **)arenaAlloc(&memoArena, capPure * sizeof(const char *));
+        memset(pureFns, 0, capPure * sizeof(const char *));
+        for (int k = 0; k < oldCap; k++) {
+            if (!old[k]) continue;
+            size_t h = slotOf(old[k]);
+            while (pureFns[h]) h = (h + 1) & (capPure - 1);
+            pureFns[h] = old[k];
+        }
+    }
+    size_t h = slotOf(name);
+    while (pureFns[h]) h = (h + 1) & (capPure - 1);
+    pureFns[h] = name;
+    stats.pure++;
+}
+
+void resetMemo(void) {
+    pureFns = NULL;
+    capPure = 0;
+    stats.pure = stats.memoized = 0;
+}
+
+// the subtree id and its list of next nodes use only local variables and pure functions
+// the recursive calls of the function self are pure if the function is pure
+static bool isPure(int id, const char *self) {
+    for (; id; id = nodes[id].next) {
+        const Node *n = &nodes[id];
+        if ((n->kind == N_VAR || n->kind == N_ASSIGN) && !n->local) return false;
+        if (n->kind == N_CALL && n->name != self && !isPureFn(n->name)) return false;
+        if (!isPure(n->a, self) || !isPure(n->b, self) || !isPure(n->c, self)) return false;
+    }
+    return true;
+}
+
+// the values of the type can be keys and results in the table
+static bool isKeyType(int type) {
+    return type == TYPE_INT || type == TYPE_REAL;
+}
+
+bool addPure(int id) {
+    const Node *fn = &nodes[id];
+    if (!isPure(fn->c, fn->name)) return false;
+    addPureFn(fn->name);
+    if (!fn->a || !isKeyType(fn->type)) return false;
+    for (int a = fn->a; a; a = nodes[a].next) {
+        if (!isKeyType(nodes[a].type)) return false;
+    }
+    stats.memoized++;
+    return true;
+}
+
+// the generated names start with __q_, which cannot be used in Quick (see checkName in parser.c),
+// so they do not depend on the names defined later in the program
+void genMemoHeader(Text *t) {
+    Text_lit(t, "// the bits of a real argument of a memoized function, to be compared exactly\n"
+        "static inline unsigned long long __q_memoBits(double r){"
+        "unsigned long long u;__builtin_memcpy(&u,&r,sizeof(u));return u;}\n\n");
+}
+
+// the name of fn with the given prefix: __q_memo_ for its table, __q_report_ for the function which shows
+// the hits at exit and __q_memofn_ for the wrapped function
+static void genName(Text *t, const char *prefix) {
+    Text_puts(t, prefix);
+    Text_id(t, fnName);
+}
+
+// a field of the table of fn
+static void genTable(Text *t, const char *field) {
+    genName(t, "__q_memo_");
+    Text_puts(t, field);
+}
+
+// the header of a function with the name of fn and with the parameters named a0, a1, ...
+static void genWrapperHeader(Text *t, const Node *fn) {
+    Text_puts(t, cType(fn->type));
+    Text_putc(t, ' ');
+    Text_id(t, fnName);
+    Text_putc(t, '(');
+    int i = 0;
+    for (int a = fn->a; a; a = nodes[a].next, i++) {
+        if (i) Text_putc(t, ',');
+        Text_puts(t, cType(nodes[a].type));
+        Text_lit(t, " a");
+        Text_int(t, i);
+    }
+    Text_putc(t, ')');
+}
+
+void genMemoBefore(Text *t, int id) {
+    Node *fn = &nodes[id];
+    int nArgs = 0;
+    for (int a = fn->a; a; a = nodes[a].next) nArgs++;
+    fnName = fn->name;
+
+    Text_lit(t, "\nstatic struct{\nstruct{unsigned long long k[");
+    Text_int(t, nArgs);
+    Text_lit(t, "];");
+    Text_puts(t, cType(fn->type));
+    Text_lit(t, " r;char used;}e[");
+    Text_int(t, memoSize);
+    Text_lit(t, "];\nunsigned long calls,hits;\n}");
+    genName(t, "__q_memo_");
+    Text_lit(t, ";\n");
+
+    // a destructor instead of atexit, so no declaration from stdlib.h is needed
+    Text_lit(t, "__attribute__((destructor)) static void ");
+    genName(t, "__q_report_");
+    Text_lit(t, "(void){\nif(!");
+    genTable(t, ".calls)return;\nfprintf(stderr,\"memo ");
+    Text_id(t, fnName);
+    Text_lit(t, ": %lu calls, %lu hits (%.1f%%)\\n\",");
+    genTable(t, ".calls,");
+    genTable(t, ".hits,100.0*");
+    genTable(t, ".hits/");
+    genTable(t, ".calls);\n}\n");
+
+    // the recursive calls are before the wrapper
+    genWrapperHeader(t, fn);
+    Text_lit(t, ";\n");
+
+    Text_clear(&memoName);
+    genName(&memoName, "__q_memofn_");
+    fn->name = intern(memoName.buf, memoName.n);
+}
+
+void genMemoAfter(Text *t, int id) {
+    Node *fn = &nodes[id];
+    fn->name = fnName;
+    int bits = 0;
+    while ((1 << bits) < memoSize) bits++;
+
+    Text_putc(t, '\n');
+    genWrapperHeader(t, fn);
+    Text_lit(t, "{\n");
+    // the keys and their hash
+    int i = 0;
+    for (int a = fn->a; a; a = nodes[a].next, i++) {
+        Text_lit(t, "unsigned long long k");
+        Text_int(t, i);
+        Text_puts(t, nodes[a].type == TYPE_INT ? "=(unsigned)a" : "=__q_memoBits(a");
+        Text_int(t, i);
+        Text_puts(t, nodes[a].type == TYPE_INT ? ";\n" : ");\n");
+    }
+    Text_lit(t, "unsigned long long h=k0*0x9E3779B97F4A7C15ull;\n");
+    for (int k = 1; k < i; k++) {
+        Text_lit(t, "h=(h^k");
+        Text_int(t, k);
+        Text_lit(t, ")*0x9E3779B97F4A7C15ull;\n");
+    }
+    Text_lit(t, "unsigned i=(unsigned)(h>>");
+    Text_int(t, 64 - bits);
+    Text_lit(t, ");\n");
+    genTable(t, ".calls++;\nif(");
+    genTable(t, ".e[i].used");
+    for (int k = 0; k < i; k++) {
+        Text_lit(t, "&&");
+        genTable(t, ".e[i].k[");
+        Text_int(t, k);
+        Text_lit(t, "]==k");
+        Text_int(t, k);
+    }
+    Text_lit(t, "){\n");
+    genTable(t, ".hits++;\nreturn ");
+    genTable(t, ".e[i].r;\n}\n");
+    // a miss calls the function and replaces the entry
+    Text_puts(t, cType(fn->type));
+    Text_lit(t, " r=");
+    genName(t, "__q_memofn_");
+    Text_putc(t, '(');
+    for (int k = 0; k < i; k++) {
+        if (k) Text_putc(t, ',');
+        Text_putc(t, 'a');
+        Text_int(t, k);
+    }
+    Text_lit(t, ");\n");
+    for (int k = 0; k < i; k++) {
+        genTable(t, ".e[i].k[");
+        Text_int(t, k);
+        Text_lit(t, "]=k");
+        Text_int(t, k);
+        Text_lit(t, ";\n");
+    }
+    genTable(t, ".e[i].r=r;\n");
+    genTable(t, ".e[i].used=1;\nreturn r;\n}\n");
+}
+
+MemoStats memoStats(void) {
+    return stats;
+}
+
+void showMemoStats(void) {
+    printf("Memoization: %d pure functions, %d memoized\n", stats.pure, stats.memoized);
+}
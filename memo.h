@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "gen.h"
+
+// Memoization of the pure functions, done when memoize is true (the --memoize option).
+// A function is pure if it reads only its parameters and local variables, does not assign global variables
+// and calls only pure functions (puti, putr and puts are not pure), so its result depends only on its arguments.
+// A pure function with int and real parameters and result is renamed to __q_memofn_<name> and it is called
+// through a wrapper with its original name, so its recursive calls also use the wrapper.
+// The names which start with __q_ are reserved for the generated code, so they never clash with the program.
+// The wrapper looks up the arguments in a direct mapped table of memoSize entries, in which each entry
+// has the arguments and the result, so a lookup reads a single cache line. A new result replaces the old one
+// from the same entry. At exit, each called wrapper shows on stderr its calls and how many were found in its table.
+extern bool memoize;
+extern int memoSize;        // the entries of the table of each function, a power of 2
+
+// deletes the known pure functions, before a new program is compiled
+void resetMemo(void);
+
+// checks if the function id is pure and, if it is, remembers it for the purity of the next functions
+// returns true if the function is memoized
+bool addPure(int id);
+
+// writes the declarations needed by all the wrappers, at the start of the C code
+void genMemoHeader(Text *t);
+
+// writes the table and the prototype of the memoized function id and renames it,
+// so its code can be generated by genItem or genIrItem
+void genMemoBefore(Text *t, int id);
+
+// restores the name of the function id and writes its wrapper, after its code
+void genMemoAfter(Text *t, int id);
+
+typedef struct{
+    int pure;           // the pure functions
+    int memoized;       // the pure functions with wrappers
+}MemoStats;
+
+MemoStats memoStats(void);
+void showMemoStats(void);
@@ -0,0 +1,367 @@
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ast.h"
+#include "lexer.h"
+#include "opt.h"
+#include "utils.h"
+
+int optLevel;
+static OptStats stats;
+static Arena optArena = ARENA("optimizer");
+
+// the value of an expression, as far as it is known at compile time
+typedef struct{
+    bool known;     // the value is known
+    bool pure;      // the expression has no side effects, so it can be replaced with its value
+    int i;          // TYPE_INT
+    double r;       // TYPE_REAL
+}Value;
+
+static const Value unknown = {false, false, 0, 0};
+
+// The known values of the local variables and arguments of the current function.
+// An environment is an array of values, with the same indexes as vars.
+static const char **vars;       // the names of the local variables and arguments
+static int nVars;
+static Value *env;
+
+static int varIndex(const Node *n) {
+    if (!n->local) return -1;
+    for (int i = 0; i < nVars; i++) {
+        if (vars[i] == n->name) return i;
+    }
+    return -1;
+}
+
+static Value *copyEnv(void) {
+    Value *e = (Value *)arenaAlloc(&optArena, nVars * sizeof(Value));
+    memcpy(e, env, nVars * sizeof(Value));
+    return e;
+}
+
+// the reals are compared by their bits, so 0.0 and -0.0 are different values
+static bool sameValue(const Value *x, const Value *y) {
+    return x->known && y->known && x->i == y->i && !memcmp(&x->r, &y->r, sizeof(x->r));
+}
+
+// keeps in env only the values which are the same in other
+static void mergeEnv(const Value *other) {
+    for (int i = 0; i < nVars; i++) {
+        if (env[i].known && !sameValue(&other[i], &env[i])) {
+            env[i] = unknown;
+        }
+    }
+}
+
+// forgets the values of the variables assigned in the subtree id and in its list of next nodes if withNext
+static void killAssigned(int id, bool withNext) {
+    for (; id; id = withNext ? nodes[id].next : 0) {
+        const Node *n = &nodes[id];
+        if (n->kind == N_ASSIGN) {
+            int v = varIndex(n);
+            if (v >= 0) env[v] = unknown;
+        }
+        // the children of the constants and variables are not used
+        if (n->kind != N_INT && n->kind != N_REAL && n->kind != N_STR && n->kind != N_VAR) {
+            killAssigned(n->a, true);
+            killAssigned(n->b, true);
+            killAssigned(n->c, true);
+        }
+    }
+}
+
+// replaces the node with the constant v, keeping its place in its list
+static void setConstant(int id, Value v) {
+    Node *n = &nodes[id];
+    n->kind = n->type == TYPE_REAL ? N_REAL : N_INT;
+    n->a = n->b = n->c = 0;
+    n->lval = false;
+    if (n->kind == N_REAL) n->r = v.r;
+    else n->i = v.i;
+}
+
+static Value constant(const Node *n) {
+    Value v = {true, true, 0, 0};
+    if (n->kind == N_REAL) v.r = n->r;
+    else v.i = n->i;
+    return v;
+}
+
+// the int operations are done like in the generated C code, but without the signed overflow
+static bool foldInt(int op, int a, int b, int *result) {
+    switch (op) {
+        case ADD: *result = (int)((unsigned)a + (unsigned)b); return true;
+        case SUB: *result = (int)((unsigned)a - (unsigned)b); return true;
+        case MUL: *result = (int)((unsigned)a * (unsigned)b); return true;
+        case DIV:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            *result = a / b;
+            return true;
+        case LESS: *result = a < b; return true;
+        case GREATER: *result = a > b; return true;
+        case LESSEQ: *result = a <= b; return true;
+        case GREATEREQ: *result = a >= b; return true;
+        case EQUAL: *result = a == b; return true;
+        case NOTEQ: *result = a != b; return true;
+        default: return false;
+    }
+}
+
+// an inf or NaN result is not folded: it has no C constant and the operation gives it anyway at runtime
+static bool foldReal(int op, double a, double b, Value *result) {
+    switch (op) {
+        case ADD: result->r = a + b; return isfinite(result->r);
+        case SUB: result->r = a - b; return isfinite(result->r);
+        case MUL: result->r = a * b; return isfinite(result->r);
+        case DIV:
+            if (b == 0) return false;
+            result->r = a / b;
+            return isfinite(result->r);
+        case LESS: result->i = a < b; return true;
+        case GREATER: result->i = a > b; return true;
+        case LESSEQ: result->i = a <= b; return true;
+        case GREATEREQ: result->i = a >= b; return true;
+        case EQUAL: result->i = a == b; return true;
+        case NOTEQ: result->i = a != b; return true;
+        default: return false;
+    }
+}
+
+static bool isTrue(const Node *n, Value v) {
+    return n->type == TYPE_REAL ? v.r != 0 : v.i != 0;
+}
+
+static Value foldExpr(int id);
+
+// && and ||: the right operand is evaluated only if the left one does not decide the result
+static Value foldLogic(int id) {
+    Node *n = &nodes[id];
+    int a = n->a, b = n->b;
+    bool isAnd = n->op == AND;
+    Value va = foldExpr(a);
+    if (va.known && va.pure && isTrue(&nodes[a], va) != isAnd) {
+        // 0&&x is 0 and 1||x is 1, without evaluating x
+        Value v = {true, true, !isAnd, 0};
+        setConstant(id, v);
+        stats.folded++;
+        return v;
+    }
+    Value vb = foldExpr(b);
+    killAssigned(b, false);     // the right operand may be not evaluated at all
+    if (va.known && va.pure && vb.known && vb.pure) {
+        Value v = {true, true, isTrue(&nodes[b], vb), 0};
+        setConstant(id, v);
+        stats.folded++;
+        return v;
+    }
+    return unknown;
+}
+
+// folds the subtree of the expression id and returns its value
+static Value foldExpr(int id) {
+    Node *n = &nodes[id];
+    switch (n->kind) {
+        case N_INT: case N_REAL:
+            return constant(n);
+        case N_STR:
+            return (Value){false, true, 0, 0};
+        case N_VAR: {
+            int v = varIndex(n);
+            if (v >= 0 && env[v].known) {
+                setConstant(id, env[v]);
+                stats.propagated++;
+                return env[v];
+            }
+            return (Value){false, true, 0, 0};
+        }
+        case N_CALL:
+            for (int a = n->a; a; a = nodes[a].next) foldExpr(a);
+            return unknown;
+        case N_ASSIGN: {
+            Value v = foldExpr(n->a);
+            int iVar = varIndex(&nodes[id]);
+            if (iVar >= 0) env[iVar] = v.known ? (Value){true, true, v.i, v.r} : unknown;
+            v.pure = false;
+            return v;
+        }
+        case N_SEQ: {
+            Value va = foldExpr(n->a);
+            Value vb = foldExpr(nodes[id].b);
+            vb.pure = vb.pure && va.pure;
+            return vb;
+        }
+        case N_COND: {
+            int a = n->a;
+            Value v = foldExpr(a);
+            n = &nodes[id];
+            if (v.known && v.pure) {
+                // only the selected operand remains, in the place of the node
+                int selected = isTrue(&nodes[a], v) ? n->b : n->c;
+                Value vs = foldExpr(selected);
+                int next = nodes[id].next;
+                nodes[id] = nodes[selected];
+                nodes[id].next = next;
+                stats.branches++;
+                return vs;
+            }
+            ArenaMark mark = arenaMark(&optArena);
+            Value *before = copyEnv();
+            Value vb = foldExpr(n->b);
+            Value *afterThen = copyEnv();
+            memcpy(env, before, nVars * sizeof(Value));
+            Value vc = foldExpr(nodes[id].c);
+            mergeEnv(afterThen);
+            arenaRelease(&optArena, mark);
+            if (sameValue(&vb, &vc)) return (Value){true, vb.pure && vc.pure && v.pure, vb.i, vb.r};
+            return (Value){false, vb.pure && vc.pure && v.pure, 0, 0};
+        }
+        case N_PAREN: case N_NEG: case N_NOT: {
+            int a = n->a;
+            Value v = foldExpr(a);
+            if (!v.known || !v.pure) return v.pure ? (Value){false, true, 0, 0} : unknown;
+            n = &nodes[id];
+            if (n->kind == N_NEG) {
+                if (nodes[a].type == TYPE_REAL) v.r = -v.r;
+                else v.i = (int)-(unsigned)v.i;
+            } else if (n->kind == N_NOT) {
+                v.i = !isTrue(&nodes[a], v);
+            }
+            setConstant(id, v);
+            stats.folded++;
+            return v;
+        }
+        case N_BIN: {
+            if (n->op == AND || n->op == OR) return foldLogic(id);
+            int a = n->a, b = n->b, op = n->op;
+            Value va = foldExpr(a);
+            Value vb = foldExpr(b);
+            bool pure = va.pure && vb.pure;
+            if (!va.known || !vb.known || !pure) return pure ? (Value){false, true, 0, 0} : unknown;
+            Value v = {true, true, 0, 0};
+            bool folded = false;
+            if (nodes[a].type == TYPE_INT) folded = foldInt(op, va.i, vb.i, &v.i);
+            else if (nodes[a].type == TYPE_REAL) folded = foldReal(op, va.r, vb.r, &v);
+            if (!folded) return (Value){false, true, 0, 0};
+            setConstant(id, v);
+            stats.folded++;
+            return v;
+        }
+        default:
+            return unknown;
+    }
+}
+
+static void foldList(int *link);
+
+// removes the node from its list, replacing it with the list first (which can be empty)
+static void splice(int *link, int first) {
+    int next = nodes[*link].next;
+    if (!first) {
+        *link = next;
+        return;
+    }
+    int last = first;
+    while (nodes[last].next) last = nodes[last].next;
+    nodes[last].next = next;
+    *link = first;
+}
+
+// folds the instructions from the list which starts at *link
+// *link is the link which points to the current instruction, so it can be replaced
+static void foldList(int *link) {
+    while (*link) {
+        int id = *link;
+        Node *n = &nodes[id];
+        switch (n->kind) {
+            case N_EXPR: case N_RETURN:
+                foldExpr(n->a);
+                break;
+            case N_IF: {
+                int cond = n->a;
+                Value v = foldExpr(cond);
+                n = &nodes[id];
+                if (v.known && v.pure) {
+                    // only the executed branch remains, and its instructions are folded next
+                    splice(link, isTrue(&nodes[cond], v) ? n->b : n->c);
+                    stats.branches++;
+                    continue;
+                }
+                ArenaMark mark = arenaMark(&optArena);
+                Value *before = copyEnv();
+                foldList(&nodes[id].b);
+                Value *afterThen = copyEnv();
+                memcpy(env, before, nVars * sizeof(Value));
+                foldList(&nodes[id].c);
+                mergeEnv(afterThen);
+                arenaRelease(&optArena, mark);
+                break;
+            }
+            case N_WHILE: {
+                // the variables changed in the loop are unknown at the start of each iteration
+                killAssigned(n->a, false);
+                killAssigned(n->b, true);
+                int cond = n->a;
+                Value v = foldExpr(cond);
+                if (v.known && v.pure && !isTrue(&nodes[cond], v)) {
+                    splice(link, 0);
+                    stats.branches++;
+                    continue;
+                }
+                ArenaMark mark = arenaMark(&optArena);
+                Value *head = copyEnv();
+                foldList(&nodes[id].b);
+                memcpy(env, head, nVars * sizeof(Value));
+                arenaRelease(&optArena, mark);
+                break;
+            }
+            default:
+                break;
+        }
+        link = &nodes[*link].next;
+    }
+}
+
+int foldConstants(int id) {
+    Node *n = &nodes[id];
+    if (n->kind == N_VARDEF) return id;
+    ArenaMark mark = arenaMark(&optArena);
+    nVars = 0;
+    if (n->kind == N_FN) {
+        for (int a = n->a; a; a = nodes[a].next) nVars++;
+        for (int v = n->b; v; v = nodes[v].next) nVars++;
+        vars = (const char **)arenaAlloc(&optArena, nVars * sizeof(const char *));
+        env = (Value *)arenaAlloc(&optArena, nVars * sizeof(Value));
+        int i = 0;
+        for (int a = n->a; a; a = nodes[a].next) vars[i++] = nodes[a].name;
+        for (int v = n->b; v; v = nodes[v].next) vars[i++] = nodes[v].name;
+        for (i = 0; i < nVars; i++) env[i] = unknown;
+        foldList(&nodes[id].c);
+    } else if (n->kind == N_BLOCK) {
+        // global instructions with the local variables added by the inliner
+        for (int v = n->a; v; v = nodes[v].next) nVars++;
+        vars = (const char **)arenaAlloc(&optArena, nVars * sizeof(const char *));
+        env = (Value *)arenaAlloc(&optArena, nVars * sizeof(Value));
+        int i = 0;
+        for (int v = n->a; v; v = nodes[v].next) vars[i++] = nodes[v].name;
+        for (i = 0; i < nVars; i++) env[i] = unknown;
+        foldList(&nodes[id].b);
+    } else {
+        // an instruction of the global code, where all the variables are global
+        foldList(&id);
+    }
+    arenaRelease(&optArena, mark);
+    return id;
+}
+
+OptStats optStats(void) {
+    return stats;
+}
+
+void showOptStats(void) {
+    printf("Optimizer: %d expressions folded, %d variables replaced with constants, %d constant conditions\n",
+        stats.folded, stats.propagated, stats.branches);
+}
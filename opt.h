@@ -0,0 +1,23 @@
+#pragma once
+
+// The optimizations on the AST of a top-level item (see ast.h).
+// They are applied only if optLevel>0 (the -O option).
+extern int optLevel;
+
+// Evaluates at compile time the int and real expressions whose operands are known:
+// constants and, in functions, the local variables and arguments with a known value.
+// The values are propagated through the straight-line code and through the if and while instructions,
+// and the if and while instructions with constant conditions are replaced with the executed code.
+// The expressions with side effects (assignments and calls) are never removed.
+// Returns the new root of the item: an instruction of the global code can become
+// a list of instructions or it can disappear (0).
+int foldConstants(int id);
+
+typedef struct{
+    int folded;         // the expressions replaced with their value
+    int propagated;     // the variables replaced with their known value
+    int branches;       // the if and while instructions with constant conditions
+}OptStats;
+
+OptStats optStats(void);
+void showOptStats(void);
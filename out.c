@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "out.h"
+#include "utils.h"
+
+#define MAX_CHUNKS 64       // the chunks written by a single writev (it must be <= IOV_MAX)
+
+static struct iovec chunks[MAX_CHUNKS];
+static int nChunks;
+static size_t pending;      // the number of bytes in chunks
+static int fd = -1;
+static bool toMemory;
+static char *mem;           // the memory output
+static size_t memN, memCap;
+
+static size_t nBytes, nAppended, nCalls, maxPending;
+
+static void resetOutput(void) {
+    closeOutput();
+    free(mem);
+    mem = NULL;
+    memN = memCap = 0;
+    toMemory = false;
+    nBytes = nAppended = nCalls = maxPending = 0;
+}
+
+void openOutput(const char *path) {
+    resetOutput();
+    if (!path || !strcmp(path, "-")) {
+        // the code is written to a copy of stdout, and the messages of the compiler (printf) go to stderr,
+        // so stdout has only the code, which can be piped to the C compiler
+        fflush(stdout);
+        fd = dup(STDOUT_FILENO);
+        if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) err("cannot redirect stdout: %s", strerror(errno));
+        return;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) err("cannot write to file %s: %s", path, strerror(errno));
+}
+
+void openMemoryOutput(void) {
+    resetOutput();
+    toMemory = true;
+}
+
+void outAppend(const char *p, size_t n) {
+    if (!n) return;
+    if (nChunks == MAX_CHUNKS) outFlush();
+    chunks[nChunks].iov_base = (void *)p;
+    chunks[nChunks++].iov_len = n;
+    pending += n;
+    nAppended++;
+    if (pending > maxPending) maxPending = pending;
+}
+
+static void writeMemory(void) {
+    if (memN + pending > memCap) {
+        size_t cap = memCap ? memCap * 2 : 65536;
+        while (cap < memN + pending) cap *= 2;
+        char *p = (char *)realloc(mem, cap);
+        if (!p) err("not enough memory");
+        mem = p;
+        memCap = cap;
+    }
+    for (int i = 0; i < nChunks; i++) {
+        memcpy(mem + memN, chunks[i].iov_base, chunks[i].iov_len);
+        memN += chunks[i].iov_len;
+    }
+}
+
+static void writeFile(void) {
+    struct iovec *iov = chunks;
+    int n = nChunks;
+    while (n) {
+        ssize_t k = writev(fd, iov, n);
+        nCalls++;
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            err("cannot write the output: %s", strerror(errno));
+        }
+        // skips the written chunks and, after a partial write, the written part of the next one
+        for (; n && (size_t)k >= iov->iov_len; iov++, n--) k -= iov->iov_len;
+        if (n) {
+            iov->iov_base = (char *)iov->iov_base + k;
+            iov->iov_len -= k;
+        }
+    }
+}
+
+void outFlush(void) {
+    if (!nChunks) return;
+    if (toMemory) writeMemory();
+    else if (fd >= 0) writeFile();
+    else err("the output is not opened");
+    nBytes += pending;
+    nChunks = 0;
+    pending = 0;
+}
+
+void closeOutput(void) {
+    outFlush();
+    if (fd > STDERR_FILENO) close(fd);
+    fd = -1;
+}
+
+const char *outputMemory(size_t *n) {
+    *n = memN;
+    return mem;
+}
+
+void showOutputStats(void) {
+    printf("Output: %zu bytes in %zu chunks, %zu writev calls, max %zu bytes waiting to be written\n",
+        nBytes, nAppended, nCalls, maxPending);
+}
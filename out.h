@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+// The generated code is written through a list of chunks, which are written all at once with writev.
+// The chunks are not copied, so their chars must remain unchanged until the next outFlush.
+// The destination can be a file, stdout or a memory buffer.
+
+// Writes the output in the file with the given path. path==NULL or "-" writes to stdout;
+// then the messages printed on stdout are sent to stderr, so they are not mixed with the code.
+void openOutput(const char *path);
+
+// Accumulates the output in a memory buffer (see outputMemory).
+void openMemoryOutput(void);
+
+// Adds n chars from p at the end of the output.
+void outAppend(const char *p, size_t n);
+
+// Writes all the added chunks.
+void outFlush(void);
+
+// Flushes the output and closes its file.
+void closeOutput(void);
+
+// Returns the chars written in the memory output and puts their number in *n.
+// The buffer remains valid until the next openOutput or openMemoryOutput.
+const char *outputMemory(size_t *n);
+
+// Shows the number of written bytes, chunks and system calls, and the max number of bytes waiting to be written.
+void showOutputStats(void);
@@ -2,14 +2,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include "lexer.h"
 #include "ad.h"
-#include "ad.h"
 #include "gen.h"
-
-int iTk, blockDepth = 0;   // iterator in tokens
+#include "out.h"
+#include "ast.h"
+#include "opt.h"
+#include "ir.h"
+#include "prune.h"
+#include "inliner.h"
+#include "memo.h"
+#include "vm.h"
+#include "asm.h"
+#include "llvm.h"
+#include "exec.h"
+#include "parser.h"
+
+// The parser is predictive: each rule chooses its alternative only from the current token
+// and, for the assignments, from the next one. So it never returns to an already consumed token.
+// The rules build the AST of each top-level item (see ast.h) and put its root in ret.node.
+// When an item is complete, its C code is generated from the AST.
+
+int blockDepth = 0;
 Token *consumed;   // last consumed token
+static Token consumedTk;   // a copy of the last consumed token, because the window can overwrite it
+static ParserStats stats;
+FILE *astDump;
 
 // Domain management
 extern Domain *symTable;
@@ -20,11 +40,8 @@ bool funcParam();
 bool block();
 bool instr();
 bool expr();
-bool exprLogic();
 bool exprAssign();
-bool exprComp();
-bool exprAdd();
-bool exprMul();
+bool exprBin(int minBp);
 bool exprPrefix();
 bool factor();
 bool defVar();
@@ -34,7 +51,7 @@ void removeDomainIfNeeded();
 
 // Same as err, but also prints the line of the current token
 _Noreturn void tkerr(const char *fmt, ...) {
-    fprintf(stderr, "error in line %d: ", tokens[iTk].line);
+    fprintf(stderr, "error in line %d: ", peekTk(0)->line);
     va_list va;
     va_start(va, fmt);
     vfprintf(stderr, fmt, va);
@@ -43,14 +60,109 @@ _Noreturn void tkerr(const char *fmt, ...) {
     exit(EXIT_FAILURE);
 }
 
+// returns the code of the k-th token after the current one (k<=1)
+static int peek(int k) {
+    stats.peeks++;
+    return peekTk(k)->code;
+}
+
+// consumes the current token, which was already checked with peek
+static void take(void) {
+    consumedTk = *peekTk(0);
+    consumed = &consumedTk;
+    advanceTk();
+    stats.tokens++;
+}
+
 bool consume(int code) {
-    if (tokens[iTk].code == code) {
-        consumed = &tokens[iTk++];
+    if (peek(0) == code) {
+        take();
         return true;
     }
     return false;
 }
 
+// creates a new node and makes it the result of the current rule (ret.node)
+// the returned pointer is valid only until the next node is created
+static Node *retNode(int kind, int line) {
+    ret.node = newNode(kind, line);
+    return &nodes[ret.node];
+}
+
+// the same as retNode, for the expression which was just parsed: it also sets its type and l-value from ret
+static Node *exprNode(int kind, int line) {
+    Node *n = retNode(kind, line);
+    n->type = ret.type;
+    n->lval = ret.lval;
+    return n;
+}
+
+// generates the code of a complete top-level item and deletes its AST
+static void compileItem(int id) {
+    if (inlineBudget) id = inlineCalls(id);
+    if (optLevel) id = foldConstants(id);
+    if (!id) {
+        resetAst();
+        return;
+    }
+    if (nodes[id].kind == N_FN) addInlinable(id);
+    if (astDump) dumpAst(astDump, id);
+    if (vmMode) {
+        compileBytecode(id);
+        resetAst();
+        return;
+    }
+    int kind = nodes[id].kind;
+    Text *code = kind == N_FN ? &tFunctions : kind == N_VARDEF ? &tBegin : &tMain;
+    size_t start = code->n;
+    if (pruning && code == &tMain) addRoots(id);
+    bool memo = memoize && kind == N_FN && addPure(id);
+    if (memo) genMemoBefore(code, id);
+    if (llvmMode) {
+        // LLVM builds its own SSA form, so the code is generated from the AST
+        genLlvmItem(id);
+    } else if ((optLevel >= 2 || asmMode) && kind != N_VARDEF) {
+        // the assembly is always generated from the optimized IR
+        buildIr(id);
+        optimizeIr();
+        if (irDump) dumpIr(irDump, id);
+        double t0 = passStart();
+        if (asmMode) genAsmItem(id);
+        else genIrItem(id);
+        passEnd(P_EMIT, t0);
+        resetIr();
+    } else if (asmMode) {
+        genAsmItem(id);
+    } else {
+        genItem(id);
+    }
+    if (memo) genMemoAfter(code, id);
+    if (pruning && code != &tMain) {
+        // the item is written at the end of the program, only if it is used
+        keepItem(id, code->buf + start, code->n - start);
+        Text_truncate(code, start);
+    } else if (kind == N_FN) {
+        // the function is complete, so it is written now, after the global
+        // variables defined before it, and its buffer is reused for the next function
+        outAppend(tBegin.buf, tBegin.n);
+        outAppend(tFunctions.buf, tFunctions.n);
+        outFlush();
+        Text_clear(&tBegin);
+        Text_clear(&tFunctions);
+    }
+    resetAst();
+}
+
+// the tokens which can start an expression
+static bool startsExpr(int code) {
+    switch (code) {
+        case ID: case INT: case REAL: case STR: case LPAR: case SUB: case NOT:
+            return true;
+        default:
+            return false;
+    }
+}
+
 bool baseType(void) {
     // return consume(TYPE_INT) || consume(TYPE_REAL) || consume(TYPE_STR);
 
@@ -71,24 +183,32 @@ bool baseType(void) {
     return false;
 }
 
-bool defVar(void) {
-    int start = iTk;
+// the names which start with __q_ are reserved for the generated C code (see memo.h)
+static void checkName(const char *name) {
+    if (!strncmp(name, "__q_", 4)) tkerr("The names which start with __q_ are reserved: %s\n", name);
+}
 
+bool defVar(void) {
     if (consume(VAR)) {
+        int line = consumed->line;
         if (consume(ID)) {
-            const char *name = consumed->text;
+            const char *name = consumed->name;
             Symbol *s = searchInCurrentDomain(name);
             if (s)
                 tkerr("Symbol redefinition: %s\n", name);
+            checkName(name);
             s = addSymbol(name, KIND_VAR);
             s->local = crtFn != NULL;
 
             if (consume(COLON)) {
-                s->type = ret.type;
-
                 if (baseType()) {
+                    s->type = ret.type;
+
                     if (consume(SEMICOLON)) {
-                        Text_write(crtVar, "%s %s;\n", cType(s->type), s->name);
+                        Node *n = retNode(N_VARDEF, line);
+                        n->name = name;
+                        n->type = s->type;
+                        n->local = s->local;
 
                         return true;
                     } tkerr("Expected ';' after variable declaration");
@@ -97,327 +217,271 @@ bool defVar(void) {
         } tkerr("Expected variable name after 'VAR'");
     }
 
-    iTk = start;
     return false;
 }
 
+// factor ::= INT | REAL | STR | LPAR expr RPAR | ID ( LPAR ( expr ( COMMA expr )* )? RPAR )?
 bool factor(void) {
-    if (consume(INT)) {
-        Text_write(crtCode, "%d", consumed->i);
-        setRet(TYPE_INT, false); // INT is not an l-value
-        return true;
-    }
-
-    if (consume(REAL)) {
-        Text_write(crtCode, "%g", consumed->r);
-        setRet(TYPE_REAL, false); // REAL is not an l-value
-        return true;
-    }
-
-    if (consume(STR)) {
-        Text_write(crtCode,"\"%s\"",consumed->text);
-        setRet(TYPE_STR, false); // STR is not an l-value
-        return true;
-    }
+    switch (peek(0)) {
+        case INT:
+            take();
+            setRet(TYPE_INT, false); // INT is not an l-value
+            exprNode(N_INT, consumed->line)->i = consumed->i;
+            return true;
 
-    if (consume(LPAR)) {
-        Text_write(crtCode, "(");
-        if (expr()) {
-            if (consume(RPAR)) {
-                Text_write(crtCode, ")");
-                return true; // Successfully parsed ( expr )
-            } tkerr("Expected closing parenthesis");
-        } tkerr("Invalid expression inside parentheses");
-    }
+        case REAL:
+            take();
+            setRet(TYPE_REAL, false); // REAL is not an l-value
+            exprNode(N_REAL, consumed->line)->r = consumed->r;
+            return true;
 
-    if (consume(ID)) {
-        const Symbol *s = searchSymbol(consumed->text);
-        if (!s) {
-            tkerr("Undefined symbol: %s", consumed->text);
+        case STR: {
+            take();
+            setRet(TYPE_STR, false); // STR is not an l-value
+            Node *n = exprNode(N_STR, consumed->line);
+            n->pos = consumed->pos;
+            n->len = consumed->len;
+            return true;
         }
 
-        Text_write(crtCode, "%s", s->name);
-
-        if (consume(LPAR)) {
-            // Function call logic
-            Text_write(crtCode, "(");
-            if (s->kind != KIND_FN) {
-                tkerr("Symbol is not a function: %s", consumed->text);
-            }
-
-            const Symbol *arg = s->args;
-            if (consume(RPAR)) {
-                if (arg) {
-                    tkerr("Too few arguments in function call: %s", s->name);
-                }
-                Text_write(crtCode, ")");
-                setRet(s->type, false); // Function call returns its type
-                return true;
-            }
-
-            bool firstArgument = true;
-            do {
-
-                if (!firstArgument) {
-                    Text_write(crtCode, ",");
-                }
-                firstArgument = false;
-
-                if (!expr()) {
-                    tkerr("Invalid argument in function call");
-                }
-
-                if (!arg) {
-                    tkerr("Too many arguments in function call: %s", s->name);
-                }
-                if (arg->type != ret.type) {
-                    tkerr("Argument type mismatch in function call: %s", s->name);
-                }
-
-                arg = arg->next;
-            } while (consume(COMMA));
+        case LPAR: {
+            take();
+            int line = consumed->line;
+            if (expr()) {
+                if (consume(RPAR)) {
+                    int a = ret.node;
+                    exprNode(N_PAREN, line)->a = a;
+                    return true; // Successfully parsed ( expr )
+                } tkerr("Expected closing parenthesis");
+            } tkerr("Invalid expression inside parentheses");
+        }
 
-            if (consume(RPAR)) {
-                if (arg) {
-                    tkerr("Too few arguments in function call: %s", s->name);
-                }
-                Text_write(crtCode, ")");
-                setRet(s->type, false); // Function call returns its type
-                return true;
-            }
+        case ID:
+            break;
 
-            tkerr("Expected closing parenthesis after function call");
-        }
+        default:
+            return false; // No valid `factor` matched
+    }
 
+    take();
+    int line = consumed->line;
+    const Symbol *s = searchSymbol(consumed->name);
+    if (!s) {
+        tkerr("Undefined symbol: %s", consumed->name);
+    }
 
+    if (!consume(LPAR)) {
         // Handle cases where ID is not followed by LPAR
         if (s->kind == KIND_FN) {
             tkerr("The function %s can only be called", s->name);
         }
         setRet(s->type, true); // Variables can be l-values
+        Node *n = exprNode(N_VAR, line);
+        n->name = s->name;
+        n->local = s->kind == KIND_ARG || s->local;
         return true;
     }
 
+    // Function call logic
+    if (s->kind != KIND_FN) {
+        tkerr("Symbol is not a function: %s", s->name);
+    }
 
-    return false; // No valid `factor` matched
-}
-
-
-// exprPrefix ::= ( SUB | NOT )? factor
-bool exprPrefix() {
-    if (consume(SUB)) {
-        Text_write(crtCode, "-");
-
-        if (!factor()) {
-            tkerr("Expected expression after unary operator");
-        }
+    int iArg = 0;   // the index of the current argument
+    int first = 0, last = 0;    // the list of arguments
+    if (peek(0) != RPAR) {
+        do {
+            if (!expr()) {
+                tkerr("Invalid argument in function call");
+            }
 
-        if (ret.type == TYPE_STR) {
-            tkerr("The operand of a unary operator must NOT be a string");
-        }
+            if (iArg == s->nArgs) {
+                tkerr("Too many arguments in function call: %s", s->name);
+            }
+            if (s->args[iArg].type != ret.type) {
+                tkerr("Argument type mismatch in function call: %s", s->name);
+            }
 
-        ret.lval = false;
-        return true;
+            appendNode(&first, &last, ret.node);
+            iArg++;
+        } while (consume(COMMA));
     }
 
-    if (consume(NOT)) {
-        Text_write(crtCode, "!");
-
-        if (!factor()) {
-            tkerr("Expected expression after unary operator");
+    if (consume(RPAR)) {
+        if (iArg < s->nArgs) {
+            tkerr("Too few arguments in function call: %s", s->name);
         }
-
-        if (ret.type == TYPE_STR) {
-            tkerr("The operand of a unary operator must NOT be a string");
-        }
-
-        setRet(TYPE_INT, false);
+        setRet(s->type, false); // Function call returns its type
+        Node *n = exprNode(N_CALL, line);
+        n->name = s->name;
+        n->a = first;
         return true;
     }
 
-    return factor();
+    tkerr("Expected closing parenthesis after function call");
 }
 
 
-bool exprMul() {
-    if (exprPrefix()) {
-        while (consume(MUL) || consume(DIV)) {
-            Ret leftType = ret;
-
-            if (leftType.type == TYPE_STR) {
-                tkerr("The left operand of a * or / must NOT be a string");
-            }
-
-            if (consume(MUL)) {
-                Text_write(crtCode, "*");
-            } else if (consume(DIV)) {
-                Text_write(crtCode, "/");
-            }
+// exprPrefix ::= ( SUB | NOT )? factor
+bool exprPrefix() {
+    switch (peek(0)) {
+        case SUB: {
+            take();
+            int line = consumed->line;
 
-            if (!exprPrefix()) {
-                tkerr("Invalid expression after * or /");
+            if (!factor()) {
+                tkerr("Expected expression after unary operator");
             }
 
-            if (leftType.type != ret.type) {
-                tkerr("Type mismatch in multiplication or division");
+            if (ret.type == TYPE_STR) {
+                tkerr("The operand of a unary operator must NOT be a string");
             }
 
             ret.lval = false;
+            int a = ret.node;
+            exprNode(N_NEG, line)->a = a;
+            return true;
         }
-        return true;
-    }
-    return false;
-}
 
-bool exprAdd() {
-    if (exprMul()) {
-        while (true) {
-            Ret leftType = ret;
-
-            if (leftType.type == TYPE_STR) {
-                // tkerr("The left operand of a + or - must NOT be a string");
-            }
-
-            // Check which operator is consumed
-            if (consume(ADD)) {
-                Text_write(crtCode, "+");
-            } else if (consume(SUB)) {
-                Text_write(crtCode, "-");
-            } else {
-                break; // Exit loop if no operator is consumed
-            }
+        case NOT: {
+            take();
+            int line = consumed->line;
 
-            if (!exprMul()) {
-                tkerr("Expected expression after '+' or '-'");
+            if (!factor()) {
+                tkerr("Expected expression after unary operator");
             }
 
-            if (leftType.type != ret.type) {
-                tkerr("Type mismatch in addition or subtraction");
+            if (ret.type == TYPE_STR) {
+                tkerr("The operand of a unary operator must NOT be a string");
             }
 
-            ret.lval = false;
+            setRet(TYPE_INT, false);
+            int a = ret.node;
+            exprNode(N_NOT, line)->a = a;
+            return true;
         }
-        return true;
+
+        default:
+            return factor();
     }
-    return false;
 }
 
 
-bool exprComp(void) {
-    // Parse the first operand
-    if (exprAdd()) {
-        Ret leftType = ret; // Store the type of the left operand
-
-        if (consume(LESS)) {
-            Text_write(crtCode, "<");
-        } else if (consume(GREATER)) {
-            Text_write(crtCode, ">");
-        } else if (consume(EQUAL)) {
-            Text_write(crtCode, "==");
-        } else if (consume(LESSEQ)) {
-            Text_write(crtCode, "<=");
-        } else if (consume(GREATEREQ)) {
-            Text_write(crtCode, ">=");
-        } else if (consume(NOTEQ)) {
-            Text_write(crtCode, "!=");
-        } else {
-            return true; // No operator means this is just an exprAdd
+// The binary operators are parsed by precedence climbing: exprBin parses the operands
+// and the operators which bind at least as strong as minBp, so an expression needs
+// a single exprBin frame for each operator, instead of a frame for each precedence level.
+
+// the type rules of the binary operators
+typedef struct{
+    bool noStr;                 // the operands must NOT be strings
+    bool sameType;              // the operands must have the same type
+    bool intResult;             // the result is TYPE_INT, not the type of the left operand
+    const char *strLeft;        // the error when the left operand is a string
+    const char *strRight;       // the error when the right operand is a string
+    const char *missing;        // the error when the right operand is missing
+    const char *mismatch;       // the error when the types of the operands are different
+}OpRule;
+
+static const OpRule ruleMul = {true, true, false, "The left operand of a * or / must NOT be a string",
+    "The right operand of a * or / must NOT be a string", "Invalid expression after * or /",
+    "Type mismatch in multiplication or division"};
+static const OpRule ruleAdd = {false, true, false, NULL, NULL, "Expected expression after '+' or '-'",
+    "Type mismatch in addition or subtraction"};
+static const OpRule ruleComp = {false, true, true, NULL, NULL, "Expected expression after comparison operator",
+    "Type mismatch in comparison"};
+static const OpRule ruleLogic = {true, false, true, "The left operand of a logical operator must NOT be a string",
+    "The right operand of a logical operator must NOT be a string", "Expected expression after logical operator", NULL};
+
+typedef struct{
+    int bp;                 // binding power; 0 for the tokens which are not binary operators
+    bool nonAssoc;          // a op b op c is an error
+    const char *c;          // the C operator
+    const OpRule *rule;
+}BinOp;
+
+static const BinOp binOps[STR + 1] = {
+    [OR] = {1, false, "||", &ruleLogic},
+    [AND] = {2, false, "&&", &ruleLogic},
+    [LESS] = {3, true, "<", &ruleComp},
+    [GREATER] = {3, true, ">", &ruleComp},
+    [EQUAL] = {3, true, "==", &ruleComp},
+    [LESSEQ] = {3, true, "<=", &ruleComp},
+    [GREATEREQ] = {3, true, ">=", &ruleComp},
+    [NOTEQ] = {3, true, "!=", &ruleComp},
+    [ADD] = {4, false, "+", &ruleAdd},
+    [SUB] = {4, false, "-", &ruleAdd},
+    [MUL] = {5, false, "*", &ruleMul},
+    [DIV] = {5, false, "/", &ruleMul},
+};
+
+// exprBin ::= exprPrefix ( binOp exprBin )*
+// with the operators from binOps: OR < AND < comparisons < ADD,SUB < MUL,DIV
+bool exprBin(int minBp) {
+    if (!exprPrefix()) return false;
+    while (true) {
+        const BinOp *op = &binOps[peek(0)];
+        if (!op->bp || op->bp < minBp) return true;
+        take();
+        int line = consumed->line, code = consumed->code;
+        const OpRule *rule = op->rule;
+        Ret left = ret;
+
+        if (rule->noStr && left.type == TYPE_STR) {
+            tkerr("%s", rule->strLeft);
         }
 
-        // Parse the second operand
-        if (!exprAdd()) {
-            tkerr("Expected expression after comparison operator");
+        if (!exprBin(op->bp + 1)) {
+            tkerr("%s", rule->missing);
         }
 
-        // Type check
-        if (leftType.type != ret.type) {
-            tkerr("Type mismatch in comparison");
+        if (rule->noStr && ret.type == TYPE_STR) {
+            tkerr("%s", rule->strRight);
         }
-
-        setRet(TYPE_INT, false); // Comparison returns TYPE_INT
-        return true; // Successfully parsed a comparison expression
-    }
-    return false; // Failed to parse a comparison expression
-}
-
-bool exprAssign() {
-    int start = iTk;
-    if (consume(ID)) {
-        const char *name = consumed->text;
-
-        if (consume(ASSIGN)) {
-            Text_write(crtCode, "%s=", name);
-
-            if (exprComp()) {
-                Symbol *s = searchSymbol(name);
-                if (!s)
-                    tkerr("Undefined symbol: %s\n", name);
-                if (s->kind == KIND_FN)
-                    tkerr("Cannot assign to function: %s\n", name);
-                if (s->type != ret.type)
-                    tkerr("Type mismatch in assignment to symbol: %s\n", name);
-                ret.lval = false;
-
-                return true;
-            }
-            tkerr("Expected expression after '='");
+        if (rule->sameType && left.type != ret.type) {
+            tkerr("%s", rule->mismatch);
         }
-    }
 
-    iTk = start;
-    return exprComp();
-}
+        int b = ret.node;
+        setRet(rule->intResult ? TYPE_INT : left.type, false);
+        Node *n = exprNode(N_BIN, line);
+        n->op = code;
+        n->a = left.node;
+        n->b = b;
 
-// exprCompLogical ::= exprAdd ( ( LESS | EQUAL | GREATER | LESS_EQUAL | GREATER_EQUAL | NOT_EQUAL ) exprAdd )?
-bool exprCompLogical(void) {
-    if (exprAdd()) {
-        // Check for all comparison operators
-        if (consume(LESS) || consume(EQUAL) || consume(GREATEREQ) ||
-            consume(LESSEQ) || consume(GREATEREQ) || consume(NOTEQ) || consume(LESSEQ) || consume(NOTEQ)) {
-            if (!exprAdd()) {
-                tkerr("Expected expression after comparison operator");
-            }
-            Text_write(crtCode, " %s ", consumed->text);
+        if (op->nonAssoc && binOps[peek(0)].bp == op->bp) {
+            tkerr("The result of %s cannot be an operand of the same kind of operator", op->c);
         }
-
-        printf("Current token: %d\n", tokens[iTk].code);
-
-        return true;
     }
-
-    return false;
 }
 
-// exprLogical ::= exprCompLogical ( ( AND | OR ) exprCompLogical )*
-bool exprLogical() {
-    // Parse the first operand
-    if (exprCompLogical()) {
-        // Continue parsing logical operators and their right-hand operands
-        while (consume(AND) || consume(OR)) {
-            // Store the type of the left operand
-            Ret leftType = ret;
-
-            // Ensure the left operand is not a string
-            if (leftType.type == TYPE_STR) {
-                tkerr("The left operand of a logical operator must NOT be a string");
-            }
-
-            // Parse the right-hand operand
-            if (!exprCompLogical()) {
-                tkerr("Expected expression after logical operator");
-            }
-
-            // Ensure the right operand is not a string
-            if (ret.type == TYPE_STR) {
-                tkerr("The right operand of a logical operator must NOT be a string");
-            }
+// exprAssign ::= ID ASSIGN exprBin | exprBin
+// An ID starts both alternatives, so the assignment is chosen only if the next token is ASSIGN.
+bool exprAssign() {
+    if (peek(0) != ID || peek(1) != ASSIGN) return exprBin(1);
+
+    take();
+    const char *name = consumed->name;
+    int line = consumed->line;
+    take();     // ASSIGN
+
+    if (exprBin(1)) {
+        Symbol *s = searchSymbol(name);
+        if (!s)
+            tkerr("Undefined symbol: %s\n", name);
+        if (s->kind == KIND_FN)
+            tkerr("Cannot assign to function: %s\n", name);
+        if (s->type != ret.type)
+            tkerr("Type mismatch in assignment to symbol: %s\n", name);
+        ret.lval = false;
+        int a = ret.node;
+        Node *n = exprNode(N_ASSIGN, line);
+        n->name = s->name;
+        n->local = s->kind == KIND_ARG || s->local;
+        n->a = a;
 
-            // Logical operations result in an integer type
-            setRet(TYPE_INT, false);
-        }
-        return true; // Successfully parsed a logical expression
+        return true;
     }
-    return false; // Failed to parse a logical expression
+    tkerr("Expected expression after '='");
 }
 
 bool expr(void) {
@@ -426,134 +490,166 @@ bool expr(void) {
 
 // instr ::= expr? SEMICOLON | IF LPAR expr RPAR block ( ELSE block )? END | RETURN expr SEMICOLON | WHILE LPAR expr RPAR block END
 bool instr(void) {
-    if (consume(SEMICOLON)) {
-        Text_write(crtCode, ";\n");
-        return true;
-    }
-
-    if (expr()) {
-        if (consume(SEMICOLON)) {
-            Text_write(crtCode, ";\n");
+    int code = peek(0);
+    switch (code) {
+        case SEMICOLON:
+            take();
+            ret.node = newNode(N_EMPTY, consumed->line);
             return true;
-        }
-        tkerr("Missing semicolon after instr");
-    }
-
-    if (consume(IF)) {
-        if (consume(LPAR)) {
-            Text_write(crtCode, "if(");
-
-            if (expr()) {
-                if (!crtFn)
-                    tkerr("IF statement outside function");
-                if (ret.type != crtFn->type)
-                    tkerr("IF statement type mismatch");
 
-                if (consume(RPAR)) {
-                    Text_write(crtCode, "){\n");
-
-                    if (block()) {
-                        Text_write(crtCode, "}\n");
-                        if (consume(ELSE)) {
-                            Text_write(crtCode, "else{\n");
-                            if (!block()) {
-                                return false;
+        case IF: {
+            take();
+            int line = consumed->line;
+            if (consume(LPAR)) {
+                if (expr()) {
+                    if (!crtFn)
+                        tkerr("IF statement outside function");
+                    if (ret.type != crtFn->type)
+                        tkerr("IF statement type mismatch");
+                    int cond = ret.node;
+
+                    if (consume(RPAR)) {
+                        if (block()) {
+                            int thenBlock = ret.node, elseBlock = 0;
+                            if (consume(ELSE)) {
+                                if (!block()) {
+                                    tkerr("Expected block after ELSE");
+                                }
+                                elseBlock = ret.node;
+                            }
+                            if (consume(END)) {
+                                Node *n = retNode(N_IF, line);
+                                n->a = cond;
+                                n->b = thenBlock;
+                                n->c = elseBlock;
+                                return true;
+                            } else {
+                                tkerr("Missing END in IF statement");
                             }
-                            Text_write(crtCode, "}\n");
-                        }
-                        if (consume(END)) {
-                            return true;
                         } else {
-                            tkerr("Missing END in IF statement");
+                            tkerr("Expected block after IF condition");
                         }
                     } else {
-                        tkerr("Expected block after IF condition");
+                        tkerr("Expected ')' after IF condition");
                     }
                 } else {
-                    tkerr("Expected ')' after IF condition");
+                    tkerr("Expected expression in IF condition");
                 }
             } else {
-                tkerr("Expected expression in IF condition");
+                tkerr("Expected '(' after IF");
             }
-        } else {
-            tkerr("Expected '(' after IF");
         }
-    }
-
-    if (consume(RETURN)) {
-        Text_write(crtCode, "return ");
-        if (expr()) {
-            if (consume(SEMICOLON)) {
-                Text_write(crtCode, ";\n");
 
-                return true;
-            } tkerr("RETURN statement missing semicolon");
-        } tkerr("RETURN statement missing expression");
-    }
+        case RETURN: {
+            take();
+            int line = consumed->line;
+            if (expr()) {
+                if (consume(SEMICOLON)) {
+                    int a = ret.node;
+                    Node *n = retNode(N_RETURN, line);
+                    n->a = a;
+                    // return f(...) in the function f is a tail call, which is generated as a jump
+                    // to the start of f, after its arguments are assigned to the parameters
+                    while (nodes[a].kind == N_PAREN) a = nodes[a].a;
+                    if (crtFn && nodes[a].kind == N_CALL && nodes[a].name == crtFn->name) {
+                        n->tail = true;
+                        stats.tailCalls++;
+                    }
 
-    if (consume(WHILE)) {
-        Text_write(crtCode, "while(");
+                    return true;
+                } tkerr("RETURN statement missing semicolon");
+            } tkerr("RETURN statement missing expression");
+        }
 
-        if (consume(LPAR)) {
-            if (expr()) {
-                if (ret.type == TYPE_STR)
-                    tkerr("the while condition must NOT be a string");
+        case WHILE: {
+            take();
+            int line = consumed->line;
 
-                if (consume(RPAR)) {
-                    Text_write(crtCode, "){\n");
+            if (consume(LPAR)) {
+                if (expr()) {
+                    if (ret.type == TYPE_STR)
+                        tkerr("the while condition must NOT be a string");
+                    int cond = ret.node;
 
-                    if (block()) {
-                        if (consume(END)) {
-                            Text_write(crtCode, "}\n");
-                            return true;
+                    if (consume(RPAR)) {
+                        if (block()) {
+                            if (consume(END)) {
+                                int body = ret.node;
+                                Node *n = retNode(N_WHILE, line);
+                                n->a = cond;
+                                n->b = body;
+                                return true;
+                            } else {
+                                tkerr("Missing END in WHILE loop");
+                            }
                         } else {
-                            tkerr("Missing END in WHILE loop");
+                            tkerr("Expected block after WHILE condition");
                         }
                     } else {
-                        tkerr("Expected block after WHILE condition");
+                        tkerr("Expected ')' after WHILE condition");
                     }
                 } else {
-                    tkerr("Expected ')' after WHILE condition");
+                    tkerr("Expected expression in WHILE condition");
                 }
             } else {
-                tkerr("Expected expression in WHILE condition");
+                tkerr("Expected '(' after WHILE");
             }
-        } else {
-            tkerr("Expected '(' after WHILE");
         }
-    }
 
-    return false;
+        default: {
+            if (!startsExpr(code)) return false;
+            int line = peekTk(0)->line;
+            expr();
+            if (consume(SEMICOLON)) {
+                int a = ret.node;
+                retNode(N_EXPR, line)->a = a;
+                return true;
+            }
+            tkerr("Missing semicolon after instr");
+        }
+    }
 }
 
 // block ::= instr+
+// ret.node is the first instruction of the list
 bool block(void) {
-    if (instr()) {
-        while (instr()) {}
-
-        return true;
+    int first = 0, last = 0;
+    bool returned = false;
+    while (instr()) {
+        if (returned && pruning) {
+            // the instructions after a return are checked, but they are not kept
+            addUnreachable(1);
+            continue;
+        }
+        appendNode(&first, &last, ret.node);
+        returned = nodes[ret.node].kind == N_RETURN;
     }
-
-    return false;
+    ret.node = first;
+    return first != 0;
 }
 
 // funcParam ::= ID COLON baseType
 bool funcParam(void) {
     if (consume(ID)) {
-        const char *name = consumed->text;
+        const char *name = consumed->name;
+        int line = consumed->line;
         Symbol *s = searchInCurrentDomain(name);
         if (s)
             tkerr("Symbol redefinition: %s\n", name);
+        checkName(name);
         s = addSymbol(name, KIND_ARG);
         Symbol *sFnParam = addFnArg(crtFn, name);
 
         if (consume(COLON)) {
             if (baseType()) {
-                Text_write(&tFnHeader, "%s %s", cType(ret.type), name);
-
                 s->type = ret.type;
                 sFnParam->type = ret.type;
 
+                Node *n = retNode(N_VARDEF, line);
+                n->name = name;
+                n->type = ret.type;
+                n->local = true;
+
                 return true;
             } tkerr("Expected base type after ':' in parameter definition");
         } tkerr("Expected ':' after parameter name");
@@ -561,72 +657,67 @@ bool funcParam(void) {
     return false;
 }
 
+// funcParams ::= ( funcParam ( COMMA funcParam )* )?
+// ret.node is the first parameter of the list
 bool funcParams(void) {
+    int first = 0, last = 0;
     if (funcParam()) {
-        while (1) {
-            if (consume(COMMA)) {
-                Text_write(&tFnHeader, ",");
-                if (!funcParam()) {
-                    tkerr("Expected parameter after comma");
-                }
-            } else {
-                break;
+        appendNode(&first, &last, ret.node);
+        while (consume(COMMA)) {
+            if (!funcParam()) {
+                tkerr("Expected parameter after comma");
             }
+            appendNode(&first, &last, ret.node);
         }
-        return true;
     }
-
+    ret.node = first;
     return true;
 }
 
 bool defFunc(void) {
-    const int start = iTk;
-
     if (consume(FUNCTION)) {
+        int line = consumed->line;
         if (consume(ID)) {
-            const char *name = consumed->text;
-
-            crtCode = &tFunctions;
-            crtVar = &tFunctions;
-            Text_clear(&tFnHeader);
-            Text_write(&tFnHeader, "%s(", name);
+            const char *name = consumed->name;
 
             const Symbol *s = searchInCurrentDomain(name);
             if (s)
                 tkerr("Symbol redefinition: %s\n", name);
+            checkName(name);
             crtFn = addSymbol(name, KIND_FN);
-            crtFn->args = NULL;
             addDomain();
 
             if (consume(LPAR)) {
-                if (funcParams()) {
-                    if (!consume(RPAR)) {
-                        // Ensure we have a closing parenthesis
-                        tkerr("Expected ')' after function parameters");
-                    }
+                funcParams();
+                int args = ret.node;
+                if (!consume(RPAR)) {
+                    // Ensure we have a closing parenthesis
+                    tkerr("Expected ')' after function parameters");
                 }
 
                 if (consume(COLON)) {
                     // Check for the colon after the parameters
                     if (baseType()) {
-                        Text_write(&tFunctions, "\n%s %s){\n", cType(ret.type), tFnHeader.buf);
-
                         crtFn->type = ret.type;
 
-                        // Ensure there is a valid return type
                         // Parse variable definitions and the block body
+                        int locals = 0, lastLocal = 0;
                         while (defVar()) {
+                            appendNode(&locals, &lastLocal, ret.node);
                         }
                         if (block()) {
                             if (consume(END)) {
-                                Text_write(&tFunctions, "}\n");
-                                crtCode = &tMain;
-                                crtVar = &tBegin;
+                                int body = ret.node;
+                                Node *n = retNode(N_FN, line);
+                                n->name = name;
+                                n->type = crtFn->type;
+                                n->a = args;
+                                n->b = locals;
+                                n->c = body;
 
                                 delDomain();
                                 crtFn = NULL;
 
-                                // Ensure we have the END keyword
                                 return true;
                             } tkerr("Expected 'END' after function body");
                         }
@@ -642,47 +733,98 @@ bool defFunc(void) {
         tkerr("Expected function name after 'FUNCTION'");
     }
 
-    iTk = start;
     return false;
 }
 
 
 // program ::= ( defVar | defFunc | block )* FINISH
+// each global variable, function and instruction of the global code is compiled as soon as it is parsed
 bool program() {
     addDomain();
 
     addPredefinedFns();
+    resetInliner();
+    resetMemo();
+    resetPrune();
+    if (vmMode) resetVm();
+
+    if (llvmMode) {
+        genLlvmHeader(&tBegin);
+    } else if (asmMode) {
+        genAsmHeader(&tBegin, &tMain);
+    } else if (!vmMode) {
+        // the VM generates no code, so its programs leave nothing in tBegin and tMain for the next ones
+        Text_lit(&tBegin, "#include \"quick.h\"\n\n");
+        if (memoize) genMemoHeader(&tBegin);
+        // exec builds the program with hidden symbols, so main is the only one which is exported
+        if (execMode) Text_lit(&tMain, "\n__attribute__((visibility(\"default\"))) int main(){\n");
+        else Text_lit(&tMain, "\nint main(){\n");
+    }
 
-    crtCode = &tMain;
-    crtVar = &tBegin;
-    Text_write(&tBegin, "#include \"quick.h\"\n\n");
-    Text_write(&tMain, "\nint main(){\n");
+    for (;;) {
+        switch (peek(0)) {
+            case VAR:
+                defVar();
+                compileItem(ret.node);
+                break;
+            case FUNCTION:
+                defFunc();
+                compileItem(ret.node);
+                break;
+            case FINISH:
+                take();
+                delDomain();
+                if (vmMode) {
+                    runVm();
+                    return true;
+                }
 
-    while (defVar() || defFunc() || block()) {
-    }
-    if (consume(FINISH)) {
-        delDomain();
-
-        Text_write(&tMain,"return 0;\n}\n");
-        FILE *fis=fopen("./test/1.c","w");
-        if(!fis){
-            printf("cannot write to file 1.c\n");
-            exit(EXIT_FAILURE);
-        }
-        fwrite(tBegin.buf,sizeof(char),tBegin.n,fis);
-        fwrite(tFunctions.buf,sizeof(char),tFunctions.n,fis);
-        fwrite(tMain.buf,sizeof(char),tMain.n,fis);
-        fclose(fis);
+                if (llvmMode) genLlvmEnd(&tMain);
+                else if (asmMode) genAsmEnd(&tMain);
+                else Text_lit(&tMain,"return 0;\n}\n");
+                if (pruning) {
+                    outAppend(tBegin.buf, tBegin.n);
+                    writeReachable();
+                    Text_clear(&tBegin);
+                }
+                outAppend(tBegin.buf, tBegin.n);
+                outAppend(tMain.buf, tMain.n);
+                outFlush();
+                Text_clear(&tBegin);
+                Text_clear(&tMain);
 
-        printf("Generated code\n");
+                // the output of exec is only the one of the program
+                if (!execMode) printf("Generated code\n");
 
-        return true;
+                return true;
+            default:
+                if (!instr()) tkerr("Missing FINISH at end of program");
+                compileItem(ret.node);
+        }
     }
+}
+
+ParserStats parserStats(void) {
+    return stats;
+}
 
-    tkerr("Missing FINISH at end of program");
+void showParserStats(void) {
+    ParserStats s = parserStats();
+    printf("Parser: %ld tokens, %ld lookups (%.2f per token), %d tail calls\n",
+        s.tokens, s.peeks, s.tokens ? (double)s.peeks / s.tokens : 0.0, s.tailCalls);
+}
+
+void parse(const char *input) {
+    startTokens(input);
+    program();
+}
+
+void parseSource(int (*next)(Token *tk)) {
+    startTokenSource(next);
+    program();
 }
 
-void parse() {
-    iTk = 0;
+void parseTokens(void) {
+    startTokensArray();
     program();
 }
@@ -1,4 +1,26 @@
 #pragma once
 
-// parse the extracted tokens
-void parse();
+#include <stdio.h>
+
+#include "lexer.h"
+
+// parse the input, pulling its tokens on demand from the lexer
+void parse(const char *input);
+
+// parse the tokens extracted by next (see startTokenSource from lexer.h)
+void parseSource(int (*next)(Token *tk));
+
+// parse the tokens from the tokens array (filled by tokenize or tokenizeParallel)
+void parseTokens(void);
+
+typedef struct{
+    long tokens;        // the consumed tokens
+    long peeks;         // how many times the parser looked at a token
+    int tailCalls;      // the returns of a call of the current function, generated as jumps
+}ParserStats;
+
+ParserStats parserStats(void);
+void showParserStats(void);
+
+// if not NULL, the AST of each top-level item is written in it (see dumpAst)
+extern FILE *astDump;
@@ -0,0 +1,300 @@
+#define _DEFAULT_SOURCE     // MAP_ANONYMOUS, MAP_NORESERVE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "pipeline.h"
+#include "lexer.h"
+#include "parser.h"
+#include "atoms.h"
+#include "utils.h"
+
+#define CHUNK_SIZE (1 << 20)    // the reader publishes chunks of at least this size
+#define BATCH_SIZE 4096         // nr of tokens in a batch
+#define QUEUE_SIZE 64           // power of 2
+#define PAGE 4096
+// all the chunks are placed in a single reserved region, so the STR tokens can keep
+// their position relative to its beginning; the positions have 32 bits
+#define REGION_SIZE ((size_t)1 << 32)
+
+// ---------------------------------------- SPSC queue
+
+// A lock-free queue with a single producer and a single consumer
+// head is written only by the consumer and tail only by the producer
+typedef struct {
+    void *items[QUEUE_SIZE];
+    _Atomic size_t head;        // the next item to pop
+    _Atomic size_t tail;        // the next free position
+} Queue;
+
+static bool tryPush(Queue *q, void *item) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&q->head, memory_order_acquire) == QUEUE_SIZE) return false;
+    q->items[tail & (QUEUE_SIZE - 1)] = item;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static void *tryPop(Queue *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire)) return NULL;
+    void *item = q->items[head & (QUEUE_SIZE - 1)];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return item;
+}
+
+// ---------------------------------------- stages statistics
+
+typedef struct {
+    const char *name;
+    double start, end;      // when the stage started and finished
+    double stall;           // the time spent waiting for a queue
+    size_t items;           // nr of published items (chunks, batches)
+} Stage;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the blocking operations spin for a while, then yield the CPU
+// the time spent here is counted as stall time of the stage
+static void push(Queue *q, void *item, Stage *stage) {
+    if (tryPush(q, item)) return;
+    double t0 = now();
+    for (int spins = 0; !tryPush(q, item); spins++) {
+        if (spins > 64) sched_yield();
+    }
+    stage->stall += now() - t0;
+}
+
+static void *pop(Queue *q, Stage *stage) {
+    void *item = tryPop(q);
+    if (item) return item;
+    double t0 = now();
+    for (int spins = 0; !(item = tryPop(q)); spins++) {
+        if (spins > 64) sched_yield();
+    }
+    stage->stall += now() - t0;
+    return item;
+}
+
+// ---------------------------------------- reader
+
+typedef struct {
+    const char *text;       // ends with '\0'
+    bool last;
+} Chunk;
+
+typedef struct {
+    int n;
+    bool last;      // the last batch ends with the final FINISH
+    Token tokens[BATCH_SIZE];
+} Batch;
+
+static char *region;
+static int inputFd;
+static const char *inputName;
+static Queue chunks;        // reader -> lexer
+static Queue batches;       // lexer -> parser
+static Queue freeBatches;   // parser -> lexer, to reuse the batches
+static Stage reader = {"reader"}, lexer = {"lexer"}, parser = {"parser"};
+
+// The chars states used to find where a chunk can end
+enum { IN_CODE, IN_STRING, IN_COMMENT };
+
+// Searches in [p,end) the last char after which a chunk can end: a '\n' which is not in a string
+// state is the state at p and it is updated to the state at end
+// returns NULL if there is no such char
+static char *lastSplit(char *p, char *end, int *state) {
+    char *split = NULL;
+    for (; p != end; p++) {
+        switch (*state) {
+            case IN_CODE:
+                if (*p == '"') *state = IN_STRING;
+                else if (*p == '#') *state = IN_COMMENT;
+                else if (*p == '\n') split = p;
+                break;
+            case IN_STRING:
+                if (*p == '"') *state = IN_CODE;
+                break;
+            case IN_COMMENT:
+                if (*p == '\n') {
+                    *state = IN_CODE;
+                    split = p;
+                }
+                break;
+        }
+    }
+    return split;
+}
+
+static char *pageAlign(char *p) {
+    return (char *)(((uintptr_t)p + PAGE - 1) & ~(uintptr_t)(PAGE - 1));
+}
+
+// Each chunk starts at a page boundary and ends with a '\0'.
+// The SIMD scanning kernels may read past the '\0' until the end of its page,
+// so the next chunk, which is written by this thread while the lexer reads the current one, starts on another page.
+static void *readerMain(void *arg) {
+    (void)arg;
+    reader.start = now();
+    char *chunk = region;       // the beginning of the current chunk
+    char *end = region;         // the end of the read chars
+    char *scanned = region;     // the chars before it were searched by lastSplit
+    char *split = NULL;         // the last char where the current chunk can end
+    int state = IN_CODE;
+    for (;;) {
+        if (end + CHUNK_SIZE + 2 * PAGE > region + REGION_SIZE) err("the input is too large");
+        ssize_t k = read(inputFd, end, CHUNK_SIZE);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            err("cannot read %s", inputName);
+        }
+        end += k;
+        if (k == 0) {
+            *end = '\0';
+            Chunk *c = (Chunk *)safeAlloc(sizeof(Chunk));
+            *c = (Chunk){chunk, true};
+            push(&chunks, c, &reader);
+            reader.items++;
+            break;
+        }
+        char *s = lastSplit(scanned, end, &state);
+        if (s) split = s;
+        scanned = end;
+        if (split && end - chunk >= CHUNK_SIZE) {
+            // the chars after split are moved to the next chunk
+            char *next = pageAlign(split + 2);
+            size_t rest = (size_t)(end - split - 1);
+            memmove(next, split + 1, rest);
+            split[1] = '\0';
+            Chunk *c = (Chunk *)safeAlloc(sizeof(Chunk));
+            *c = (Chunk){chunk, false};
+            push(&chunks, c, &reader);
+            reader.items++;
+            chunk = next;
+            end = scanned = next + rest;
+            split = NULL;
+        }
+    }
+    reader.end = now();
+    return NULL;
+}
+
+// ---------------------------------------- lexer
+
+static void *lexerMain(void *arg) {
+    (void)arg;
+    lexer.start = now();
+    Batch *b = (Batch *)pop(&freeBatches, &lexer);
+    b->n = 0;
+    for (;;) {
+        Chunk *c = (Chunk *)pop(&chunks, &lexer);
+        bool last = c->last;
+        continueLexer(c->text, last);
+        free(c);
+        for (;;) {
+            Token *tk = &b->tokens[b->n];
+            if (nextTk(tk) == FINISH && !last) break;   // the FINISH at the end of a chunk is not published
+            b->n++;
+            if (tk->code == FINISH || b->n == BATCH_SIZE) {
+                b->last = tk->code == FINISH;
+                push(&batches, b, &lexer);
+                lexer.items++;
+                if (b->last) {
+                    flushAtomCache();
+                    lexer.end = now();
+                    return NULL;
+                }
+                b = (Batch *)pop(&freeBatches, &lexer);
+                b->n = 0;
+            }
+        }
+    }
+}
+
+// ---------------------------------------- parser
+
+static Batch *crtBatch;
+static int iBatch;      // the next token in crtBatch
+
+// the token source of the parser
+static int nextBatchTk(Token *tk) {
+    if (iBatch == crtBatch->n) {
+        if (crtBatch->last) {       // after the end, it repeats the final FINISH
+            *tk = crtBatch->tokens[crtBatch->n - 1];
+            return tk->code;
+        }
+        push(&freeBatches, crtBatch, &parser);
+        crtBatch = (Batch *)pop(&batches, &parser);
+        parser.items++;
+        iBatch = 0;
+    }
+    *tk = crtBatch->tokens[iBatch++];
+    return tk->code;
+}
+
+static void showStage(const Stage *s) {
+    double total = s->end - s->start;
+    printf("%8s %10.2f %10.2f %10.2f %10zu\n", s->name, total * 1e3, (total - s->stall) * 1e3, s->stall * 1e3, s->items);
+}
+
+void parsePipelined(const char *fileName, bool showStats) {
+    if (!fileName || !strcmp(fileName, "-")) {
+        inputFd = STDIN_FILENO;
+        inputName = "stdin";
+    } else {
+        inputFd = open(fileName, O_RDONLY);
+        if (inputFd < 0) err("unable to open %s", fileName);
+        inputName = fileName;
+    }
+    // only the used pages of the region get physical memory
+    region = (char *)mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) err("cannot reserve memory for %s", inputName);
+
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        tryPush(&freeBatches, safeAlloc(sizeof(Batch)));
+    }
+    shareAtoms(true);       // the lexer interns the IDs while the parser adds the predefined functions
+    startLexer(region);
+
+    pthread_t tReader, tLexer;
+    if (pthread_create(&tReader, NULL, readerMain, NULL) || pthread_create(&tLexer, NULL, lexerMain, NULL)) {
+        err("cannot create the pipeline threads");
+    }
+
+    parser.start = now();
+    crtBatch = (Batch *)pop(&batches, &parser);
+    parser.items++;
+    iBatch = 0;
+    parseSource(nextBatchTk);
+    parser.end = now();
+
+    pthread_join(tReader, NULL);
+    pthread_join(tLexer, NULL);
+    flushAtomCache();
+    shareAtoms(false);
+
+    if (showStats) {
+        printf("%8s %10s %10s %10s %10s\n", "stage", "total ms", "busy ms", "stall ms", "items");
+        showStage(&reader);
+        showStage(&lexer);
+        showStage(&parser);
+    }
+
+    push(&freeBatches, crtBatch, &parser);
+    for (Batch *b; (b = (Batch *)tryPop(&freeBatches));) free(b);
+    munmap(region, REGION_SIZE);
+    if (inputFd != STDIN_FILENO) close(inputFd);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Compiles the program with 3 threads which work at the same time:
+//   reader: reads the input in chunks which end with a newline outside strings
+//   lexer: extracts the tokens from each chunk and publishes them in batches
+//   parser: the calling thread, which parses the tokens and generates the code
+// The stages communicate through lock-free single-producer/single-consumer queues.
+// fileName==NULL or "-" reads from stdin.
+// If showStats is true, at the end it shows for each stage its busy time and the time it waited for the other stages.
+// The program must be linked with -pthread.
+void parsePipelined(const char *fileName,bool showStats);
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <pthread.h>
+
+#include "plexer.h"
+#include "lexer.h"
+#include "atoms.h"
+#include "utils.h"
+
+typedef struct {
+    const char *begin, *end;    // the chunk is [begin,end); end is after a '\n' or it is the end of the input
+    bool last;                  // the last chunk also has the final FINISH
+    Token *tks;                 // the tokens which start in the chunk
+    int n, cap;
+    bool failed;                // a lexical error happened
+    const char *firstPos;       // the first char of the first extracted token
+    int firstLine;              // the line of the first extracted token
+    const char *nextPos;        // the first char of the first token which starts at or after end
+    int nextLine;               // the line of that token
+    int nLpar, nRpar;           // nr of '(' and ')' from the chunk tokens
+    int lineOffset;             // added to the lines of the chunk tokens to obtain the real ones
+    Token *dst;                 // where the chunk tokens are copied in the final array
+    pthread_t thread;
+} Chunk;
+
+// Extracts the tokens of the chunk, starting from the position "from" at the line "atLine"
+// If speculative is true, the errors do not stop the program, but they only mark the chunk as failed.
+// In this case the chunk is extracted again, non-speculatively, when its real start is known.
+static void lexChunk(Chunk *c, const char *from, int atLine, bool speculative) {
+    jmp_buf jump;
+    c->n = 0;
+    c->failed = false;
+    c->firstPos = NULL;
+    if (speculative) {
+        if (setjmp(jump)) {
+            setLexerErrorJump(NULL);
+            c->failed = true;
+            return;
+        }
+        setLexerErrorJump(&jump);
+    }
+    // the start of the line is needed only for the columns from the error messages
+    const char *lineStart = from;
+    while (lineStart != tkInput && lineStart[-1] != '\n') lineStart--;
+    resumeLexer(from, atLine, lineStart);
+    int droppedLpar = 0, droppedRpar = 0;
+    for (;;) {
+        if (c->n == c->cap) {
+            c->cap = c->cap ? c->cap * 2 : 4096;
+            Token *p = (Token *)realloc(c->tks, c->cap * sizeof(Token));
+            if (!p) err("not enough memory");
+            c->tks = p;
+        }
+        Token *tk = &c->tks[c->n];
+        int code = nextTk(tk);
+        const char *begin = lastTkBegin();
+        if (!c->firstPos) {
+            c->firstPos = begin;
+            c->firstLine = tk->line;
+        }
+        if (!c->last && begin >= c->end) {
+            // the token belongs to the next chunk
+            c->nextPos = begin;
+            c->nextLine = tk->line;
+            droppedLpar = code == LPAR;
+            droppedRpar = code == RPAR;
+            break;
+        }
+        c->n++;
+        if (code == FINISH) break;
+    }
+    lexerParens(&c->nLpar, &c->nRpar);
+    c->nLpar -= droppedLpar;
+    c->nRpar -= droppedRpar;
+    setLexerErrorJump(NULL);
+}
+
+static void *lexThread(void *arg) {
+    Chunk *c = (Chunk *)arg;
+    lexChunk(c, c->begin, 1, true);
+    flushAtomCache();
+    return NULL;
+}
+
+static void *copyThread(void *arg) {
+    Chunk *c = (Chunk *)arg;
+    for (int i = 0; i < c->n; i++) {
+        c->dst[i] = c->tks[i];
+        c->dst[i].line += c->lineOffset;
+    }
+    free(c->tks);
+    return NULL;
+}
+
+// runs fn for all the chunks, each on its own thread
+static void runThreads(Chunk *chunks, int n, void *(*fn)(void *)) {
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&chunks[i].thread, NULL, fn, &chunks[i])) err("cannot create the lexer threads");
+    }
+    for (int i = 0; i < n; i++) pthread_join(chunks[i].thread, NULL);
+}
+
+void tokenizeParallel(const char *input, int nThreads) {
+    if (nThreads < 1) nThreads = 1;
+    size_t size = strlen(input);
+    const char *inputEnd = input + size;
+    Chunk *chunks = (Chunk *)calloc(nThreads, sizeof(Chunk));
+    if (!chunks) err("not enough memory");
+
+    // splits the input after the first newline from each 1/nThreads of it
+    int n = 0;
+    const char *begin = input;
+    for (int i = 1; i < nThreads; i++) {
+        const char *p = input + size / nThreads * i;
+        if (p < begin) p = begin;
+        const char *nl = (const char *)memchr(p, '\n', inputEnd - p);
+        if (!nl) break;
+        chunks[n].begin = begin;
+        chunks[n].end = nl + 1;
+        n++;
+        begin = nl + 1;
+    }
+    chunks[n].begin = begin;
+    chunks[n].end = inputEnd;
+    chunks[n].last = true;
+    n++;
+
+    startLexer(input);      // initializes the lexer tables and tkInput before the threads start
+    shareAtoms(true);
+    runThreads(chunks, n, lexThread);
+    shareAtoms(false);
+
+    // in order, each chunk must start where the previous one ended
+    int nLpar = 0, nRpar = 0, nTotal = 0;
+    for (int i = 0; i < n; i++) {
+        Chunk *c = &chunks[i];
+        if (i == 0) {
+            // the first chunk always starts at the right position
+            if (c->failed) lexChunk(c, input, 1, false);
+            c->lineOffset = 0;
+        } else {
+            // the first token of the chunk must be the one which did not fit in the previous chunk
+            const char *realBegin = chunks[i - 1].nextPos;
+            int realLine = chunks[i - 1].nextLine + chunks[i - 1].lineOffset;
+            if (c->failed || c->firstPos != realBegin) {
+                lexChunk(c, realBegin, realLine, false);
+                c->lineOffset = 0;
+            } else {
+                c->lineOffset = realLine - c->firstLine;
+            }
+        }
+        nLpar += c->nLpar;
+        nRpar += c->nRpar;
+        nTotal += c->n;
+    }
+    if (nLpar != nRpar) err("Invalid number of parentheses.");
+
+    Token *tks = (Token *)arenaAlloc(&tokenArena, nTotal * sizeof(Token));
+    Token *dst = tks;
+    for (int i = 0; i < n; i++) {
+        chunks[i].dst = dst;
+        dst += chunks[i].n;
+    }
+    runThreads(chunks, n, copyThread);
+    adoptTokens(tks, nTotal);
+    free(chunks);
+}
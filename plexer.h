@@ -0,0 +1,9 @@
+#pragma once
+
+// Extracts all the tokens from the input in the tokens array, using nThreads threads.
+// The input is split in chunks after newlines and each thread extracts the tokens of a chunk.
+// A chunk can start inside a string which contains newlines; such chunks are detected
+// and extracted again from the correct position, after the previous chunk is known.
+// The result is identical with the one of tokenize, including the errors.
+// The program must be linked with -pthread.
+void tokenizeParallel(const char *input, int nThreads);
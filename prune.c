@@ -0,0 +1,174 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ast.h"
+#include "out.h"
+#include "prune.h"
+#include "utils.h"
+
+bool pruning;
+static PruneStats stats;
+static Arena pruneArena = ARENA("prune");
+
+// a function or a global variable
+typedef struct{
+    const char *name;
+    bool isFn;
+    bool reachable;
+    const char *code;
+    size_t n;
+    int firstUse, nUses;    // the used items, in uses
+}Item;
+
+static Item *items;
+static int nItems, capItems;
+static int *uses;
+static int nUses, capUses;
+static int *roots;
+static int nRoots, capRoots;
+
+// the index of each item, by its name
+// the names are atoms, so they are compared by pointer
+static int *table;          // item index+1, 0 for an empty slot
+static int capTable;
+
+static size_t slotOf(const char *name) {
+    return (size_t)(((uintptr_t)name >> 3) * 0x9E3779B97F4A7C15ull >> 32) & (capTable - 1);
+}
+
+void resetPrune(void) {
+    arenaFree(&pruneArena);
+    items = NULL;
+    nItems = capItems = 0;
+    uses = NULL;
+    nUses = capUses = 0;
+    roots = NULL;
+    nRoots = capRoots = 0;
+    table = NULL;
+    capTable = 0;
+}
+
+static int findItem(const char *name) {
+    if (!capTable) return -1;
+    for (size_t h = slotOf(name); table[h]; h = (h + 1) & (capTable - 1)) {
+        if (items[table[h] - 1].name == name) return table[h] - 1;
+    }
+    return -1;
+}
+
+static void addToTable(int item) {
+    if (2 * (nItems + 1) > capTable) {
+        int oldCap = capTable;
+        int *old = table;
+        capTable = capTable ? capTable * 2 : 256;
+        table = (int *)arenaAlloc(&pruneArena, capTable * sizeof(int));
+        memset(table, 0, capTable * sizeof(int));
+        for (int k = 0; k < oldCap; k++) {
+            if (!old[k]) continue;
+            size_t h = slotOf(items[old[k] - 1].name);
+            while (table[h]) h = (h + 1) & (capTable - 1);
+            table[h] = old[k];
+        }
+    }
+    size_t h = slotOf(items[item].name);
+    while (table[h]) h = (h + 1) & (capTable - 1);
+    table[h] = item + 1;
+}
+
+static void pushInt(int **array, int *n, int *cap, int value) {
+    if (*n >= *cap) {
+        int newCap = *cap ? *cap * 2 : 256;
+        *array = (int *)arenaGrow(&pruneArena, *array, *cap * sizeof(int), newCap * sizeof(int));
+        *cap = newCap;
+    }
+    (*array)[(*n)++] = value;
+}
+
+// adds the items used in the subtree id (and in its list of next nodes if withNext) to uses or to roots
+static void collectUses(int id, bool withNext, bool isRoot) {
+    for (; id; id = withNext ? nodes[id].next : 0) {
+        const Node *n = &nodes[id];
+        if ((n->kind == N_CALL || n->kind == N_VAR || n->kind == N_ASSIGN) && !n->local) {
+            int item = findItem(n->name);
+            // the predefined functions are not items
+            if (item >= 0) {
+                if (isRoot) pushInt(&roots, &nRoots, &capRoots, item);
+                else pushInt(&uses, &nUses, &capUses, item);
+            }
+        }
+        if (n->kind != N_INT && n->kind != N_REAL && n->kind != N_STR && n->kind != N_VAR) {
+            collectUses(n->a, true, isRoot);
+            collectUses(n->b, true, isRoot);
+            collectUses(n->c, true, isRoot);
+        }
+    }
+}
+
+void keepItem(int id, const char *code, size_t n) {
+    const Node *node = &nodes[id];
+    if (nItems >= capItems) {
+        int newCap = capItems ? capItems * 2 : 256;
+        items = (Item *)arenaGrow(&pruneArena, items, capItems * sizeof(Item), newCap * sizeof(Item));
+        capItems = newCap;
+    }
+    Item *item = &items[nItems];
+    item->name = node->name;
+    item->isFn = node->kind == N_FN;
+    item->reachable = false;
+    char *copy = (char *)arenaAlloc(&pruneArena, n);
+    memcpy(copy, code, n);
+    item->code = copy;
+    item->n = n;
+    item->firstUse = nUses;
+    // the function is added before its uses are collected, so its recursive calls are found
+    addToTable(nItems++);
+    if (item->isFn) collectUses(node->c, true, false);
+    items[nItems - 1].nUses = nUses - items[nItems - 1].firstUse;
+    if (item->isFn) stats.fns++;
+    else stats.globals++;
+    stats.bytes += n;
+}
+
+void addRoots(int id) {
+    collectUses(id, true, true);
+}
+
+void addUnreachable(int n) {
+    stats.unreachable += n;
+}
+
+void writeReachable(void) {
+    // depth first search from the roots, with roots as the stack
+    while (nRoots) {
+        Item *item = &items[roots[--nRoots]];
+        if (item->reachable) continue;
+        item->reachable = true;
+        for (int k = 0; k < item->nUses; k++) {
+            int used = uses[item->firstUse + k];
+            if (!items[used].reachable) pushInt(&roots, &nRoots, &capRoots, used);
+        }
+    }
+    for (int i = 0; i < nItems; i++) {
+        const Item *item = &items[i];
+        if (item->reachable) {
+            outAppend(item->code, item->n);
+            continue;
+        }
+        if (item->isFn) stats.removedFns++;
+        else stats.removedGlobals++;
+        stats.removedBytes += item->n;
+    }
+    outFlush();
+}
+
+PruneStats pruneStats(void) {
+    return stats;
+}
+
+void showPruneStats(void) {
+    printf("Pruned: %d of %d functions, %d of %d global variables, %d instructions after return, "
+        "%zu of %zu bytes of C code\n",
+        stats.removedFns, stats.fns, stats.removedGlobals, stats.globals, stats.unreachable,
+        stats.removedBytes, stats.bytes);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Whole program dead code elimination, done when pruning is true (set by the -O options).
+// The C code of the functions and global variables is kept until the end of the program,
+// together with the functions and global variables used in their AST (calls, reads and assignments).
+// At the end, only the items reachable from the global code are written, in their original order.
+extern bool pruning;
+
+// deletes the kept items, before a new program is compiled
+void resetPrune(void);
+
+// keeps the C code [code,code+n) of a function or global variable, which is copied,
+// and records the items used by it
+void keepItem(int id, const char *code, size_t n);
+
+// records the items used by global instructions, which are always executed
+void addRoots(int id);
+
+// counts the instructions removed because they were after a return
+void addUnreachable(int n);
+
+// writes to the output the code of the reachable items
+void writeReachable(void);
+
+typedef struct{
+    int fns, removedFns;            // the functions and the removed ones
+    int globals, removedGlobals;    // the global variables and the removed ones
+    int unreachable;                // the instructions after a return
+    size_t bytes, removedBytes;     // the C code of the items and the removed part
+}PruneStats;
+
+PruneStats pruneStats(void);
+
+// shows what was removed
+void showPruneStats(void);
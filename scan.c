@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+#include "utils.h"
+
+const unsigned char charClass[256] = {
+	0,0,0,0,0,0,0,0,0,1,2,0,0,2,0,0,		// 0x00
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0x10
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0x20
+	4,4,4,4,4,4,4,4,4,4,0,0,0,0,0,0,		// 0x30
+	0,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,		// 0x40
+	8,8,8,8,8,8,8,8,8,8,8,0,0,0,0,8,		// 0x50
+	0,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,		// 0x60
+	8,8,8,8,8,8,8,8,8,8,8,0,0,0,0,0,		// 0x70
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0x80
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0x90
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0xA0
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0xB0
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0xC0
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0xD0
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0xE0
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,		// 0xF0
+	// 0x80-0xFF: no class
+};
+
+// ---------------------------------------- scalar kernels
+
+static const char *scalarIdent(const char *p) {
+    while (charClass[(unsigned char)*p] & CC_IDENT) p++;
+    return p;
+}
+
+static const char *scalarDigits(const char *p) {
+    while (charClass[(unsigned char)*p] & CC_DIGIT) p++;
+    return p;
+}
+
+static const char *scalarComment(const char *p) {
+    while (*p != '\n' && *p != '\0') p++;
+    return p;
+}
+
+static const char *scalarString(const char *p) {
+    while (*p != '"' && *p != '\0') p++;
+    return p;
+}
+
+static const char *scalarSpace(const char *p, int *line, const char **lineStart) {
+    for (;; p++) {
+        if (*p == '\n') {
+            (*line)++;
+            *lineStart = p + 1;
+        } else if (*p != ' ' && *p != '\t') {
+            return p;
+        }
+    }
+}
+
+// ---------------------------------------- SIMD kernels
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+
+#define PAGE_SIZE 4096
+
+// true if a W bytes read from p would cross into the next page
+#define CROSSES_PAGE(p, W) (((uintptr_t)(p) & (PAGE_SIZE - 1)) > PAGE_SIZE - (W))
+
+// Generates the kernels for an instruction set
+// STOP(c) returns a vector with 0xFF for the chars where the kernel must stop
+// scalarStop(ch) is the same test for a single char, used near page ends
+#define DEFINE_SKIP(fn, W, TARGET, VEC, LOADU, MOVEMASK, STOP, scalarStop)    \
+    __attribute__((target(TARGET))) static const char *fn(const char *p) {    \
+        for (;;) {                                                              \
+            if (CROSSES_PAGE(p, W)) {                                           \
+                if (scalarStop(*p)) return p;                                   \
+                p++;                                                            \
+                continue;                                                       \
+            }                                                                   \
+            VEC c = LOADU((const VEC *)p);                                      \
+            uint32_t m = (uint32_t)MOVEMASK(STOP(c));                           \
+            if (m) return p + __builtin_ctz(m);                                 \
+            p += W;                                                             \
+        }                                                                       \
+    }
+
+#define DEFINE_SPACE(fn, W, TARGET, VEC, LOADU, MOVEMASK, CMPEQ, SET1, OR)                 \
+    __attribute__((target(TARGET))) static const char *fn(const char *p, int *line,         \
+                                                          const char **lineStart) {         \
+        for (;;) {                                                                          \
+            if (CROSSES_PAGE(p, W)) {                                                       \
+                if (*p == '\n') {                                                           \
+                    (*line)++;                                                              \
+                    *lineStart = p + 1;                                                     \
+                } else if (*p != ' ' && *p != '\t') {                                       \
+                    return p;                                                               \
+                }                                                                           \
+                p++;                                                                        \
+                continue;                                                                   \
+            }                                                                               \
+            VEC c = LOADU((const VEC *)p);                                                  \
+            uint32_t nl = (uint32_t)MOVEMASK(CMPEQ(c, SET1('\n')));                         \
+            uint32_t blank = (uint32_t)MOVEMASK(OR(CMPEQ(c, SET1(' ')), CMPEQ(c, SET1('\t')))); \
+            uint32_t stop = ~(nl | blank);                                                  \
+            if (W < 32) stop &= (1u << (W & 31)) - 1;                                       \
+            int n = stop ? __builtin_ctz(stop) : W;                                         \
+            /* only the newlines before the stop char are counted */                        \
+            if (n < 32) nl &= (1u << n) - 1;                                                \
+            if (nl) {                                                                       \
+                *line += __builtin_popcount(nl);                                            \
+                *lineStart = p + (31 - __builtin_clz(nl)) + 1;                              \
+            }                                                                               \
+            if (stop) return p + n;                                                         \
+            p += W;                                                                         \
+        }                                                                                   \
+    }
+
+static inline int stopIdent(char ch) { return !(charClass[(unsigned char)ch] & CC_IDENT); }
+static inline int stopDigits(char ch) { return !(charClass[(unsigned char)ch] & CC_DIGIT); }
+static inline int stopComment(char ch) { return ch == '\n' || ch == '\0'; }
+static inline int stopString(char ch) { return ch == '"' || ch == '\0'; }
+
+// c in [lo,hi] <=> saturated (c-lo)-(hi-lo) == 0
+#define SSE_IN_RANGE(c, lo, hi) \
+    _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(c, _mm_set1_epi8(lo)), _mm_set1_epi8((hi) - (lo))), _mm_setzero_si128())
+#define SSE_IDENT(c) _mm_or_si128(_mm_or_si128(SSE_IN_RANGE(c, '0', '9'),                              \
+                                               SSE_IN_RANGE(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z')), \
+                                  _mm_cmpeq_epi8(c, _mm_set1_epi8('_')))
+#define SSE_NOT(v) _mm_xor_si128(v, _mm_set1_epi8((char)0xFF))
+#define SSE_STOP_IDENT(c) SSE_NOT(SSE_IDENT(c))
+#define SSE_STOP_DIGITS(c) SSE_NOT(SSE_IN_RANGE(c, '0', '9'))
+#define SSE_STOP_COMMENT(c) _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(c, _mm_setzero_si128()))
+#define SSE_STOP_STRING(c) _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('"')), _mm_cmpeq_epi8(c, _mm_setzero_si128()))
+
+DEFINE_SKIP(sse2Ident, 16, "sse2", __m128i, _mm_loadu_si128, _mm_movemask_epi8, SSE_STOP_IDENT, stopIdent)
+DEFINE_SKIP(sse2Digits, 16, "sse2", __m128i, _mm_loadu_si128, _mm_movemask_epi8, SSE_STOP_DIGITS, stopDigits)
+DEFINE_SKIP(sse2Comment, 16, "sse2", __m128i, _mm_loadu_si128, _mm_movemask_epi8, SSE_STOP_COMMENT, stopComment)
+DEFINE_SKIP(sse2String, 16, "sse2", __m128i, _mm_loadu_si128, _mm_movemask_epi8, SSE_STOP_STRING, stopString)
+DEFINE_SPACE(sse2Space, 16, "sse2", __m128i, _mm_loadu_si128, _mm_movemask_epi8, _mm_cmpeq_epi8, _mm_set1_epi8, _mm_or_si128)
+
+#define AVX_IN_RANGE(c, lo, hi) \
+    _mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_sub_epi8(c, _mm256_set1_epi8(lo)), _mm256_set1_epi8((hi) - (lo))), _mm256_setzero_si256())
+#define AVX_IDENT(c) _mm256_or_si256(_mm256_or_si256(AVX_IN_RANGE(c, '0', '9'),                                 \
+                                                     AVX_IN_RANGE(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z')), \
+                                     _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')))
+#define AVX_NOT(v) _mm256_xor_si256(v, _mm256_set1_epi8((char)0xFF))
+#define AVX_STOP_IDENT(c) AVX_NOT(AVX_IDENT(c))
+#define AVX_STOP_DIGITS(c) AVX_NOT(AVX_IN_RANGE(c, '0', '9'))
+#define AVX_STOP_COMMENT(c) _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(c, _mm256_setzero_si256()))
+#define AVX_STOP_STRING(c) _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(c, _mm256_setzero_si256()))
+
+DEFINE_SKIP(avx2Ident, 32, "avx2", __m256i, _mm256_loadu_si256, _mm256_movemask_epi8, AVX_STOP_IDENT, stopIdent)
+DEFINE_SKIP(avx2Digits, 32, "avx2", __m256i, _mm256_loadu_si256, _mm256_movemask_epi8, AVX_STOP_DIGITS, stopDigits)
+DEFINE_SKIP(avx2Comment, 32, "avx2", __m256i, _mm256_loadu_si256, _mm256_movemask_epi8, AVX_STOP_COMMENT, stopComment)
+DEFINE_SKIP(avx2String, 32, "avx2", __m256i, _mm256_loadu_si256, _mm256_movemask_epi8, AVX_STOP_STRING, stopString)
+DEFINE_SPACE(avx2Space, 32, "avx2", __m256i, _mm256_loadu_si256, _mm256_movemask_epi8, _mm256_cmpeq_epi8, _mm256_set1_epi8, _mm256_or_si256)
+
+#define HAVE_SIMD_KERNELS
+#endif
+
+static const ScanKernels allKernels[] = {
+#ifdef HAVE_SIMD_KERNELS
+    {"avx2", avx2Ident, avx2Digits, avx2Comment, avx2String, avx2Space},
+    {"sse2", sse2Ident, sse2Digits, sse2Comment, sse2String, sse2Space},
+#endif
+    {"scalar", scalarIdent, scalarDigits, scalarComment, scalarString, scalarSpace},
+};
+
+ScanKernels scan = {"scalar", scalarIdent, scalarDigits, scalarComment, scalarString, scalarSpace};
+
+static bool cpuSupports(const char *name) {
+#ifdef HAVE_SIMD_KERNELS
+    __builtin_cpu_init();
+    if (!strcmp(name, "avx2")) return __builtin_cpu_supports("avx2");
+    if (!strcmp(name, "sse2")) return __builtin_cpu_supports("sse2");
+#endif
+    return !strcmp(name, "scalar");
+}
+
+bool useScanKernels(const char *name) {
+    for (size_t i = 0; i < sizeof(allKernels) / sizeof(allKernels[0]); i++) {
+        if (!strcmp(allKernels[i].name, name) && cpuSupports(name)) {
+            scan = allKernels[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void initScan(void) {
+    const char *forced = getenv("QUICK_SCAN");
+    if (forced) {
+        if (!useScanKernels(forced)) err("the scan kernels %s are not available", forced);
+        return;
+    }
+    // allKernels is ordered from the fastest to the slowest
+    for (size_t i = 0; i < sizeof(allKernels) / sizeof(allKernels[0]); i++) {
+        if (useScanKernels(allKernels[i].name)) return;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Character classes used by the lexer instead of the locale-dependent isdigit/isalpha/isalnum
+enum {
+    CC_BLANK = 1,       // ' ', '\t'
+    CC_NL = 2,          // '\n', '\r'
+    CC_DIGIT = 4,       // 0-9
+    CC_ALPHA = 8,       // A-Z, a-z, _
+    CC_IDENT = CC_DIGIT | CC_ALPHA,
+};
+
+extern const unsigned char charClass[256];
+
+// The scanning kernels skip runs of chars of the same kind.
+// All of them stop at the final '\0' of the input.
+// The SIMD versions test 16 or 32 chars at a time. They may read past the final '\0',
+// but never into the next memory page, so they never fault.
+typedef struct {
+    const char *name;       // "avx2", "sse2" or "scalar"
+    // returns the first char which is not CC_IDENT
+    const char *(*ident)(const char *p);
+    // returns the first char which is not CC_DIGIT
+    const char *(*digits)(const char *p);
+    // returns the first '\n' or '\0'
+    const char *(*comment)(const char *p);
+    // returns the first '"' or '\0'
+    const char *(*string)(const char *p);
+    // skips ' ', '\t' and '\n' and returns the first other char
+    // for each '\n', increments *line and sets *lineStart to the char after it
+    const char *(*space)(const char *p, int *line, const char **lineStart);
+} ScanKernels;
+
+extern ScanKernels scan;
+
+// selects the fastest kernels supported by the CPU
+// the environment variable QUICK_SCAN (avx2, sse2 or scalar) can force a specific set
+void initScan(void);
+
+// selects the kernels by name; returns false if they are not supported by this CPU
+bool useScanKernels(const char *name);
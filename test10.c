@@ -0,0 +1,86 @@
+// The whole program dead code elimination of -O (see prune.h). The program is compiled without and with -O,
+// without inlining, so only the pruning removes code. It is built with the C compiler and the output of each
+// executable is checked. With -O, the functions which are called only from dead functions and the global
+// variables which are used only by them must be removed, together with the instructions after a return.
+// A second program compiled after it must not contain its items.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "prune.h"
+#include "inliner.h"
+#include "testutil.h"
+
+static const char *program =
+    "var used:int;\n"
+    "var unused:int;\n"
+    "function leaf(x:int):int\n"
+    "  return x*3;\n"
+    "end\n"
+    "function deadCaller(x:int):int\n"
+    "  unused=x;\n"
+    "  return leaf(x)+1;\n"
+    "end\n"
+    "function dead(x:int):int\n"
+    "  return deadCaller(x)*2;\n"
+    "end\n"
+    "function live(x:int):int\n"
+    "  if(x<0) return 0; end\n"
+    "  return leaf(x)+used;\n"
+    "  puti(x);\n"
+    "end\n"
+    "used=5;\n"
+    "puti(live(4));\n"
+    "puti(live(0-1));\n";
+
+static const char *expected = "17\n0\n";
+
+// the next program compiled in the same process, which must not contain the items of the first one
+static const char *other =
+    "function other(x:int):int\n"
+    "  return x+1;\n"
+    "end\n"
+    "puti(other(1));\n";
+
+static const char *otherExpected = "2\n";
+
+int main() {
+    char cFile[64];
+    testFile(cFile, sizeof(cFile), "test10", ".c");
+    int failed = 0;
+    inlineBudget = 0;
+    for (optLevel = 0; optLevel <= 1; optLevel++) {
+        pruning = optLevel > 0;
+        // the stats are added for all the programs
+        PruneStats before = pruneStats();
+        bool ok;
+        char *out = compileAndRun(program, cFile, "-O0 -w -I.", &ok);
+        ok = ok && !strcmp(out, expected);
+        if (pruning) {
+            // dead, deadCaller and unused are removed; live, leaf and used are kept
+            PruneStats s = pruneStats();
+            char *code = loadFile(cFile);
+            ok = ok && s.fns - before.fns == 4 && s.removedFns - before.removedFns == 2 &&
+                s.globals - before.globals == 2 && s.removedGlobals - before.removedGlobals == 1 &&
+                s.unreachable - before.unreachable == 1 && !strstr(code, "dead") && !strstr(code, "unused");
+            free(code);
+        }
+        if (!report(ok, out, "-O%d", optLevel)) failed = 1;
+        free(out);
+    }
+    // the items kept for the previous program are deleted
+    PruneStats before = pruneStats();
+    bool ok;
+    char *out = compileAndRun(other, cFile, "-O0 -w -I.", &ok);
+    PruneStats s = pruneStats();
+    char *code = loadFile(cFile);
+    ok = ok && !strcmp(out, otherExpected) && s.fns - before.fns == 1 && s.removedFns == before.removedFns &&
+        !strstr(code, "leaf") && !strstr(code, "live") && !strstr(code, "used");
+    free(code);
+    if (!report(ok, out, "next program -O1")) failed = 1;
+    free(out);
+    remove(cFile);
+    showPruneStats();
+    return failed;
+}
@@ -0,0 +1,79 @@
+// The inlining of the functions (--inline-budget, --inline-depth), also in recursive functions.
+// The program is compiled with several limits, built with the C compiler and the output of each executable
+// is checked. The recursion must be inlined only up to the depth, and with a small budget only the small
+// function must be inlined. The inlined and not inlined calls of each compilation are shown.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "prune.h"
+#include "inliner.h"
+#include "testutil.h"
+
+static const char *program =
+    "function fib(n:int):int\n"
+    "  if(n<2) return n; end\n"
+    "  return fib(n-1)+fib(n-2);\n"
+    "end\n"
+    "function even(n:int):int\n"
+    "  if(n==0) return 1; end\n"
+    "  if(n==1) return 0; end\n"
+    "  return even(n-2);\n"
+    "end\n"
+    "function sq(x:int):int\n"
+    "  return x*x;\n"
+    "end\n"
+    "puti(fib(15));\n"
+    "puti(even(10));\n"
+    "puti(even(7));\n"
+    "puti(sq(fib(6))+sq(3));\n";
+
+static const char *expected = "610\n1\n0\n73\n";
+
+typedef struct{
+    int budget;
+    int depth;
+    int candidates;     // the inlinable functions
+    int minInlined;     // the min number of inlined calls
+    int maxInlined;     // the max number of inlined calls
+    bool rejects;       // some calls are not inlined because of the limits
+}Limits;
+
+static const Limits limits[] = {
+    {0, 2, 0, 0, 0, false},             // no inlining
+    {40, 0, 3, 0, 0, true},             // all the calls are rejected
+    {40, 1, 3, 1, 20, true},
+    {40, 3, 3, 21, 1000, true},         // more than with --inline-depth 1
+    {3, 2, 1, 1, 2, false},             // only sq
+};
+
+int main() {
+    char cFile[64];
+    testFile(cFile, sizeof(cFile), "test11", ".c");
+    int failed = 0;
+    optLevel = 1;
+    pruning = true;
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+        const Limits *l = &limits[i];
+        inlineBudget = l->budget;
+        inlineDepth = l->depth;
+        // the stats are added for all the programs
+        InlineStats before = inlineStats();
+        bool ok;
+        char *out = compileAndRun(program, cFile, "-O0 -w -I.", &ok);
+        InlineStats s = inlineStats();
+        int candidates = s.candidates - before.candidates, inlined = s.inlined - before.inlined;
+        int rejected = s.rejected - before.rejected;
+        ok = ok && !strcmp(out, expected) && candidates == l->candidates &&
+            inlined >= l->minInlined && inlined <= l->maxInlined && (rejected > 0) == l->rejects;
+        if (!report(ok, out, "--inline-budget %d --inline-depth %d: %d inlined, %d not inlined",
+                l->budget, l->depth, inlined, rejected)) {
+            printf("%d inlinable functions\n", candidates);
+            failed = 1;
+        }
+        free(out);
+    }
+    remove(cFile);
+    return failed;
+}
@@ -0,0 +1,66 @@
+// Tail calls: recursions with a depth of 10^7 must run in constant stack space,
+// also when the C code is compiled without optimizations (cc -O0).
+// The program is compiled without and with -O2, and the output of each executable is checked.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "testutil.h"
+
+static const char *program =
+    "function sum(n:int, acc:int):int\n"
+    "  if(n<1) return acc; end\n"
+    "  return sum(n-1, acc+n-n/3*3);\n"
+    "end\n"
+    "function swap(a:int, b:int, n:int):int\n"
+    "  if(n<1) return a*1000+b; end\n"
+    "  return (swap(b, a, n-1));\n"
+    "end\n"
+    "function zig(n:int, acc:int):int\n"
+    "  if(n<1) return acc; end\n"
+    "  if(n/2*2==n) return zig(n-1, acc+1); end\n"
+    "  return zig(n-1, acc+2);\n"
+    "end\n"
+    "function w(n:int):int\n"
+    "  var i:int;\n"
+    "  i=0;\n"
+    "  while(i<1)\n"
+    "    if(n>0) return w(n-1); end\n"
+    "    i=i+1;\n"
+    "  end\n"
+    "  return n;\n"
+    "end\n"
+    "function half(x:real, n:real):real\n"
+    "  if(n) return half((x+1.0)/2.0, n-1.0); end\n"
+    "  return x;\n"
+    "end\n"
+    // the tail call is unreachable, so the parameters come only from the entry
+    "function dead(p0:int, p2:int):int\n"
+    "  if(p0<1) return 70; else return p2+5; end\n"
+    "  return dead(p0-1, 23);\n"
+    "end\n"
+    "puti(sum(10000000, 0));\n"
+    "puti(swap(1, 2, 10000001));\n"
+    "puti(zig(10000000, 0));\n"
+    "puti(w(10000000));\n"
+    "putr(half(0.0, 10000000.0));\n"
+    "puti(dead(7, 1));\n";
+
+static const char *expected = "10000000\n2001\n15000000\n0\n1\n6\n";
+
+int main() {
+    char cFile[64];
+    testFile(cFile, sizeof(cFile), "test12", ".c");
+    int failed = 0;
+    for (optLevel = 0; optLevel <= 2; optLevel += 2) {
+        bool ok;
+        char *out = compileAndRun(program, cFile, "-O0 -w -I.", &ok);
+        ok = ok && !strcmp(out, expected);
+        if (!report(ok, out, "-O%d", optLevel)) failed = 1;
+        free(out);
+    }
+    remove(cFile);
+    printf("%d tail calls\n", parserStats().tailCalls);
+    return failed;
+}
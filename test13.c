@@ -0,0 +1,60 @@
+// --memoize (see memo.h): the memoized program is compiled without and with -O2, built with the C compiler
+// and the output of each executable is checked. The program defines functions named like the ones of the C library
+// (div, free) and, after the memoized function fib, the names which were used by older versions of the wrappers,
+// so the generated code must not depend on any of them.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "memo.h"
+#include "testutil.h"
+
+static const char *program =
+    "function fib(n:int):int\n"
+    "  if(n<2) return n; end\n"
+    "  return fib(n-1)+fib(n-2);\n"
+    "end\n"
+    "function half(x:real):real\n"
+    "  return x/2.0;\n"
+    "end\n"
+    "function div(a:int, b:int):int\n"
+    "  return fib(a)/b;\n"
+    "end\n"
+    "function fib_memo_fn(n:int):int\n"
+    "  return n+1;\n"
+    "end\n"
+    "var fib_memo:int;\n"
+    "var fib_memo_report:int;\n"
+    "var memoBits:int;\n"
+    "function free(x:int):int\n"
+    "  return x*2;\n"
+    "end\n"
+    "fib_memo=1;\n"
+    "puti(fib(30));\n"
+    "putr(half(3.0));\n"
+    "puti(div(20,5));\n"
+    "puti(fib_memo_fn(1)+free(3));\n";
+
+static const char *expected =
+    "832040\n"
+    "1.5\n"
+    "1353\n"
+    "8\n";
+
+int main() {
+    char cFile[64];
+    testFile(cFile, sizeof(cFile), "test13", ".c");
+    int failed = 0;
+    memoize = true;
+    for (optLevel = 0; optLevel <= 2; optLevel += 2) {
+        bool ok;
+        char *out = compileAndRun(program, cFile, "-O0 -w -I.", &ok);
+        ok = ok && !strcmp(out, expected) && memoStats().memoized > 0;
+        if (!report(ok, out, "-O%d", optLevel)) failed = 1;
+        free(out);
+    }
+    remove(cFile);
+    showMemoStats();
+    return failed;
+}
@@ -0,0 +1,84 @@
+// quick run: the bytecode VM must give the same output as the C backend. test/1.q and a program with
+// recursion, loops, int and real arithmetic and strings are compiled to C and built with the C compiler,
+// then they are executed by the VM in this process, without and with -O. The outputs must be the same.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ad.h"
+#include "opt.h"
+#include "vm.h"
+#include "testutil.h"
+
+static const char *program =
+    "var n:int;\n"
+    "var r:real;\n"
+    "function fib(n:int):int\n"
+    "  if(n<2) return n; end\n"
+    "  return fib(n-1)+fib(n-2);\n"
+    "end\n"
+    "function sum(n:int):int\n"
+    "  var i:int;\n"
+    "  var s:int;\n"
+    "  i=0; s=0;\n"
+    "  while(i<n)\n"
+    "    s=s+i*i-i/3;\n"
+    "    i=i+1;\n"
+    "  end\n"
+    "  return s;\n"
+    "end\n"
+    "function half(x:real):real\n"
+    "  return x/2.0;\n"
+    "end\n"
+    "n=20;\n"
+    "puti(fib(n));\n"
+    "puti(sum(100));\n"
+    "puti(0-7/2);\n"
+    "r=half(7.0)+0.25;\n"
+    "putr(r);\n"
+    "putr(0.0-r*r);\n"
+    "puts(\"vm\");\n";
+
+// the output of the VM, in outFile instead of stdout
+static void runVmTo(const char *source, const char *outFile) {
+    vmMode = true;
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    if (!freopen(outFile, "w", stdout)) err("cannot write %s", outFile);
+    parse(source);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    vmMode = false;
+}
+
+static bool check(const char *name, const char *source, const char *cFile, const char *vmOut) {
+    bool ok;
+    char *expected = compileAndRun(source, cFile, "-O0 -w -I.", &ok);
+    runVmTo(source, vmOut);
+    char *out = loadFile(vmOut);
+    ok = ok && *expected && !strcmp(out, expected);
+    if (!report(ok, out, "%s -O%d", name, optLevel)) printf("C:\n%s", expected);
+    showVmStats();
+    free(expected);
+    free(out);
+    return ok;
+}
+
+int main() {
+    char cFile[64], vmOut[64];
+    testFile(cFile, sizeof(cFile), "test14", ".c");
+    testFile(vmOut, sizeof(vmOut), "test14", ".vm.out");
+    traceSymbols = false;
+    char *q1 = loadFile("test/1.q");
+    int failed = 0;
+    for (optLevel = 0; optLevel <= 1; optLevel++) {
+        if (!check("test/1.q", q1, cFile, vmOut)) failed = 1;
+        if (!check("program", program, cFile, vmOut)) failed = 1;
+    }
+    free(q1);
+    remove(cFile);
+    remove(vmOut);
+    return failed;
+}
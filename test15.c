@@ -0,0 +1,130 @@
+// The x86-64 assembly backend (-S): the program is compiled to assembly without and with -O2,
+// built with the C compiler and the output of each executable is checked.
+// It covers the arguments passed on the stack, the values kept in the stack frame and in the callee-saved
+// registers during calls, the real comparisons with NaN, the strings and the global variables.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "asm.h"
+#include "testutil.h"
+
+static const char *program =
+    "var g:int;\n"
+    "var gr:real;\n"
+    "var gs:str;\n"
+    "var empty:str;\n"
+    "function many(a:int, b:int, c:int, d:int, e:int, f:int, h:int, i:int, j:real, k:real):int\n"
+    "  return a-b+c*d-e+f*h-i+(j<k);\n"
+    "end\n"
+    "function reals(a:real, b:real, c:real, d:real, e:real, f:real, h:real, i:real, j:real, k:real):real\n"
+    "  return a+b*c-d/e+f-h+i*j-k;\n"
+    "end\n"
+    "function pick(s:str, n:str):str\n"
+    "  if(n) return s; end\n"
+    "  return \"other\";\n"
+    "end\n"
+    "function spill(n:int):int\n"
+    "  var a:int; var b:int; var c:int; var d:int; var e:int; var f:int; var h:int; var i:int; var j:int; var k:int;\n"
+    "  a=n+1; b=n+2; c=n+3; d=n+4; e=n+5; f=n+6; h=n+7; i=n+8; j=n+9; k=n+10;\n"
+    "  puti(a); \n"
+    "  return a*b+c*d+e*f+h*i+j*k+many(a,b,c,d,e,f,h,i,1.5,2.5)+a+b+c+d+e+f+h+i+j+k;\n"
+    "end\n"
+    "function rs(x:real):real\n"
+    "  var a:real; var b:real; var c:real;\n"
+    "  a=x+1.0; b=x*2.0; c=x/3.0;\n"
+    "  putr(a);\n"
+    "  return a+b+c+reals(a,b,c,a,b,c,a,b,c,a);\n"
+    "end\n"
+    "function fact(n:int):int\n"
+    "  if(n<2) return 1; end\n"
+    "  return n*fact(n-1);\n"
+    "end\n"
+    "function cmpr(a:real, b:real):int\n"
+    "  return (a<b)*1000+(a<=b)*100+(a>b)*10+(a>=b)+(a==b)*10000+(a!=b)*100000;\n"
+    "end\n"
+    "function rtest(x:real):real\n"
+    "  if(x) puts(\"true\"); else puts(\"false\"); end\n"
+    "  return x;\n"
+    "end\n"
+    "g=7;\n"
+    "gr=2.5;\n"
+    "gs=\"hello\\tworld\";\n"
+    "puti(many(1,2,3,4,5,6,7,8,0.5,0.25));\n"
+    "putr(reals(1.0,2.0,3.0,4.0,5.0,6.0,7.0,8.0,9.0,10.0));\n"
+    "puts(pick(gs,gs));\n"
+    "puts(pick(gs,empty));\n"
+    "puti(spill(g));\n"
+    "putr(rs(gr));\n"
+    "puti(fact(10));\n"
+    "puti(-17/5);\n"
+    "puti(17/-5);\n"
+    "puti(0-g/2);\n"
+    "putr(-gr);\n"
+    "putr(-0.0);\n"
+    "puti(!g);\n"
+    "puti(!0);\n"
+    "puti(!gr);\n"
+    "puti(!0.0);\n"
+    "puti(cmpr(1.0,2.0));\n"
+    "puti(cmpr(2.0,2.0));\n"
+    "puti(cmpr(3.0,2.0));\n"
+    "puti(cmpr(0.0/0.0,1.0));\n"
+    "puti(g>3 && gr<3.0);\n"
+    "puti(g<3 || gr<2.0);\n"
+    "puti(gr && 0.0);\n"
+    "rtest(gr);\n"
+    "rtest(0.0/0.0);\n"
+    "rtest(0.0);\n"
+    "puti(gs==gs);\n"
+    "puti(g*g*g-g+g/3);\n";
+
+static const char *expected =
+    "40\n"
+    "67.2\n"
+    "hello\tworld\n"
+    "other\n"
+    "8\n"
+    "1210\n"
+    "3.5\n"
+    "14.3\n"
+    "3628800\n"
+    "-3\n"
+    "-3\n"
+    "-3\n"
+    "-2.5\n"
+    "-0\n"
+    "0\n"
+    "1\n"
+    "0\n"
+    "1\n"
+    "101100\n"
+    "10101\n"
+    "100011\n"
+    "100000\n"
+    "1\n"
+    "0\n"
+    "0\n"
+    "true\n"
+    "true\n"
+    "false\n"
+    "1\n"
+    "338\n";
+
+int main() {
+    char sFile[64];
+    testFile(sFile, sizeof(sFile), "test15", ".s");
+    int failed = 0;
+    asmMode = true;
+    for (optLevel = 0; optLevel <= 2; optLevel += 2) {
+        bool ok;
+        char *out = compileAndRun(program, sFile, "", &ok);
+        ok = ok && !strcmp(out, expected);
+        if (!report(ok, out, "-O%d", optLevel)) failed = 1;
+        free(out);
+    }
+    remove(sFile);
+    showAsmStats();
+    return failed;
+}
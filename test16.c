@@ -0,0 +1,159 @@
+// The LLVM backend (--emit-llvm): the program is compiled to LLVM IR without and with -O and inlining,
+// then it is executed with lli (or built with clang) and its output is checked.
+// It covers the phis of && and || and of the inlined code, the blocks after return, the musttail self calls,
+// the string escapes, the reals used as conditions, the global variables and a function without return.
+// The sample program test/1.q is also round-tripped: the output of its LLVM IR must be the same as the one
+// of its C code built with the C compiler. If no LLVM tool is found, the test is skipped.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "prune.h"
+#include "inliner.h"
+#include "llvm.h"
+#include "testutil.h"
+
+static const char *program =
+    "var g:int;\n"
+    "var gr:real;\n"
+    "var gs:str;\n"
+    "function sign(x:int):int\n"
+    "  if(x<0) return 0-1; end\n"
+    "  if(x>0) return 1; end\n"
+    "  return 0;\n"
+    "end\n"
+    "function orHalf(x:real):real\n"
+    "  if(x) return x; end\n"
+    "  return 0.5;\n"
+    "end\n"
+    "function count(n:int, acc:int):int\n"
+    "  if(n==0) return acc; end\n"
+    "  return count(n-1, acc+1);\n"
+    "end\n"
+    "function collatz(n:int):int\n"
+    "  var steps:int;\n"
+    "  steps=0;\n"
+    "  while(n!=1)\n"
+    "    if(n/2*2==n) n=n/2; else n=3*n+1; end\n"
+    "    steps=steps+1;\n"
+    "  end\n"
+    "  return steps;\n"
+    "  puts(\"unreachable\");\n"
+    "end\n"
+    "function both(a:int, b:int):int\n"
+    "  return (a && b) + (a || b)*10 + (!a && (b || a))*100;\n"
+    "end\n"
+    "function none(x:int):int\n"
+    "  x=x+1;\n"
+    "end\n"
+    "g=5;\n"
+    "gr=2.75;\n"
+    "gs=\"backslash \\\\ tab\\tend\";\n"
+    "puts(gs);\n"
+    "puti(sign(0-g)+sign(g)*10+sign(0)*100);\n"
+    "putr(orHalf(gr)+orHalf(0.0)*10.0);\n"
+    "puti(orHalf(0.0/0.0)!=orHalf(0.0/0.0));\n"
+    "puti(count(10000000,0));\n"
+    "puti(collatz(27));\n"
+    "puti(both(0,0)+both(0,1)*1000+both(1,0)*1000000);\n"
+    "puti(both(3,7));\n"
+    "puti(none(g));\n"
+    "puti(g>3 && gr>3.0 || g==5);\n"
+    "putr(-gr*2.0/0.5);\n"
+    "return g-5;\n"
+    "puts(\"not printed\");\n";
+
+static const char *expected =
+    "backslash \\ tab\tend\n"
+    "9\n"
+    "7.75\n"
+    "1\n"
+    "10000000\n"
+    "111\n"
+    "10110000\n"
+    "11\n"
+    "0\n"
+    "1\n"
+    "-11\n";
+
+// the ways to execute a module, tried in order; LLVM 14 needs -opaque-pointers for the ptr type
+static const char *runners[] = {
+    "lli %s",
+    "lli -opaque-pointers %s",
+    "clang -w -o %s.exe %s && %s.exe",
+};
+
+// runs the module with the runner and returns its output, dynamically allocated; *ok is set if it succeeded
+static char *run(const char *runner, const char *llFile, bool *ok) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), runner, llFile, llFile, llFile);
+    strcat(cmd, " 2>/dev/null");
+    return capture(cmd, ok);
+}
+
+// the output of test/1.q with the C backend and with the LLVM backend
+static bool roundTrip(const char *runner, const char *llFile) {
+    char cFile[64];
+    char *src = loadFile("test/1.q");
+    testFile(cFile, sizeof(cFile), "test16", ".c");
+    llvmMode = false;
+    bool ok, okLl;
+    char *outC = compileAndRun(src, cFile, "-w -Itest", &ok);
+    llvmMode = true;
+    openOutput(llFile);
+    parse(src);
+    closeOutput();
+    char *outLl = run(runner, llFile, &okLl);
+    ok = ok && okLl && !strcmp(outC, outLl);
+    if (!report(ok, outLl, "test/1.q")) printf("C:\n%s", outC);
+    remove(cFile);
+    free(outC);
+    free(outLl);
+    free(src);
+    return ok;
+}
+
+int main() {
+    char llFile[64];
+    testFile(llFile, sizeof(llFile), "test16", ".ll");
+    const char *runner = NULL;
+    int failed = 0;
+    llvmMode = true;
+    for (optLevel = 0; optLevel <= 1; optLevel++) {
+        pruning = optLevel;
+        inlineBudget = optLevel ? 40 : 0;
+        openOutput(llFile);
+        parse(program);
+        closeOutput();
+        bool ok = false;
+        char *out = NULL;
+        if (runner) {
+            out = run(runner, llFile, &ok);
+        } else {
+            for (size_t i = 0; i < sizeof(runners) / sizeof(runners[0]) && !ok; i++) {
+                free(out);
+                out = run(runners[i], llFile, &ok);
+                if (ok) runner = runners[i];
+            }
+            if (!runner && system("command -v lli >/dev/null || command -v clang >/dev/null")) {
+                printf("skipped: lli and clang were not found\n");
+                free(out);
+                remove(llFile);
+                return 0;
+            }
+        }
+        ok = ok && !strcmp(out, expected);
+        if (!report(ok, out, "-O%d", optLevel)) failed = 1;
+        free(out);
+    }
+    optLevel = 0;
+    pruning = false;
+    inlineBudget = 0;
+    if (!runner || !roundTrip(runner, llFile)) failed = 1;
+    remove(llFile);
+    char exe[80];
+    snprintf(exe, sizeof(exe), "%s.exe", llFile);
+    remove(exe);
+    return failed;
+}
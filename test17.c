@@ -0,0 +1,103 @@
+// quick exec: the program is generated in memory, built as a shared object in a new cache directory,
+// loaded and executed in this process. The second exec of the same program must find it in the cache,
+// and a changed program must be built again. The output of the program and the result of its main are checked.
+// The functions of a program named like the ones of the C library must not be replaced by those.
+// A cached program with the same hash but another content must not be loaded. The path of the cache has a quote.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ad.h"
+#include "exec.h"
+#include "testutil.h"
+
+static const char *program =
+    "var total:int;\n"
+    "function fact(n:int):int\n"
+    "  if(n<2) return 1; end\n"
+    "  return n*fact(n-1);\n"
+    "end\n"
+    "total=fact(10);\n"
+    "puti(total);\n"
+    "putr(2.5*4.0);\n"
+    "puts(\"exec\");\n"
+    "return total/1000000;\n";
+
+static const char *expected =
+    "3628800\n"
+    "10\n"
+    "exec\n";
+
+static const char *libcNames =
+    "function div(a:int, b:int):int\n"
+    "  return a*100+b;\n"
+    "end\n"
+    "function abs(x:int):int\n"
+    "  return x+1000;\n"
+    "end\n"
+    "puti(div(7,2));\n"
+    "puti(abs(0-5));\n";
+
+static const char *libcExpected =
+    "702\n"
+    "995\n";
+
+// the output of the program is written in outFile, instead of stdout
+static int execTo(const char *source, const char *outFile) {
+    execMode = true;
+    beginExec();
+    parse(source);
+    closeOutput();
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    if (!freopen(outFile, "w", stdout)) err("cannot write %s", outFile);
+    int result = execProgram();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return result;
+}
+
+static bool check(const char *name, int result, const char *outFile, bool compiled, int expectedResult,
+        const char *expectedOut) {
+    char *out = loadFile(outFile);
+    ExecStats s = execStats();
+    bool ok = result == expectedResult && !strcmp(out, expectedOut) && s.compiled == compiled;
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) printf("result %d, %s:\n%s", result, s.compiled ? "compiled" : "found in the cache", out);
+    showExecStats();
+    free(out);
+    return ok;
+}
+
+int main() {
+    char cache[64], outFile[64], file[128], cmd[128];
+    // the shell must not see the path of the cache
+    testFile(cache, sizeof(cache), "test17", "'s cache");
+    testFile(outFile, sizeof(outFile), "test17", ".out");
+    setenv("QUICK_CACHE", cache, 1);
+    traceSymbols = false;
+    int failed = 0;
+    if (!check("cold", execTo(program, outFile), outFile, true, 3, expected)) failed = 1;
+    if (!check("warm", execTo(program, outFile), outFile, false, 3, expected)) failed = 1;
+    // the same output, but from a different program
+    char *changed = (char *)malloc(strlen(program) + 16);
+    strcpy(changed, program);
+    strcat(changed, "total=0;\n");
+    if (!check("changed", execTo(changed, outFile), outFile, true, 3, expected)) failed = 1;
+    free(changed);
+    if (!check("libc names", execTo(libcNames, outFile), outFile, true, 0, libcExpected)) failed = 1;
+    // another program with the same hash: its shared object must not be loaded, so program is built again
+    snprintf(file, sizeof(file), "%s/%016llx-0.src", cache, (unsigned long long)execStats().key);
+    FILE *f = fopen(file, "w");
+    if (!f) err("cannot write %s", file);
+    fputs("another program", f);
+    fclose(f);
+    if (!check("same hash", execTo(libcNames, outFile), outFile, true, 0, libcExpected)) failed = 1;
+    if (!check("same hash, warm", execTo(libcNames, outFile), outFile, false, 0, libcExpected)) failed = 1;
+    remove(outFile);
+    snprintf(cmd, sizeof(cmd), "rm -rf \"%s\"", cache);
+    system(cmd);
+    return failed;
+}
@@ -0,0 +1,89 @@
+// The constant folder of -O (see opt.h): the program is compiled without and with -O, built with the C compiler
+// and the output of each executable is checked. It covers the int and real operations, the comparisons,
+// && and ||, the propagation of local variables and the constant conditions. The real operations whose result
+// is inf or NaN must not be folded, because C has no literals for them, and a literal too big for a double
+// (which is inf) must still give valid C code. The values merged after an if must keep the sign of 0.0.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "testutil.h"
+
+// 10^320, more than the max double
+#define TOO_BIG "10000000000000000000000000000000000000000.0*10000000000000000000000000000000000000000.0*" \
+    "10000000000000000000000000000000000000000.0*10000000000000000000000000000000000000000.0*" \
+    "10000000000000000000000000000000000000000.0*10000000000000000000000000000000000000000.0*" \
+    "10000000000000000000000000000000000000000.0*10000000000000000000000000000000000000000.0"
+
+static const char *program =
+    "var big:real;\n"
+    "function f(n:int):int\n"
+    "  var a:int;\n"
+    "  var b:int;\n"
+    "  a=6*7;\n"
+    "  b=a-2;\n"
+    "  if(0) n=n+1000; end\n"
+    "  return n+a*b/(b-30);\n"
+    "end\n"
+    // 0.0 and -0.0 are equal, but they are different values after an if
+    "function zero(c:int):int\n"
+    "  var x:real;\n"
+    "  if(c) x=0.0; else x=-0.0; end\n"
+    "  putr(1.0/x);\n"
+    "  return 0;\n"
+    "end\n"
+    "puti(0-7/2);\n"
+    "puti(3<4 && 2.5>=2.5);\n"
+    "puti(0 || 0.0);\n"
+    "putr(1.0/4.0+2.0*3.0);\n"
+    "putr(0.1+0.2);\n"
+    "putr(0.0-1.5);\n"
+    "big=(" TOO_BIG ");\n"
+    "putr(big);\n"
+    "putr(0.0-(" TOO_BIG "));\n"
+    "puti((" TOO_BIG ")-(" TOO_BIG ")!=(" TOO_BIG ")-(" TOO_BIG "));\n"
+    "puti((" TOO_BIG ")==(" TOO_BIG "));\n"
+    "puti(f(1));\n"
+    "zero(0);\n"
+    "zero(1);\n";
+
+static const char *expected =
+    "-3\n"
+    "1\n"
+    "0\n"
+    "6.25\n"
+    "0.3\n"
+    "-1.5\n"
+    "inf\n"
+    "-inf\n"
+    "1\n"
+    "1\n"
+    "169\n"
+    "-inf\n"
+    "inf\n"
+    "inf\n";
+
+int main() {
+    char cFile[64];
+    testFile(cFile, sizeof(cFile), "test8", ".c");
+    // a literal with 400 digits, which is read as inf
+    size_t n = strlen(program);
+    char *source = (char *)malloc(n + 420);
+    memcpy(source, program, n);
+    memcpy(source + n, "putr(1", 6);
+    memset(source + n + 6, '0', 400);
+    strcpy(source + n + 406, ".0);\n");
+    int failed = 0;
+    for (optLevel = 0; optLevel <= 1; optLevel++) {
+        bool ok;
+        char *out = compileAndRun(source, cFile, "-O0 -w -I.", &ok);
+        ok = ok && !strcmp(out, expected) && (!optLevel || optStats().folded > 0);
+        if (!report(ok, out, "-O%d", optLevel)) failed = 1;
+        free(out);
+    }
+    remove(cFile);
+    free(source);
+    showOptStats();
+    return failed;
+}
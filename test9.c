@@ -0,0 +1,72 @@
+// The SSA passes of -O2 (see ir.h): the program is compiled without and with -O2, built with the C compiler
+// and the output of each executable is checked. At -O2, the loop invariant division by a constant must be hoisted,
+// the repeated a*b must be removed by the common subexpressions, and the global stores overwritten
+// before being read must be removed. The division by an argument must remain in its loop, which is not executed
+// when the divisor is 0.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "ir.h"
+#include "testutil.h"
+
+static const char *program =
+    "var g:int;\n"
+    "function hoist(n:int, x:int):int\n"
+    "  var i:int;\n"
+    "  var s:int;\n"
+    "  i=0; s=0;\n"
+    "  while(i<n)\n"
+    "    s=s+x/7+x*x;\n"
+    "    i=i+1;\n"
+    "  end\n"
+    "  return s;\n"
+    "end\n"
+    "function guarded(n:int, d:int):int\n"
+    "  var i:int;\n"
+    "  var s:int;\n"
+    "  i=0; s=0;\n"
+    "  while(i<n)\n"
+    "    s=s+n/d;\n"
+    "    i=i+1;\n"
+    "  end\n"
+    "  return s;\n"
+    "end\n"
+    "function common(a:int, b:int):int\n"
+    "  return a*b+(a*b)/2+(a*b-b);\n"
+    "end\n"
+    "function stores(x:int):int\n"
+    "  g=x;\n"
+    "  g=x+1;\n"
+    "  g=g*2;\n"
+    "  return g;\n"
+    "end\n"
+    "puti(hoist(10, 100));\n"
+    "puti(guarded(0, 0));\n"
+    "puti(guarded(5, 2));\n"
+    "puti(common(6, 7));\n"
+    "puti(stores(4));\n"
+    "puti(g);\n";
+
+static const char *expected = "100140\n0\n10\n98\n10\n10\n";
+
+int main() {
+    char cFile[64];
+    testFile(cFile, sizeof(cFile), "test9", ".c");
+    int failed = 0;
+    for (optLevel = 0; optLevel <= 2; optLevel += 2) {
+        bool ok;
+        char *out = compileAndRun(program, cFile, "-O0 -w -I.", &ok);
+        ok = ok && !strcmp(out, expected);
+        if (optLevel == 2) {
+            IrStats s = irStats();
+            ok = ok && s.hoisted > 0 && s.cse > 0 && s.deadStores > 0;
+        }
+        if (!report(ok, out, "-O%d", optLevel)) failed = 1;
+        free(out);
+    }
+    remove(cFile);
+    showPassTimes();
+    return failed;
+}
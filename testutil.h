@@ -0,0 +1,71 @@
+#pragma once
+
+// The helpers of the tests which compile a Quick program, build the generated code and check the output
+// of the executable. They are defined in the header, like the functions of quick.h, so the tests are still
+// built only with the modules of the compiler (without main.c).
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "out.h"
+#include "parser.h"
+#include "utils.h"
+
+// puts in file the name of a temporary file of the test: /tmp/<test>_<pid><ext>
+static inline void testFile(char *file, size_t size, const char *test, const char *ext) {
+    if (snprintf(file, size, "/tmp/%s_%d%s", test, (int)getpid(), ext) >= (int)size) err("the file name is too long");
+}
+
+// runs cmd with the shell and returns its output (stdout), dynamically allocated
+// *ok is set to true if cmd succeeded
+static inline char *capture(const char *cmd, bool *ok) {
+    FILE *p = popen(cmd, "r");
+    if (!p) err("cannot run %s", cmd);
+    size_t capacity = 4096, n = 0, k;
+    char *out = (char *)safeAlloc(capacity);
+    while ((k = fread(out + n, 1, capacity - n - 1, p)) > 0) {
+        n += k;
+        if (n + 1 == capacity) {
+            capacity *= 2;
+            char *q = (char *)realloc(out, capacity);
+            if (!q) err("not enough memory");
+            out = q;
+        }
+    }
+    out[n] = '\0';
+    *ok = !pclose(p);
+    return out;
+}
+
+// compiles source with the current options (optLevel, asmMode...) to file, builds it with $CC (default cc)
+// and ccFlags, then runs the executable and returns its output, dynamically allocated
+// *ok is set to true if the build and the run succeeded
+static inline char *compileAndRun(const char *source, const char *file, const char *ccFlags, bool *ok) {
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    char cmd[512];
+    openOutput(file);
+    parse(source);
+    closeOutput();
+    if (snprintf(cmd, sizeof(cmd), "%s %s -o %s.exe %s && %s.exe", cc, ccFlags, file, file, file) >= (int)sizeof(cmd)) {
+        err("the command is too long");
+    }
+    char *out = capture(cmd, ok);
+    snprintf(cmd, sizeof(cmd), "%s.exe", file);
+    remove(cmd);
+    return out;
+}
+
+// prints the name of the case, formatted like printf, followed by ok or FAILED; on failure it also prints out
+// returns ok
+static inline bool report(bool ok, const char *out, const char *fmt, ...) {
+    va_list va;
+    va_start(va, fmt);
+    vprintf(fmt, va);
+    va_end(va);
+    printf(": %s\n", ok ? "ok" : "FAILED");
+    if (!ok) printf("%s", out);
+    return ok;
+}
@@ -1,6 +1,15 @@
+#define _DEFAULT_SOURCE		// MAP_ANONYMOUS
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 
 #include "utils.h"
 
@@ -33,3 +42,189 @@ char *loadFile(const char *fileName){
 	buf[n]='\0';
 	return buf;
 	}
+
+// reads all the content of fd in a buffer which doubles its capacity when full
+static Source readStream(int fd,const char *fileName){
+	size_t capacity=64*1024,n=0;
+	char *buf=(char*)safeAlloc(capacity);
+	for(;;){
+		if(n+1==capacity){
+			capacity*=2;
+			char *p=(char*)realloc(buf,capacity);
+			if(!p)err("not enough memory");
+			buf=p;
+			}
+		ssize_t k=read(fd,buf+n,capacity-n-1);
+		if(k==0)break;
+		if(k<0){
+			if(errno==EINTR)continue;
+			err("cannot read %s",fileName);
+			}
+		n+=(size_t)k;
+		if(n>MAX_SOURCE_SIZE)err("%s is too large: the max size of an input is %u bytes",fileName,MAX_SOURCE_SIZE);
+		}
+	buf[n]='\0';
+	return (Source){buf,n,NULL,0};
+	}
+
+// maps the file in memory, followed by at least one zero byte
+// First an anonymous zeroed region is reserved, large enough for the file plus the final '\0',
+// then the file is mapped over its beginning. In this way the '\0' exists even if
+// the file size is a multiple of the page size.
+static Source mapFile(int fd,size_t n,const char *fileName){
+	size_t page=(size_t)sysconf(_SC_PAGESIZE);
+	size_t mapSize=(n+1+page-1)/page*page;
+	void *base=mmap(NULL,mapSize,PROT_READ,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if(base==MAP_FAILED)err("cannot map %s",fileName);
+	if(mmap(base,n,PROT_READ,MAP_PRIVATE|MAP_FIXED,fd,0)==MAP_FAILED)err("cannot map %s",fileName);
+	madvise(base,mapSize,MADV_SEQUENTIAL);		// the lexer reads it from start to end
+	return (Source){(const char*)base,n,base,mapSize};
+	}
+
+Source loadSource(const char *fileName){
+	if(!fileName||!strcmp(fileName,"-"))return readStream(STDIN_FILENO,"stdin");
+	int fd=open(fileName,O_RDONLY);
+	if(fd<0)err("unable to open %s",fileName);
+	struct stat st;
+	if(fstat(fd,&st)<0)err("cannot stat %s",fileName);
+	Source src;
+	if(S_ISREG(st.st_mode)&&(unsigned long long)st.st_size>MAX_SOURCE_SIZE){
+		err("%s is too large: the max size of an input is %u bytes",fileName,MAX_SOURCE_SIZE);
+		}
+	if(S_ISREG(st.st_mode)&&st.st_size>0){
+		src=mapFile(fd,(size_t)st.st_size,fileName);
+		}else{
+		src=readStream(fd,fileName);
+		}
+	close(fd);
+	return src;
+	}
+
+void freeSource(Source *src){
+	if(src->map)munmap(src->map,src->mapSize);
+	else free((void*)src->text);
+	src->text=NULL;
+	src->n=0;
+	src->map=NULL;
+	}
+
+#define ARENA_BLOCK_SIZE (64*1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct ArenaBlock{
+	ArenaBlock *prev;		// the previous block of the arena
+	size_t size;		// the size of data
+	alignas(max_align_t) char data[];
+	};
+
+static _Atomic(Arena*) arenas;		// all the used arenas
+// the memory reserved by the blocks of all arenas
+// the arenas can be used from different threads, so these are atomic
+static _Atomic size_t reservedBytes,reservedPeak;
+
+static void addReserved(size_t n){
+	size_t crt=atomic_fetch_add(&reservedBytes,n)+n;
+	size_t peak=atomic_load(&reservedPeak);
+	while(crt>peak&&!atomic_compare_exchange_weak(&reservedPeak,&peak,crt)){}
+	}
+
+static void freeBlock(Arena *a,ArenaBlock *b){
+	atomic_fetch_sub(&reservedBytes,sizeof(ArenaBlock)+b->size);
+	a->nBlocks--;
+	free(b);
+	}
+
+// adds to the arena a block with at least nBytes
+static void newBlock(Arena *a,size_t nBytes){
+	if(!a->total&&!a->nBlocks){		// first use: adds the arena to the list
+		a->next=atomic_load(&arenas);
+		while(!atomic_compare_exchange_weak(&arenas,&a->next,a)){}
+		}
+	ArenaBlock *b;
+	if(a->spare&&a->spare->size>=nBytes){
+		b=a->spare;
+		a->spare=NULL;
+		}else{
+		size_t size=nBytes>ARENA_BLOCK_SIZE?nBytes:ARENA_BLOCK_SIZE;
+		b=(ArenaBlock*)safeAlloc(sizeof(ArenaBlock)+size);
+		b->size=size;
+		a->nBlocks++;
+		addReserved(sizeof(ArenaBlock)+size);
+		}
+	b->prev=a->block;
+	a->block=b;
+	a->p=b->data;
+	a->end=b->data+b->size;
+	}
+
+void *arenaAlloc(Arena *a,size_t nBytes){
+	nBytes=(nBytes+ARENA_ALIGN-1)&~(size_t)(ARENA_ALIGN-1);
+	if((size_t)(a->end-a->p)<nBytes)newBlock(a,nBytes);
+	void *p=a->p;
+	a->p+=nBytes;
+	a->last=p;
+	a->used+=nBytes;
+	a->total+=nBytes;
+	if(a->used>a->peak)a->peak=a->used;
+	return p;
+	}
+
+void *arenaGrow(Arena *a,void *p,size_t oldSize,size_t newSize){
+	oldSize=(oldSize+ARENA_ALIGN-1)&~(size_t)(ARENA_ALIGN-1);
+	size_t add=((newSize+ARENA_ALIGN-1)&~(size_t)(ARENA_ALIGN-1))-oldSize;
+	if(p&&p==a->last&&(size_t)(a->end-a->p)>=add){
+		a->p+=add;
+		a->used+=add;
+		a->total+=add;
+		if(a->used>a->peak)a->peak=a->used;
+		return p;
+		}
+	void *q=arenaAlloc(a,newSize);
+	if(p)memcpy(q,p,oldSize<newSize?oldSize:newSize);
+	return q;
+	}
+
+ArenaMark arenaMark(Arena *a){
+	return (ArenaMark){a->block,a->p,a->used};
+	}
+
+void arenaRelease(Arena *a,ArenaMark mark){
+	while(a->block!=mark.block){
+		ArenaBlock *b=a->block;
+		a->block=b->prev;
+		if(!a->spare||a->spare->size<b->size){		// keeps the largest released block
+			if(a->spare)freeBlock(a,a->spare);
+			a->spare=b;
+			}else{
+			freeBlock(a,b);
+			}
+		}
+	if(mark.block){
+		a->p=mark.p;
+		a->end=mark.block->data+mark.block->size;
+		}else{
+		a->p=a->end=NULL;
+		}
+	a->last=NULL;
+	a->used=mark.used;
+	}
+
+void arenaFree(Arena *a){
+	arenaRelease(a,(ArenaMark){NULL,NULL,0});
+	if(a->spare){
+		freeBlock(a,a->spare);
+		a->spare=NULL;
+		}
+	}
+
+void freeArenas(){
+	for(Arena *a=atomic_load(&arenas);a;a=a->next)arenaFree(a);
+	}
+
+void showArenaStats(){
+	printf("%-12s %14s %14s %14s\n","arena","allocated","peak","in use");
+	for(Arena *a=atomic_load(&arenas);a;a=a->next){
+		printf("%-12s %14zu %14zu %14zu\n",a->name,a->total,a->peak,a->used);
+		}
+	printf("peak reserved by all arenas: %zu bytes\n",atomic_load(&reservedPeak));
+	}
@@ -15,3 +15,77 @@ void *safeAlloc(size_t nBytes);
 // on error, prints a message and exit the program
 char *loadFile(const char *fileName);
 
+
+// an input text which is ready to be given to the lexer
+// the content is always followed by a '\0', which is not counted in "n"
+typedef struct{
+	const char *text;		// the chars of the input
+	size_t n;		// nr of chars, without the final '\0'
+	void *map;		// if the file was memory-mapped, the start of the mapping, else NULL
+	size_t mapSize;		// the size of the mapping
+	}Source;
+
+// the max size of an input, because the tokens keep 32 bit offsets in it (see Token)
+#define MAX_SOURCE_SIZE 0xFFFFFFFFu
+
+// loads the input for the lexer
+// regular files are memory-mapped read-only, without copying them
+// pipes, terminals and stdin (fileName==NULL or "-") are read in a growing buffer
+// on error or if the input is larger than MAX_SOURCE_SIZE, prints a message and exit the program
+Source loadSource(const char *fileName);
+
+// releases the memory of a Source loaded with loadSource
+void freeSource(Source *src);
+
+// An arena allocates memory by advancing a pointer inside big blocks.
+// The allocations are not freed one by one: an arena is freed all at once,
+// or back to a mark (for example when a domain is deleted).
+// Each subsystem has its own arena, so the statistics show the memory used by each one.
+// An arena must be used by a single thread at a time.
+typedef struct ArenaBlock ArenaBlock;
+typedef struct Arena Arena;
+struct Arena{
+	const char *name;		// the subsystem which uses the arena
+	ArenaBlock *block;		// the current block; it links to the previous ones
+	ArenaBlock *spare;		// a released block, kept for reuse
+	char *p;		// the first free byte from the current block
+	char *end;		// the end of the current block
+	void *last;		// the last allocation, which can grow in place
+	size_t used;		// nr of currently allocated bytes
+	size_t peak;		// the maximum value of used
+	size_t total;		// nr of bytes allocated since the arena was created, including the released ones
+	size_t nBlocks;		// nr of currently allocated blocks
+	Arena *next;		// the list of arenas, used for statistics
+	};
+
+// the initializer of an arena; name is shown in statistics
+#define ARENA(name)		{name}
+
+typedef struct{
+	ArenaBlock *block;
+	char *p;
+	size_t used;
+	}ArenaMark;
+
+// allocates nBytes aligned for any type
+// on error, prints a message and exit the program
+void *arenaAlloc(Arena *a,size_t nBytes);
+
+// changes the size of an allocation from oldSize to newSize and returns its new address
+// if p is the last allocation and there is enough space, it grows in place, else it is copied
+void *arenaGrow(Arena *a,void *p,size_t oldSize,size_t newSize);
+
+// returns a mark for the current state of the arena
+ArenaMark arenaMark(Arena *a);
+
+// frees all the allocations made after the mark
+void arenaRelease(Arena *a,ArenaMark mark);
+
+// frees all the memory of the arena
+void arenaFree(Arena *a);
+
+// frees all the arenas which were used, at the end of the compilation
+void freeArenas();
+
+// prints for each used arena its allocated bytes and peak, and the peak of the memory reserved by all arenas
+void showArenaStats();
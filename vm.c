@@ -0,0 +1,655 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "atoms.h"
+#include "lexer.h"
+#include "utils.h"
+#include "vm.h"
+
+bool vmMode;
+FILE *vmDump;
+static VmStats stats;
+static Arena vmArena = ARENA("vm");
+
+// the instructions; R[x] is the register x of the current frame, G[k] is the global variable k
+#define VM_OPS(X) \
+    X(MOV)      /* R[a]=R[b] */ \
+    X(LOADI)    /* R[a]=k */ \
+    X(LOADR)    /* R[a]=reals[k] */ \
+    X(LOADS)    /* R[a]=strs[k] */ \
+    X(LOADG)    /* R[a]=G[k] */ \
+    X(STOREG)   /* G[k]=R[a] */ \
+    X(ADDI) X(SUBI) X(MULI) X(DIVI)     /* R[a]=R[b] op R[c], for int and real */ \
+    X(ADDR) X(SUBR) X(MULR) X(DIVR) \
+    X(LTI) X(LEI) X(EQI) X(NEI)         /* R[a]=R[b] op R[c], for int, real and str; the result is an int */ \
+    X(LTR) X(LER) X(EQR) X(NER) \
+    X(LTS) X(LES) X(EQS) X(NES) \
+    X(NEGI) X(NEGR)     /* R[a]=-R[b] */ \
+    X(NOTI) X(NOTR)     /* R[a]=!R[b] */ \
+    X(JMP)      /* jumps k instructions from the current one */ \
+    X(JZI) X(JZR) X(JZS)    /* jumps if R[a] is 0 */ \
+    X(JNZI) X(JNZR)         /* jumps if R[a] is not 0 */ \
+    X(CALL)     /* calls fns[k] with the frame starting at R[a]; the result is in R[a] */ \
+    X(TAILCALL) /* copies the arguments from R[a] to the parameters and jumps to the start of fns[k] */ \
+    X(RET)      /* returns R[a] */ \
+    X(PUTI) X(PUTR) X(PUTS)     /* writes R[a] */ \
+    X(HALT)
+
+#define OP_ENUM(name)   OP_##name,
+enum{VM_OPS(OP_ENUM) OP_COUNT};
+#define OP_NAME(name)   #name,
+static const char *opNames[OP_COUNT] = {VM_OPS(OP_NAME)};
+
+typedef struct{
+    uint8_t op;         // OP_*
+    uint16_t a;         // a register
+    union{
+        struct{uint16_t b, c;};     // the operands, for the instructions with 3 registers
+        int32_t k;                  // a constant, a global variable, a function or a jump
+    };
+}Instr;
+
+typedef union{
+    int i;
+    double r;
+    const char *s;
+}Value;
+
+typedef struct{
+    Instr *instrs;
+    int n, cap;
+}Code;
+
+typedef struct{
+    const char *name;
+    int nParams;
+    int nRegs;          // the size of its frame
+    int start;          // its first instruction in fnCode
+}Fn;
+
+// a map from names (atoms, compared by pointer) to indexes, in an open addressing table
+typedef struct{
+    const char **names;
+    int *values;
+    int n, cap;
+}NameMap;
+
+static Code fnCode, mainCode;       // the code of all the functions and of the global code
+static Fn *fns;
+static int nFns, capFns;
+static NameMap fnMap, globalMap;
+static const char **globalNames;
+static int capGlobals;
+static double *reals;
+static int nReals, capReals;
+static const char **strs;
+static int nStrs, capStrs;
+static int mainRegs;                // the size of the frame of the global code
+
+// the compilation state of the current item
+static Code *code;
+static int crtFn;                   // the index of the current function, -1 for the global code
+static const char **vars;           // the parameters and local variables, in the first registers
+static int nVars, capVars;
+static int top, maxTop;             // the first free register and the number of used registers
+static const char *atomPuti, *atomPutr, *atomPuts;
+
+#define MAX_REGS        65535
+#define STACK_SIZE      (1 << 22)   // the registers of all the frames
+#define MAX_FRAMES      (1 << 20)
+
+// grows an array allocated in vmArena to have room for n+1 elements
+static void *grow(void *p, int *cap, int n, size_t size) {
+    if (n < *cap) return p;
+    int newCap = *cap ? *cap * 2 : 64;
+    p = arenaGrow(&vmArena, p, *cap * size, newCap * size);
+    *cap = newCap;
+    return p;
+}
+
+static size_t slotOf(const NameMap *m, const char *name) {
+    return (size_t)(((uintptr_t)name >> 3) * 0x9E3779B97F4A7C15ull >> 32) & (m->cap - 1);
+}
+
+static int mapFind(const NameMap *m, const char *name) {
+    if (!m->cap) return -1;
+    for (size_t h = slotOf(m, name); m->names[h]; h = (h + 1) & (m->cap - 1)) {
+        if (m->names[h] == name) return m->values[h];
+    }
+    return -1;
+}
+
+static void mapAdd(NameMap *m, const char *name, int value) {
+    if (2 * (m->n + 1) > m->cap) {
+        NameMap old = *m;
+        m->cap = m->cap ? m->cap * 2 : 256;
+        m->names = (const char **)arenaAlloc(&vmArena, m->cap * sizeof(const char *));
+        memset(m->names, 0, m->cap * sizeof(const char *));
+        m->values = (int *)arenaAlloc(&vmArena, m->cap * sizeof(int));
+        m->n = 0;
+        for (int k = 0; k < old.cap; k++) {
+            if (old.names[k]) mapAdd(m, old.names[k], old.values[k]);
+        }
+    }
+    size_t h = slotOf(m, name);
+    while (m->names[h]) h = (h + 1) & (m->cap - 1);
+    m->names[h] = name;
+    m->values[h] = value;
+    m->n++;
+}
+
+void resetVm(void) {
+    memset(&fnCode, 0, sizeof(Code));
+    memset(&mainCode, 0, sizeof(Code));
+    memset(&fnMap, 0, sizeof(NameMap));
+    memset(&globalMap, 0, sizeof(NameMap));
+    fns = NULL;
+    nFns = capFns = 0;
+    globalNames = NULL;
+    capGlobals = 0;
+    reals = NULL;
+    nReals = capReals = 0;
+    strs = NULL;
+    nStrs = capStrs = 0;
+    mainRegs = 0;
+    memset(&stats, 0, sizeof(stats));
+    atomPuti = intern("puti", 4);
+    atomPutr = intern("putr", 4);
+    atomPuts = intern("puts", 4);
+}
+
+static int emit(int op, int a, int b, int c) {
+    code->instrs = (Instr *)grow(code->instrs, &code->cap, code->n, sizeof(Instr));
+    Instr *in = &code->instrs[code->n];
+    memset(in, 0, sizeof(Instr));
+    in->op = op;
+    in->a = a;
+    in->b = b;
+    in->c = c;
+    return code->n++;
+}
+
+static int emitK(int op, int a, int k) {
+    int at = emit(op, a, 0, 0);
+    code->instrs[at].k = k;
+    return at;
+}
+
+// the jump at makes its target the next instruction
+static void patch(int at) {
+    code->instrs[at].k = code->n - at;
+}
+
+static void move(int dst, int src) {
+    if (dst != src) emit(OP_MOV, dst, src, 0);
+}
+
+static int newReg(void) {
+    if (top >= MAX_REGS) err("too many registers in a function for the bytecode");
+    if (++top > maxTop) maxTop = top;
+    return top - 1;
+}
+
+static void addVar(const char *name) {
+    vars = (const char **)grow(vars, &capVars, nVars, sizeof(const char *));
+    vars[nVars++] = name;
+}
+
+static int varReg(const char *name) {
+    for (int i = nVars - 1; i >= 0; i--) {
+        if (vars[i] == name) return i;
+    }
+    err("internal error: unknown local variable %s in bytecode", name);
+}
+
+static int globalIndex(const char *name) {
+    int g = mapFind(&globalMap, name);
+    if (g < 0) err("internal error: unknown global variable %s in bytecode", name);
+    return g;
+}
+
+static int addReal(double r) {
+    reals = (double *)grow(reals, &capReals, nReals, sizeof(double));
+    reals[nReals] = r;
+    return nReals++;
+}
+
+// the chars of a string constant, with its escape sequences replaced
+static int addStr(const Node *n) {
+    const char *p = tkInput + n->pos, *end = p + n->len;
+    char *s = (char *)arenaAlloc(&vmArena, n->len + 1), *q = s;
+    while (p < end) {
+        if (*p != '\\' || p + 1 == end) {
+            *q++ = *p++;
+            continue;
+        }
+        switch (p[1]) {
+            case 'n': *q++ = '\n'; break;
+            case 't': *q++ = '\t'; break;
+            case 'r': *q++ = '\r'; break;
+            case '0': *q++ = '\0'; break;
+            case 'a': *q++ = '\a'; break;
+            case 'b': *q++ = '\b'; break;
+            case 'f': *q++ = '\f'; break;
+            case 'v': *q++ = '\v'; break;
+            default: *q++ = p[1];
+        }
+        p += 2;
+    }
+    *q = '\0';
+    strs = (const char **)grow(strs, &capStrs, nStrs, sizeof(const char *));
+    strs[nStrs] = s;
+    return nStrs++;
+}
+
+// a jump if the register reg of the given type is 0 (ifZero) or not 0
+static int jumpIf(int reg, int type, bool ifZero) {
+    if (type == TYPE_STR) {
+        if (!ifZero) err("internal error: a string used as a logical operand in bytecode");
+        return emitK(OP_JZS, reg, 0);
+    }
+    if (ifZero) return emitK(type == TYPE_REAL ? OP_JZR : OP_JZI, reg, 0);
+    return emitK(type == TYPE_REAL ? OP_JNZR : OP_JNZI, reg, 0);
+}
+
+static void exprTo(int id, int dst);
+
+// returns the register with the value of the expression id: the register of a local variable or a new one
+static int expr(int id) {
+    const Node *n = &nodes[id];
+    if (n->kind == N_PAREN) return expr(n->a);
+    if (n->kind == N_VAR && n->local) return varReg(n->name);
+    if (n->kind == N_ASSIGN && n->local) {
+        int r = varReg(n->name);
+        exprTo(n->a, r);
+        return r;
+    }
+    int r = newReg();
+    exprTo(id, r);
+    return r;
+}
+
+static void binary(const Node *n, int dst, int left, int right) {
+    int type = nodes[n->a].type, op;
+    bool swap = false;
+    switch (n->op) {
+        case ADD: case SUB: case MUL: case DIV:
+            if (type == TYPE_STR) err("line %d: the strings cannot be used in arithmetic", n->line);
+            op = (type == TYPE_REAL ? OP_ADDR : OP_ADDI) + (n->op == ADD ? 0 : n->op == SUB ? 1 : n->op == MUL ? 2 : 3);
+            break;
+        default:
+            // a>b is b<a and a>=b is b<=a
+            swap = n->op == GREATER || n->op == GREATEREQ;
+            op = type == TYPE_REAL ? OP_LTR : type == TYPE_STR ? OP_LTS : OP_LTI;
+            op += n->op == LESS || n->op == GREATER ? 0 : n->op == LESSEQ || n->op == GREATEREQ ? 1 : n->op == EQUAL ? 2 : 3;
+    }
+    if (swap) emit(op, dst, right, left);
+    else emit(op, dst, left, right);
+}
+
+// a&&b and a||b are 1 or 0, and b is evaluated only if a does not decide the result
+static void logic(const Node *n, int dst) {
+    bool isAnd = n->op == AND;
+    int mark = top;
+    int a = expr(n->a);
+    int j1 = jumpIf(a, nodes[n->a].type, isAnd);
+    top = mark;
+    int b = expr(n->b);
+    int j2 = jumpIf(b, nodes[n->b].type, isAnd);
+    emitK(OP_LOADI, dst, isAnd);
+    int end = emitK(OP_JMP, 0, 0);
+    patch(j1);
+    patch(j2);
+    emitK(OP_LOADI, dst, !isAnd);
+    patch(end);
+}
+
+static void call(const Node *n, int dst) {
+    if (n->name == atomPuti || n->name == atomPutr || n->name == atomPuts) {
+        int x = expr(n->a);
+        emit(n->name == atomPuti ? OP_PUTI : n->name == atomPutr ? OP_PUTR : OP_PUTS, x, 0, 0);
+        move(dst, x);
+        return;
+    }
+    int f = mapFind(&fnMap, n->name);
+    if (f < 0) err("internal error: unknown function %s in bytecode", n->name);
+    int base = top;
+    for (int a = n->a; a; a = nodes[a].next) exprTo(a, newReg());
+    if (top == base) newReg();      // the register of the result
+    emitK(OP_CALL, base, f);
+    move(dst, base);
+}
+
+// compiles the expression id so its value is put in the register dst
+static void exprTo(int id, int dst) {
+    const Node *n = &nodes[id];
+    int mark = top;
+    switch (n->kind) {
+        case N_INT: emitK(OP_LOADI, dst, n->i); break;
+        case N_REAL: emitK(OP_LOADR, dst, addReal(n->r)); break;
+        case N_STR: emitK(OP_LOADS, dst, addStr(n)); break;
+        case N_VAR:
+            if (n->local) move(dst, varReg(n->name));
+            else emitK(OP_LOADG, dst, globalIndex(n->name));
+            break;
+        case N_PAREN: exprTo(n->a, dst); break;
+        case N_NEG: case N_NOT: {
+            int x = expr(n->a);
+            bool isReal = nodes[n->a].type == TYPE_REAL;
+            if (n->kind == N_NEG) emit(isReal ? OP_NEGR : OP_NEGI, dst, x, 0);
+            else emit(isReal ? OP_NOTR : OP_NOTI, dst, x, 0);
+            break;
+        }
+        case N_BIN:
+            if (n->op == AND || n->op == OR) {
+                logic(n, dst);
+            } else {
+                int left = expr(n->a);
+                int right = expr(n->b);
+                binary(n, dst, left, right);
+            }
+            break;
+        case N_ASSIGN:
+            if (n->local) {
+                int r = varReg(n->name);
+                exprTo(n->a, r);
+                move(dst, r);
+            } else {
+                int x = expr(n->a);
+                emitK(OP_STOREG, x, globalIndex(n->name));
+                move(dst, x);
+            }
+            break;
+        case N_CALL: call(n, dst); break;
+        case N_COND: {
+            int cond = expr(n->a);
+            int jz = jumpIf(cond, nodes[n->a].type, true);
+            top = mark;
+            exprTo(n->b, dst);
+            int end = emitK(OP_JMP, 0, 0);
+            patch(jz);
+            exprTo(n->c, dst);
+            patch(end);
+            break;
+        }
+        case N_SEQ:
+            expr(n->a);
+            top = mark;
+            exprTo(n->b, dst);
+            break;
+        default:
+            err("internal error: wrong expression node %d in bytecode", n->kind);
+    }
+    top = mark;
+}
+
+static void compileList(int id);
+
+static void compileInstr(int id) {
+    const Node *n = &nodes[id];
+    int mark = top;
+    switch (n->kind) {
+        case N_EXPR: expr(n->a); break;
+        case N_EMPTY: break;
+        case N_IF: {
+            int jz = jumpIf(expr(n->a), nodes[n->a].type, true);
+            top = mark;
+            compileList(n->b);
+            if (n->c) {
+                int end = emitK(OP_JMP, 0, 0);
+                patch(jz);
+                compileList(n->c);
+                patch(end);
+            } else {
+                patch(jz);
+            }
+            break;
+        }
+        case N_WHILE: {
+            int start = code->n;
+            int jz = jumpIf(expr(n->a), nodes[n->a].type, true);
+            top = mark;
+            compileList(n->b);
+            emitK(OP_JMP, 0, start - code->n);
+            patch(jz);
+            break;
+        }
+        case N_RETURN: {
+            int call = crtFn >= 0 ? tailCall(id) : 0;
+            if (call) {
+                int base = top;
+                for (int a = nodes[call].a; a; a = nodes[a].next) exprTo(a, newReg());
+                emitK(OP_TAILCALL, base, crtFn);
+            } else {
+                int r = expr(n->a);
+                // a return from the global code ends the program, like in the C main function
+                if (crtFn >= 0) emit(OP_RET, r, 0, 0);
+                else emit(OP_HALT, 0, 0, 0);
+            }
+            break;
+        }
+        default:
+            err("internal error: wrong instruction node %d in bytecode", n->kind);
+    }
+    top = mark;
+}
+
+static void compileList(int id) {
+    for (; id; id = nodes[id].next) compileInstr(id);
+}
+
+static void compileFn(const Node *fn) {
+    nFns++;
+    fns = (Fn *)grow(fns, &capFns, nFns, sizeof(Fn));
+    crtFn = nFns - 1;
+    mapAdd(&fnMap, fn->name, crtFn);    // before the body, for the recursive calls
+    code = &fnCode;
+    int start = code->n;
+    nVars = 0;
+    for (int a = fn->a; a; a = nodes[a].next) addVar(nodes[a].name);
+    int nParams = nVars;
+    for (int v = fn->b; v; v = nodes[v].next) addVar(nodes[v].name);
+    top = maxTop = nVars;
+    compileList(fn->c);
+    // the end of a function without return
+    int r = newReg();
+    emitK(OP_LOADI, r, 0);
+    emit(OP_RET, r, 0, 0);
+    fns[crtFn] = (Fn){fn->name, nParams, maxTop, start};
+    stats.fns++;
+}
+
+static void compileGlobalCode(int id) {
+    crtFn = -1;
+    code = &mainCode;
+    nVars = 0;
+    if (nodes[id].kind == N_BLOCK) {
+        // the local variables created by the inliner are the first registers of the global code
+        for (int v = nodes[id].a; v; v = nodes[v].next) addVar(nodes[v].name);
+        id = nodes[id].b;
+    }
+    top = maxTop = nVars;
+    compileList(id);
+    if (maxTop > mainRegs) mainRegs = maxTop;
+}
+
+static void dumpCode(FILE *fis, const Code *c, int from) {
+    for (int i = from; i < c->n; i++) {
+        const Instr *in = &c->instrs[i];
+        fprintf(fis, "  %4d  %-8s", i, opNames[in->op]);
+        switch (in->op) {
+            case OP_LOADI: fprintf(fis, " r%d, %d", in->a, in->k); break;
+            case OP_LOADR: fprintf(fis, " r%d, %g", in->a, reals[in->k]); break;
+            case OP_LOADS: fprintf(fis, " r%d, \"%s\"", in->a, strs[in->k]); break;
+            case OP_LOADG: case OP_STOREG: fprintf(fis, " r%d, %s", in->a, globalNames[in->k]); break;
+            case OP_JMP: fprintf(fis, " %d", i + in->k); break;
+            case OP_JZI: case OP_JZR: case OP_JZS: case OP_JNZI: case OP_JNZR:
+                fprintf(fis, " r%d, %d", in->a, i + in->k);
+                break;
+            case OP_CALL: case OP_TAILCALL: fprintf(fis, " r%d, %s", in->a, fns[in->k].name); break;
+            case OP_MOV: case OP_NEGI: case OP_NEGR: case OP_NOTI: case OP_NOTR:
+                fprintf(fis, " r%d, r%d", in->a, in->b);
+                break;
+            case OP_RET: case OP_PUTI: case OP_PUTR: case OP_PUTS: fprintf(fis, " r%d", in->a); break;
+            case OP_HALT: break;
+            default: fprintf(fis, " r%d, r%d, r%d", in->a, in->b, in->c);
+        }
+        fputc('\n', fis);
+    }
+}
+
+void compileBytecode(int id) {
+    const Node *n = &nodes[id];
+    int fnStart = fnCode.n, mainStart = mainCode.n;
+    switch (n->kind) {
+        case N_VARDEF:
+            globalNames = (const char **)grow(globalNames, &capGlobals, stats.globals, sizeof(const char *));
+            globalNames[stats.globals] = n->name;
+            mapAdd(&globalMap, n->name, stats.globals++);
+            break;
+        case N_FN:
+            compileFn(n);
+            break;
+        default:
+            compileGlobalCode(id);
+    }
+    stats.instrs = fnCode.n + mainCode.n;
+    if (!vmDump || n->kind == N_VARDEF) return;
+    if (n->kind == N_FN) {
+        const Fn *f = &fns[nFns - 1];
+        fprintf(vmDump, "fn %s: %d parameters, %d registers\n", f->name, f->nParams, f->nRegs);
+        dumpCode(vmDump, &fnCode, fnStart);
+    } else {
+        fprintf(vmDump, "global code\n");
+        dumpCode(vmDump, &mainCode, mainStart);
+    }
+}
+
+typedef struct{
+    const Instr *ret;       // the instruction after the call
+    Value *regs;            // the frame of the caller
+}Frame;
+
+static void execute(const Instr *pc, Value *stack, Value *globals, Frame *frames) {
+    Value *R = stack;
+    const Value *stackEnd = stack + STACK_SIZE;
+    Frame *fp = frames;
+    const Frame *framesEnd = frames + MAX_FRAMES;
+    const Instr *fnInstrs = fnCode.instrs;
+#if defined(__GNUC__) && !defined(VM_SWITCH)
+    // each instruction jumps directly to the code of the next one, without a switch
+    #define OP_LABEL(name)  &&L_##name,
+    static void *labels[OP_COUNT] = {VM_OPS(OP_LABEL)};
+    #define CASE(name)      L_##name
+    #define NEXT            goto *labels[pc->op]
+    NEXT;
+#else
+    #define CASE(name)      case OP_##name
+    #define NEXT            goto dispatch
+dispatch:
+    switch (pc->op) {
+#endif
+    CASE(MOV): R[pc->a] = R[pc->b]; pc++; NEXT;
+    CASE(LOADI): R[pc->a].i = pc->k; pc++; NEXT;
+    CASE(LOADR): R[pc->a].r = reals[pc->k]; pc++; NEXT;
+    CASE(LOADS): R[pc->a].s = strs[pc->k]; pc++; NEXT;
+    CASE(LOADG): R[pc->a] = globals[pc->k]; pc++; NEXT;
+    CASE(STOREG): globals[pc->k] = R[pc->a]; pc++; NEXT;
+    // the int operations wrap around on overflow, like in the C code compiled with gcc
+    CASE(ADDI): R[pc->a].i = (int)((unsigned)R[pc->b].i + (unsigned)R[pc->c].i); pc++; NEXT;
+    CASE(SUBI): R[pc->a].i = (int)((unsigned)R[pc->b].i - (unsigned)R[pc->c].i); pc++; NEXT;
+    CASE(MULI): R[pc->a].i = (int)((unsigned)R[pc->b].i * (unsigned)R[pc->c].i); pc++; NEXT;
+    CASE(DIVI): {
+        int x = R[pc->b].i, y = R[pc->c].i;
+        if (!y) err("division by zero");
+        R[pc->a].i = y == -1 ? (int)(0u - (unsigned)x) : x / y;
+        pc++;
+        NEXT;
+    }
+    CASE(ADDR): R[pc->a].r = R[pc->b].r + R[pc->c].r; pc++; NEXT;
+    CASE(SUBR): R[pc->a].r = R[pc->b].r - R[pc->c].r; pc++; NEXT;
+    CASE(MULR): R[pc->a].r = R[pc->b].r * R[pc->c].r; pc++; NEXT;
+    CASE(DIVR): R[pc->a].r = R[pc->b].r / R[pc->c].r; pc++; NEXT;
+    CASE(LTI): R[pc->a].i = R[pc->b].i < R[pc->c].i; pc++; NEXT;
+    CASE(LEI): R[pc->a].i = R[pc->b].i <= R[pc->c].i; pc++; NEXT;
+    CASE(EQI): R[pc->a].i = R[pc->b].i == R[pc->c].i; pc++; NEXT;
+    CASE(NEI): R[pc->a].i = R[pc->b].i != R[pc->c].i; pc++; NEXT;
+    CASE(LTR): R[pc->a].i = R[pc->b].r < R[pc->c].r; pc++; NEXT;
+    CASE(LER): R[pc->a].i = R[pc->b].r <= R[pc->c].r; pc++; NEXT;
+    CASE(EQR): R[pc->a].i = R[pc->b].r == R[pc->c].r; pc++; NEXT;
+    CASE(NER): R[pc->a].i = R[pc->b].r != R[pc->c].r; pc++; NEXT;
+    // the strings are compared by address, like in C
+    CASE(LTS): R[pc->a].i = (uintptr_t)R[pc->b].s < (uintptr_t)R[pc->c].s; pc++; NEXT;
+    CASE(LES): R[pc->a].i = (uintptr_t)R[pc->b].s <= (uintptr_t)R[pc->c].s; pc++; NEXT;
+    CASE(EQS): R[pc->a].i = R[pc->b].s == R[pc->c].s; pc++; NEXT;
+    CASE(NES): R[pc->a].i = R[pc->b].s != R[pc->c].s; pc++; NEXT;
+    CASE(NEGI): R[pc->a].i = (int)(0u - (unsigned)R[pc->b].i); pc++; NEXT;
+    CASE(NEGR): R[pc->a].r = -R[pc->b].r; pc++; NEXT;
+    CASE(NOTI): R[pc->a].i = !R[pc->b].i; pc++; NEXT;
+    CASE(NOTR): R[pc->a].i = !R[pc->b].r; pc++; NEXT;
+    CASE(JMP): pc += pc->k; NEXT;
+    CASE(JZI): pc += R[pc->a].i ? 1 : pc->k; NEXT;
+    CASE(JZR): pc += R[pc->a].r ? 1 : pc->k; NEXT;
+    CASE(JZS): pc += R[pc->a].s ? 1 : pc->k; NEXT;
+    CASE(JNZI): pc += R[pc->a].i ? pc->k : 1; NEXT;
+    CASE(JNZR): pc += R[pc->a].r ? pc->k : 1; NEXT;
+    CASE(CALL): {
+        const Fn *f = &fns[pc->k];
+        if (fp == framesEnd || R + pc->a + f->nRegs > stackEnd) err("stack overflow in %s", f->name);
+        fp->ret = pc + 1;
+        fp->regs = R;
+        fp++;
+        R += pc->a;
+        pc = fnInstrs + f->start;
+        NEXT;
+    }
+    CASE(TAILCALL): {
+        const Fn *f = &fns[pc->k];
+        memmove(R, R + pc->a, f->nParams * sizeof(Value));
+        pc = fnInstrs + f->start;
+        NEXT;
+    }
+    CASE(RET): {
+        R[0] = R[pc->a];
+        fp--;
+        R = fp->regs;
+        pc = fp->ret;
+        NEXT;
+    }
+    CASE(PUTI): printf("%d\n", R[pc->a].i); pc++; NEXT;
+    CASE(PUTR): printf("%g\n", R[pc->a].r); pc++; NEXT;
+    CASE(PUTS): puts(R[pc->a].s); pc++; NEXT;
+    CASE(HALT): return;
+#if !defined(__GNUC__) || defined(VM_SWITCH)
+    }
+#endif
+    #undef CASE
+    #undef NEXT
+}
+
+void runVm(void) {
+    code = &mainCode;
+    emit(OP_HALT, 0, 0, 0);
+    if (mainRegs >= STACK_SIZE) err("the global code has too many registers");
+    Value *stack = (Value *)calloc(STACK_SIZE, sizeof(Value));
+    Value *globals = (Value *)calloc(stats.globals ? stats.globals : 1, sizeof(Value));
+    Frame *frames = (Frame *)malloc(MAX_FRAMES * sizeof(Frame));
+    if (!stack || !globals || !frames) err("not enough memory for the bytecode interpreter");
+    execute(mainCode.instrs, stack, globals, frames);
+    fflush(stdout);
+    free(frames);
+    free(globals);
+    free(stack);
+}
+
+VmStats vmStats(void) {
+    return stats;
+}
+
+void showVmStats(void) {
+    printf("VM: %d functions, %d global variables, %ld instructions (%zu bytes)\n",
+        stats.fns, stats.globals, stats.instrs, stats.instrs * sizeof(Instr));
+}
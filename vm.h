@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// A bytecode backend, used instead of the C code generator when vmMode is true (quick run file.q).
+// Each top-level item is compiled from its AST (see ast.h) to the instructions of a register machine,
+// then the global code is executed at the end of the program, without a C compiler.
+// Each function has a frame of registers: its parameters, its local variables and its temporaries.
+// A call puts its arguments in consecutive registers of the caller, which become the first registers
+// of the callee frame, and the result is returned in the first of them.
+// The global variables are in a separate array, and puti, putr and puts are instructions.
+// The interpreter jumps directly from an instruction to the next one (computed goto), if the C compiler supports it
+// and VM_SWITCH is not defined; else it uses a switch.
+extern bool vmMode;
+extern FILE *vmDump;        // if not NULL, the bytecode of each item is written in it
+
+// deletes the compiled functions and global code, before a new program is compiled
+void resetVm(void);
+
+// compiles the top-level item id: a global variable, a function or global instructions
+void compileBytecode(int id);
+
+// executes the global code compiled so far
+void runVm(void);
+
+typedef struct{
+    int fns;            // the compiled functions
+    int globals;        // the global variables
+    long instrs;        // the instructions of the functions and of the global code
+}VmStats;
+
+VmStats vmStats(void);
+void showVmStats(void);